@@ -49,6 +49,11 @@ public class HPCImageProcessing : ModuleRules
 
 		PrivateDependencyModuleNames.AddRange(new string[] {  });
         LoadCudaLib();
+        // The processing daemon uses the Winsock sockets
+        if (Target.Platform == UnrealTargetPlatform.Win64)
+        {
+            PublicAdditionalLibraries.Add("ws2_32.lib");
+        }
 		// Uncomment if you are using Slate UI
 		// PrivateDependencyModuleNames.AddRange(new string[] { "Slate", "SlateCore" });
 		
@@ -2,5 +2,38 @@
 
 #include "HPCImageProcessing.h"
 #include "Modules/ModuleManager.h"
+#include "Misc/CommandLine.h"
+#include "TextureCreator.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, HPCImageProcessing, "HPCImageProcessing" );
+/**
+ *	Game module. If the command line has -ProcessingDaemon=socket
+ *	the processing daemon is started with the module, so the game
+ *	can run headless (-nullrhi) as a server of other processes.
+ *	-DaemonWorkers, -DaemonQueue and -DaemonCache (megabytes) set
+ *	the workers, the capacity of the queue and the result cache
+ */
+class FHPCImageProcessingModule : public FDefaultGameModuleImpl
+{
+public:
+	virtual void StartupModule() override
+	{
+		FString socketPath;
+		int workerCount = 2, queueCapacity = 16, memoryBudget = 256;
+		if (FParse::Value(FCommandLine::Get(), TEXT("ProcessingDaemon="),
+			socketPath))
+		{
+			FParse::Value(FCommandLine::Get(), TEXT("DaemonWorkers="), workerCount);
+			FParse::Value(FCommandLine::Get(), TEXT("DaemonQueue="), queueCapacity);
+			FParse::Value(FCommandLine::Get(), TEXT("DaemonCache="), memoryBudget);
+			UTextureCreator::StartDaemon(socketPath, workerCount,
+				queueCapacity, memoryBudget);
+		}
+	}
+
+	virtual void ShutdownModule() override
+	{
+		UTextureCreator::StopDaemon();
+	}
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FHPCImageProcessingModule, HPCImageProcessing, "HPCImageProcessing" );
@@ -0,0 +1,283 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BatchDiamondSquare.h"
+#include "OpenMPDiamondSquare.h"
+
+/*
+*	BatchDiamondSquare constructor.
+*	It allocates the buffer of all the terrains and the
+*	interleaved matrices used by the threads
+*		jobs: size and seed of each terrain
+*		threadNumber: the number of thread to use
+*		maxBatchedSize: terrains larger than this size are computed
+*			one at a time with intra-image parallelism
+*/
+BatchDiamondSquare::BatchDiamondSquare(const TArray<DiamondSquareJob>& jobs,
+	int threadNumber, int maxBatchedSize)
+{
+	int64 arenaSize = 0;
+	int i;
+	this->jobs = jobs;
+	this->threadNum = threadNumber > 0 ? threadNumber : 1;
+	this->maxBatchedSize = maxBatchedSize;
+	this->executionTime = 0;
+	this->laneCells = 0;
+	for (i = 0; i < jobs.Num(); i++)
+	{
+		this->offsets.Add(arenaSize);
+		arenaSize += (int64)jobs[i].size * jobs[i].size;
+	}
+	this->BuildGroups();
+	this->arena = (uint8*)malloc(arenaSize > 0 ? arenaSize : 1);
+	this->lanes = (uint8*)malloc(this->laneCells > 0 ?
+		this->threadNum * this->laneCells * LANES : 1);
+}
+
+/*
+*	BatchDiamondSquare destructor.
+*	It frees the terrains and the interleaved matrices
+*/
+BatchDiamondSquare::~BatchDiamondSquare()
+{
+	free(this->arena);
+	free(this->lanes);
+}
+
+/*	PRIVATE
+*	It splits the jobs in groups of at most LANES terrains with
+*	the same size, from the largest ones so the threads end
+*	together, and sets the size of the interleaved matrices
+*/
+void BatchDiamondSquare::BuildGroups()
+{
+	TArray<int> order;
+	int i, first;
+	for (i = 0; i < this->jobs.Num(); i++)
+	{
+		if (this->jobs[i].size > this->maxBatchedSize)
+		{
+			this->largeJobs.Add(i);
+		}
+		else
+		{
+			order.Add(i);
+		}
+	}
+	const TArray<DiamondSquareJob>& jobList = this->jobs;
+	order.Sort([&jobList](int a, int b)
+	{
+		return jobList[a].size > jobList[b].size;
+	});
+	first = 0;
+	while (first < order.Num())
+	{
+		JobGroup group;
+		group.size = this->jobs[order[first]].size;
+		group.count = 0;
+		for (i = first; i < order.Num() && group.count < LANES
+			&& this->jobs[order[i]].size == group.size; i++)
+		{
+			group.jobs[group.count++] = order[i];
+		}
+		first = i;
+		this->groups.Add(group);
+		if ((int64)group.size * group.size > this->laneCells)
+		{
+			this->laneCells = (int64)group.size * group.size;
+		}
+	}
+}
+
+/*
+*	It computes all the terrains. Groups of small terrains are
+*	handed out to the threads, then large terrains are computed
+*	one at a time using all the threads.
+*	It returns false if the buffers could not be allocated
+*/
+bool BatchDiamondSquare::ExecuteBatch()
+{
+	int i;
+	double start;
+	if (this->arena == NULL || this->lanes == NULL)
+	{
+		return false;
+	}
+	start = omp_get_wtime();
+	#pragma omp parallel for schedule(dynamic, 1) num_threads(this->threadNum)
+	for (i = 0; i < this->groups.Num(); i++)
+	{
+		uint8* threadLanes = this->lanes +
+			omp_get_thread_num() * this->laneCells * LANES;
+		this->ExecuteGroup(this->groups[i], threadLanes);
+	}
+	for (i = 0; i < this->largeJobs.Num(); i++)
+	{
+		const DiamondSquareJob& job = this->jobs[this->largeJobs[i]];
+		OpenMPDiamondSquare diamondSquare(job.size, this->threadNum);
+		diamondSquare.SetSeed(job.seed);
+		uint8* terrain = diamondSquare.ExecuteDiamondSquare();
+		if (terrain == NULL)
+		{
+			return false;
+		}
+		FMemory::Memcpy(this->GetTerrain(this->largeJobs[i]), terrain,
+			(int64)job.size * job.size);
+	}
+	this->executionTime = omp_get_wtime() - start;
+	return true;
+}
+
+/*
+*	It returns the terrain of a job
+*		job: index of the job in the list given to the constructor
+*/
+uint8* BatchDiamondSquare::GetTerrain(int job) const
+{
+	return this->arena + this->offsets[job];
+}
+
+/*
+*	It returns the number of terrains computed per second
+*	by the last execution
+*/
+double BatchDiamondSquare::GetTerrainsPerSecond() const
+{
+	return this->executionTime > 0 ?
+		this->jobs.Num() / this->executionTime : 0;
+}
+
+/*	PRIVATE
+*	It computes the terrains of a group in the interleaved matrix
+*	and copies each one in its place of the buffer. Unused lanes
+*	repeat the first terrain so every step works on LANES values
+*		group: terrains to compute
+*		lanes: interleaved matrix of the thread
+*/
+void BatchDiamondSquare::ExecuteGroup(const JobGroup& group,
+	uint8* lanes) const
+{
+	uint32 seeds[LANES];
+	int size = group.size;
+	int last = size - 1;
+	int corners[4] = { 0, last, last * size, last * size + last };
+	int64 i;
+	int l, k, matrixSize, maxValue;
+	for (l = 0; l < LANES; l++)
+	{
+		seeds[l] = this->jobs[group.jobs[l < group.count ? l : 0]].seed;
+	}
+	// It inizializes matrix angles
+	for (k = 0; k < 4; k++)
+	{
+		for (l = 0; l < LANES; l++)
+		{
+			lanes[corners[k] * LANES + l] =
+				DiamondSquareHash(seeds[l], corners[k]) % MAX;
+		}
+	}
+	for (matrixSize = last, maxValue = MAX; matrixSize > 1;
+		matrixSize /= 2, maxValue /= 2)
+	{
+		this->DiamondLevel(lanes, seeds, size, matrixSize, maxValue);
+		this->SquareLevel(lanes, seeds, size, matrixSize, maxValue);
+	}
+	for (l = 0; l < group.count; l++)
+	{
+		uint8* terrain = this->GetTerrain(group.jobs[l]);
+		for (i = 0; i < (int64)size * size; i++)
+		{
+			terrain[i] = lanes[i * LANES + l];
+		}
+	}
+}
+
+/*	PRIVATE
+*	It executes the diamond step of a level on all the lanes.
+*	The random range is a power of two because maxValue starts
+*	from MAX, so the modulo of RandomValue is a mask
+*		lanes: interleaved matrix
+*		seeds: seed of each lane
+*		size: the length of the matrix row/column
+*		matrixSize: size of the squares of the level
+*		maxValue: random seed to use
+*/
+void BatchDiamondSquare::DiamondLevel(uint8* lanes, const uint32* seeds,
+	int size, int matrixSize, int maxValue) const
+{
+	int i, j, l;
+	int last = size - 1;
+	int half = matrixSize / 2;
+	int max = maxValue / 2 > 1 ? maxValue / 2 : 1;
+	uint32 mask = (uint32)(2 * max - 1);
+	for (i = half; i < last; i += matrixSize)
+	{
+		for (j = half; j < last; j += matrixSize)
+		{
+			uint64 index = (uint64)i * size + j;
+			uint8* target = lanes + index * LANES;
+			const uint8* topLeft = target - (half * size + half) * LANES;
+			const uint8* topRight = topLeft + matrixSize * LANES;
+			const uint8* bottomLeft = topLeft + matrixSize * size * LANES;
+			const uint8* bottomRight = bottomLeft + matrixSize * LANES;
+			for (l = 0; l < LANES; l++)
+			{
+				int value = topLeft[l] + topRight[l] +
+					bottomLeft[l] + bottomRight[l];
+				value += (int)(DiamondSquareHash(seeds[l], index) & mask) - max;
+				target[l] = value / 4;
+			}
+		}
+	}
+}
+
+/*	PRIVATE
+*	It executes the square step of a level on all the lanes.
+*	Missing neighbours of border cells are read as zero
+*		lanes: interleaved matrix
+*		seeds: seed of each lane
+*		size: the length of the matrix row/column
+*		matrixSize: size of the squares of the level
+*		maxValue: random seed to use
+*/
+void BatchDiamondSquare::SquareLevel(uint8* lanes, const uint32* seeds,
+	int size, int matrixSize, int maxValue) const
+{
+	static const uint8 zero[LANES] = { 0 };
+	int i, j, l;
+	int last = size - 1;
+	int half = matrixSize / 2;
+	int max = maxValue / 2 > 1 ? maxValue / 2 : 1;
+	uint32 mask = (uint32)(2 * max - 1);
+	for (i = 0; i < size; i += half)
+	{
+		for (j = i % matrixSize == 0 ? half : 0; j < size; j += matrixSize)
+		{
+			uint64 index = (uint64)i * size + j;
+			uint8* target = lanes + index * LANES;
+			const uint8* up = i != 0 ? target - half * size * LANES : zero;
+			const uint8* down = i != last ? target + half * size * LANES : zero;
+			const uint8* left = j != 0 ? target - half * LANES : zero;
+			const uint8* right = j != last ? target + half * LANES : zero;
+			int div = 4 - (i == 0) - (i == last) - (j == 0) - (j == last);
+			if (div == 4)
+			{
+				for (l = 0; l < LANES; l++)
+				{
+					int value = up[l] + down[l] + left[l] + right[l];
+					value += (int)(DiamondSquareHash(seeds[l], index) & mask) - max;
+					target[l] = value / 4;
+				}
+			}
+			else
+			{
+				for (l = 0; l < LANES; l++)
+				{
+					int value = up[l] + down[l] + left[l] + right[l];
+					value += (int)(DiamondSquareHash(seeds[l], index) & mask) - max;
+					target[l] = value / div;
+				}
+			}
+		}
+	}
+}
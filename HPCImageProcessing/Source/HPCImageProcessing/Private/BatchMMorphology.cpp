@@ -0,0 +1,255 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BatchMMorphology.h"
+
+/*
+*	BatchMMorphology constructor.
+*	It loads the structuring element and allocates the buffer of
+*	all the outputs and the planes used by the threads
+*		images: input images
+*		size: size of the structuring element
+*		threadNumber: the number of thread to use
+*/
+BatchMMorphology::BatchMMorphology(const TArray<FImage*>& images, int size,
+	int threadNumber)
+{
+	int64 arenaSize = 0;
+	int i, row, col;
+	this->images = images;
+	this->threadNum = threadNumber > 0 ? threadNumber : 1;
+	this->executionTime = 0;
+	this->planeSize = 0;
+	this->elementCount = 0;
+	this->elementRows = NULL;
+	this->elementCols = NULL;
+	this->arena = NULL;
+	this->structElem = MathematicalMorphology::LoadStructuringElement(size);
+	if (!this->structElem.element)
+	{
+		return;
+	}
+	this->elementRows = (int*)malloc(sizeof(int)*
+		this->structElem.width*this->structElem.height);
+	this->elementCols = (int*)malloc(sizeof(int)*
+		this->structElem.width*this->structElem.height);
+	for (row = 0; this->elementRows && this->elementCols
+		&& row < this->structElem.height; row++)
+	{
+		for (col = 0; col < this->structElem.width; col++)
+		{
+			if (this->structElem
+				.element[row*this->structElem.width + col] == FOREGROUND)
+			{
+				this->elementRows[this->elementCount] =
+					row - (this->structElem.height - 1) / 2;
+				this->elementCols[this->elementCount] =
+					col - (this->structElem.width - 1) / 2;
+				this->elementCount++;
+			}
+		}
+	}
+	for (i = 0; i < images.Num(); i++)
+	{
+		int64 padded = (int64)ImagePlane::GetPitch(
+			images[i]->SizeX + this->structElem.width - 1)*
+			(images[i]->SizeY + this->structElem.height - 1);
+		this->offsets.Add(arenaSize);
+		arenaSize += (int64)images[i]->SizeX * images[i]->SizeY * CHANNELS;
+		this->planeSize = padded > this->planeSize ? padded : this->planeSize;
+	}
+	this->arena = (uint8*)malloc(arenaSize > 0 ? arenaSize : 1);
+	for (i = 0; i < this->threadNum; i++)
+	{
+		WorkerScratch scratch;
+		scratch.planes = (uint8*)ImagePlane::Allocate(this->planeSize > 0 ?
+			2 * this->planeSize : 1);
+		scratch.erosionOffsets = (int*)malloc(sizeof(int)*
+			(this->elementCount > 0 ? this->elementCount : 1));
+		scratch.dilationOffsets = (int*)malloc(sizeof(int)*
+			(this->elementCount > 0 ? this->elementCount : 1));
+		scratch.offsetWidth = -1;
+		this->workers.Add(scratch);
+	}
+}
+
+/*
+*	BatchMMorphology destructor.
+*	It frees the outputs, the element and the planes of the threads
+*/
+BatchMMorphology::~BatchMMorphology()
+{
+	for (int i = 0; i < this->workers.Num(); i++)
+	{
+		ImagePlane::Free(this->workers[i].planes);
+		free(this->workers[i].erosionOffsets);
+		free(this->workers[i].dilationOffsets);
+	}
+	free(this->arena);
+	free(this->elementRows);
+	free(this->elementCols);
+	free(this->structElem.element);
+}
+
+/*
+*	It executes opening or closing on all the images, one image
+*	per thread at a time.
+*	It returns false if the element or the buffers are not available
+*		isOpening: true if it has to execute opening
+*/
+bool BatchMMorphology::ExecuteBatch(bool isOpening)
+{
+	int i;
+	double start;
+	if (!this->structElem.element || !this->elementRows
+		|| !this->elementCols || !this->arena)
+	{
+		return false;
+	}
+	for (i = 0; i < this->workers.Num(); i++)
+	{
+		if (!this->workers[i].planes || !this->workers[i].erosionOffsets
+			|| !this->workers[i].dilationOffsets)
+		{
+			return false;
+		}
+	}
+	start = omp_get_wtime();
+	#pragma omp parallel for schedule(dynamic, 1) num_threads(this->threadNum)
+	for (i = 0; i < this->images.Num(); i++)
+	{
+		this->ExecuteImage(i, isOpening, this->workers[omp_get_thread_num()]);
+	}
+	this->executionTime = omp_get_wtime() - start;
+	return true;
+}
+
+/*
+*	It returns the output of an image, in BGRA order
+*		image: index of the image in the list given to the constructor
+*/
+uint8* BatchMMorphology::GetOutput(int image) const
+{
+	return this->arena + this->offsets[image];
+}
+
+/*
+*	It returns the number of images computed per second
+*	by the last execution
+*/
+double BatchMMorphology::GetImagesPerSecond() const
+{
+	return this->executionTime > 0 ?
+		this->images.Num() / this->executionTime : 0;
+}
+
+/*	PRIVATE
+*	It executes opening or closing on an image, one channel at a time
+*		image: index of the image
+*		isOpening: true if it has to execute opening
+*		scratch: buffers of the thread
+*/
+void BatchMMorphology::ExecuteImage(int image, bool isOpening,
+	WorkerScratch& scratch) const
+{
+	FImage* input = this->images[image];
+	FColor* colors = input->AsBGRA8();
+	uint8* output = this->GetOutput(image);
+	int paddedWidth = ImagePlane::GetPitch(
+		input->SizeX + this->structElem.width - 1);
+	int paddedHeight = input->SizeY + this->structElem.height - 1;
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	uint8* in = scratch.planes;
+	uint8* middle = scratch.planes + this->planeSize;
+	int64 i, size = (int64)input->SizeX * input->SizeY;
+	this->SetOffsets(scratch, paddedWidth);
+	for (int c = 0; c < 3; c++)
+	{
+		// Opening erodes first, so its ghost cells are white
+		FMemory::Memset(in, isOpening ? WHITE : BLACK,
+			(int64)paddedWidth * paddedHeight);
+		FMemory::Memset(middle, isOpening ? BLACK : WHITE,
+			(int64)paddedWidth * paddedHeight);
+		for (int row = 0; row < input->SizeY; row++)
+		{
+			const FColor* source = colors + row * input->SizeX;
+			uint8* target = in + (row + firstRow) * paddedWidth + firstCol;
+			for (int col = 0; col < input->SizeX; col++)
+			{
+				target[col] = c == 0 ? source[col].R :
+					c == 1 ? source[col].G : source[col].B;
+			}
+		}
+		this->FilterPlane(in, middle + firstRow * paddedWidth + firstCol, 1,
+			paddedWidth, input->SizeX, input->SizeY, paddedWidth,
+			isOpening ? scratch.erosionOffsets : scratch.dilationOffsets,
+			isOpening);
+		// The output is BGRA, so red is the third byte
+		this->FilterPlane(middle, output + 2 - c, CHANNELS,
+			input->SizeX * CHANNELS, input->SizeX, input->SizeY, paddedWidth,
+			isOpening ? scratch.dilationOffsets : scratch.erosionOffsets,
+			!isOpening);
+	}
+	for (i = 0; i < size; i++)
+	{
+		output[i*CHANNELS + 3] = ALPHA;
+	}
+}
+
+/*	PRIVATE
+*	It computes the offsets of the element for planes of a width,
+*	if they are not the ones of the last image of the thread
+*		scratch: buffers of the thread
+*		width: pitch of the planes with ghost cells
+*/
+void BatchMMorphology::SetOffsets(WorkerScratch& scratch, int width) const
+{
+	if (scratch.offsetWidth == width)
+	{
+		return;
+	}
+	for (int i = 0; i < this->elementCount; i++)
+	{
+		scratch.erosionOffsets[i] =
+			this->elementRows[i] * width + this->elementCols[i];
+		scratch.dilationOffsets[i] = -scratch.erosionOffsets[i];
+	}
+	scratch.offsetWidth = width;
+}
+
+/*	PRIVATE
+*	It executes the erosion or dilation of a plane with ghost cells
+*		in: input plane
+*		out: first output pixel
+*		step: distance between two output pixels of a row
+*		outWidth: distance between two output rows
+*		width: width of the image
+*		height: height of the image
+*		paddedWidth: pitch of the input plane
+*		offsets: offsets of the element in the input plane
+*		isErosion: true for erosion, false for dilation
+*/
+void BatchMMorphology::FilterPlane(const uint8* in, uint8* out, int step,
+	int outWidth, int width, int height, int paddedWidth,
+	const int* offsets, bool isErosion) const
+{
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	for (int row = 0; row < height; row++)
+	{
+		const uint8* source = in + (row + firstRow) * paddedWidth + firstCol;
+		uint8* target = out + (int64)row * outWidth;
+		for (int col = 0; col < width; col++)
+		{
+			uint8 value = isErosion ? WHITE : BLACK;
+			for (int i = 0; i < this->elementCount; i++)
+			{
+				uint8 pixel = source[col + offsets[i]];
+				value = isErosion ? (pixel < value ? pixel : value) :
+					(pixel > value ? pixel : value);
+			}
+			target[col * step] = value;
+		}
+	}
+}
@@ -0,0 +1,448 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ChunkedDiamondSquare.h"
+
+/*
+*	TerrainChunk constructor.
+*	It allocates the space for the samples
+*		chunkKey: position and level of the chunk
+*		chunkSize: the length of the chunk row/column
+*/
+TerrainChunk::TerrainChunk(ChunkKey chunkKey, int chunkSize)
+{
+	this->key = chunkKey;
+	this->size = chunkSize;
+	this->samples = (uint8*)malloc(sizeof(uint8)*chunkSize*chunkSize);
+}
+
+/*
+*	TerrainChunk destructor.
+*	It frees the samples allocated space
+*/
+TerrainChunk::~TerrainChunk()
+{
+	free(this->samples);
+}
+
+/*
+*	ChunkedDiamondSquare constructor.
+*		worldSeed: seed of the whole terrain
+*		chunkSize: the length of a chunk row/column, it has to be 2^n+1
+*		topLevel: level of the coarsest chunks, the ones computed
+*			without a parent
+*		cacheCapacity: number of chunks kept in the cache
+*/
+ChunkedDiamondSquare::ChunkedDiamondSquare(uint32 worldSeed, int chunkSize,
+	int topLevel, int cacheCapacity)
+{
+	this->worldSeed = worldSeed;
+	this->chunkSize = chunkSize;
+	this->topLevel = topLevel;
+	this->cacheCapacity = cacheCapacity;
+}
+
+/*
+*	ChunkedDiamondSquare destructor.
+*	Chunks still used by the caller are freed when they are released
+*/
+ChunkedDiamondSquare::~ChunkedDiamondSquare()
+{
+	this->cache.Empty();
+	this->usage.Empty();
+}
+
+/*
+*	It returns a chunk, computing it and its missing
+*	ancestors if it is not in the cache
+*		chunkX: column of the chunk at its level
+*		chunkY: row of the chunk at its level
+*		level: level of the chunk, between 0 and topLevel
+*/
+TSharedPtr<TerrainChunk> ChunkedDiamondSquare::GetChunk(int chunkX,
+	int chunkY, int level)
+{
+	TArray<ChunkKey> keys;
+	TMap<ChunkKey, TSharedPtr<TerrainChunk>> chunks;
+	ChunkKey key = { chunkX, chunkY, level };
+	keys.Add(key);
+	this->BuildChunks(keys, 1, chunks);
+	return chunks.FindRef(key);
+}
+
+/*
+*	It computes in parallel the chunks of a set that are not in the cache
+*	and puts them in the cache. Missing ancestors are computed level
+*	by level, from the top one, and each level is split among threads.
+*	It returns false if a chunk cannot be computed
+*		keys: the chunks to compute
+*		threadNumber: the number of threads to use
+*/
+bool ChunkedDiamondSquare::GenerateChunks(const TArray<ChunkKey>& keys,
+	int threadNumber)
+{
+	TMap<ChunkKey, TSharedPtr<TerrainChunk>> chunks;
+	return this->BuildChunks(keys, threadNumber, chunks);
+}
+
+/*	PRIVATE
+*	It finds or computes the chunks of a set and their ancestors.
+*	Chunks whose samples cannot be allocated, or whose parent is
+*	missing, are not cached and it returns false
+*		keys: the chunks to compute
+*		threadNumber: the number of threads to use
+*		chunks: map that receives the chunks of the set and the
+*			ancestors used to compute them
+*/
+bool ChunkedDiamondSquare::BuildChunks(const TArray<ChunkKey>& keys,
+	int threadNumber, TMap<ChunkKey, TSharedPtr<TerrainChunk>>& chunks)
+{
+	TArray<TArray<ChunkKey>> missing;
+	bool isCompleted = true;
+	missing.SetNum(this->topLevel + 1);
+	// It collects the missing chunks and ancestors for each level
+	for (int i = 0; i < keys.Num(); i++)
+	{
+		ChunkKey key = keys[i];
+		if (key.Level < 0 || key.Level > this->topLevel)
+		{
+			continue;
+		}
+		while (!chunks.Contains(key))
+		{
+			TSharedPtr<TerrainChunk> chunk = this->FindChunk(key);
+			chunks.Add(key, chunk);
+			if (chunk.IsValid())
+			{
+				break;
+			}
+			missing[key.Level].Add(key);
+			if (key.Level == this->topLevel)
+			{
+				break;
+			}
+			key = this->GetParent(key);
+		}
+	}
+	for (int level = this->topLevel; level >= 0; level--)
+	{
+		TArray<ChunkKey>& levelKeys = missing[level];
+		TArray<TSharedPtr<TerrainChunk>> created;
+		TArray<TerrainChunk*> parents;
+		TArray<bool> generated;
+		int count = levelKeys.Num();
+		generated.SetNum(count);
+		for (int i = 0; i < count; i++)
+		{
+			created.Add(MakeShareable(
+				new TerrainChunk(levelKeys[i], this->chunkSize)));
+			parents.Add(level == this->topLevel ? NULL :
+				chunks.FindRef(this->GetParent(levelKeys[i])).Get());
+		}
+		omp_set_num_threads(threadNumber > 0 ? threadNumber : 1);
+#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < count; i++)
+		{
+			if (level == this->topLevel)
+			{
+				generated[i] = this->GenerateTopChunk(created[i].Get());
+			}
+			else
+			{
+				generated[i] = this->GenerateChildChunk(created[i].Get(),
+					parents[i]);
+			}
+		}
+		for (int i = 0; i < count; i++)
+		{
+			if (generated[i])
+			{
+				chunks.Add(levelKeys[i], created[i]);
+				this->AddChunk(created[i]);
+			}
+			else
+			{
+				isCompleted = false;
+			}
+		}
+	}
+	return isCompleted;
+}
+
+/*	PRIVATE
+*	It returns a chunk of the cache and marks it as
+*	the most recently used, NULL if it is not cached
+*		key: the chunk to find
+*/
+TSharedPtr<TerrainChunk> ChunkedDiamondSquare::FindChunk(const ChunkKey& key)
+{
+	CacheEntry* entry = this->cache.Find(key);
+	if (!entry)
+	{
+		return NULL;
+	}
+	this->usage.RemoveNode(entry->node);
+	this->usage.AddHead(key);
+	entry->node = this->usage.GetHead();
+	return entry->chunk;
+}
+
+/*	PRIVATE
+*	It adds a chunk to the cache, removing the least
+*	recently used ones if the cache is full
+*		chunk: the chunk to add
+*/
+void ChunkedDiamondSquare::AddChunk(const TSharedPtr<TerrainChunk>& chunk)
+{
+	CacheEntry entry;
+	if (this->cacheCapacity <= 0 || this->cache.Contains(chunk->key))
+	{
+		return;
+	}
+	while (this->cache.Num() >= this->cacheCapacity)
+	{
+		TDoubleLinkedList<ChunkKey>::TDoubleLinkedListNode* last =
+			this->usage.GetTail();
+		this->cache.Remove(last->GetValue());
+		this->usage.RemoveNode(last);
+	}
+	this->usage.AddHead(chunk->key);
+	entry.chunk = chunk;
+	entry.node = this->usage.GetHead();
+	this->cache.Add(chunk->key, entry);
+}
+
+/*	PRIVATE
+*	It returns the key of the chunk of the upper
+*	level that contains the given chunk
+*		key: the chunk
+*/
+ChunkKey ChunkedDiamondSquare::GetParent(const ChunkKey& key) const
+{
+	// Division rounded down also for negative coordinates
+	ChunkKey parent = { key.X >= 0 ? key.X / 2 : (key.X - 1) / 2,
+		key.Y >= 0 ? key.Y / 2 : (key.Y - 1) / 2, key.Level + 1 };
+	return parent;
+}
+
+/*	PRIVATE
+*	It returns the depth of the finest diamond-square level of a
+*	chunk, used to scale random values: the levels of a top chunk
+*	have depths from 0 to log2(chunkSize - 1) - 1 and every level
+*	below adds one
+*		level: level of the chunk
+*/
+int ChunkedDiamondSquare::GetDepth(int level) const
+{
+	int depth = -1;
+	for (int step = this->chunkSize - 1; step > 1; step /= 2)
+	{
+		depth++;
+	}
+	return depth + this->topLevel - level;
+}
+
+/*	PRIVATE
+*	It computes a chunk of the top level with the diamond-square
+*	algorithm. Corners and edges only depend on the world position.
+*	It returns false if the samples have not been allocated
+*		chunk: the chunk to compute
+*/
+bool ChunkedDiamondSquare::GenerateTopChunk(TerrainChunk* chunk) const
+{
+	int last = this->chunkSize - 1;
+	int maxValue = MAX;
+	uint32 levelSeed = DiamondSquareHash(this->worldSeed, chunk->key.Level);
+	if (!chunk->samples)
+	{
+		return false;
+	}
+	for (int row = 0; row <= last; row += last)
+	{
+		for (int col = 0; col <= last; col += last)
+		{
+			uint32 hash = DiamondSquareHash(levelSeed,
+				((uint64)(uint32)(chunk->key.Y * last + row) << 32) |
+				(uint32)(chunk->key.X * last + col));
+			chunk->samples[row*this->chunkSize + col] = hash % MAX;
+		}
+	}
+	for (int matrixSize = last; matrixSize > 1; matrixSize /= 2)
+	{
+		int half = matrixSize / 2;
+		this->GenerateEdges(chunk, matrixSize, maxValue);
+		for (int row = half; row < last; row += matrixSize)
+		{
+			for (int col = half; col < last; col += matrixSize)
+			{
+				this->DiamondStep(chunk, row, col, half, maxValue);
+			}
+		}
+		// Square step only on the inner cells, edges are already set
+		for (int row = half; row < last; row += half)
+		{
+			int startIndex = row % matrixSize == 0 ? half : matrixSize;
+			for (int col = startIndex; col < last; col += matrixSize)
+			{
+				this->SquareStep(chunk, row, col, half, maxValue);
+			}
+		}
+		maxValue /= 2;
+	}
+	return true;
+}
+
+/*	PRIVATE
+*	It computes a chunk taking every other sample from the
+*	parent chunk and the others with one diamond-square level.
+*	It returns false if the samples of the chunk or of the parent
+*	are missing
+*		chunk: the chunk to compute
+*		parent: the chunk of the upper level that contains it
+*/
+bool ChunkedDiamondSquare::GenerateChildChunk(TerrainChunk* chunk,
+	const TerrainChunk* parent) const
+{
+	int last = this->chunkSize - 1;
+	int depth = this->GetDepth(chunk->key.Level);
+	int maxValue = depth < 9 ? MAX >> depth : 0;
+	int firstRow, firstCol;
+	if (!chunk->samples || !parent || !parent->samples)
+	{
+		return false;
+	}
+	// Position of the chunk inside the parent
+	firstRow = (chunk->key.Y - 2 * parent->key.Y) * last / 2;
+	firstCol = (chunk->key.X - 2 * parent->key.X) * last / 2;
+	for (int row = 0; row <= last; row += 2)
+	{
+		for (int col = 0; col <= last; col += 2)
+		{
+			chunk->samples[row*this->chunkSize + col] = parent->samples
+				[(firstRow + row / 2)*this->chunkSize + firstCol + col / 2];
+		}
+	}
+	this->GenerateEdges(chunk, 2, maxValue);
+	for (int row = 1; row < last; row += 2)
+	{
+		for (int col = 1; col < last; col += 2)
+		{
+			this->DiamondStep(chunk, row, col, 1, maxValue);
+		}
+	}
+	for (int row = 1; row < last; row++)
+	{
+		for (int col = 1 + row % 2; col < last; col += 2)
+		{
+			this->SquareStep(chunk, row, col, 1, maxValue);
+		}
+	}
+	return true;
+}
+
+/*	PRIVATE
+*	It sets the middle cells of the segments of the four edges
+*	with the average of the segment ends plus a random value.
+*	It only uses cells of the edge, so the edge shared by two
+*	chunks has the same values in both
+*		chunk: the chunk to compute
+*		matrixSize: length of the segments
+*		maxValue: random seed
+*/
+void ChunkedDiamondSquare::GenerateEdges(TerrainChunk* chunk,
+	int matrixSize, int maxValue) const
+{
+	int last = this->chunkSize - 1;
+	int half = matrixSize / 2;
+	uint8* samples = chunk->samples;
+	for (int edge = 0; edge <= last; edge += last)
+	{
+		for (int i = half; i < last; i += matrixSize)
+		{
+			// Horizontal edge
+			int value = samples[edge*this->chunkSize + i - half] +
+				samples[edge*this->chunkSize + i + half] +
+				this->RandomValue(chunk, edge, i, maxValue);
+			value /= 2;
+			samples[edge*this->chunkSize + i] =
+				value < 0 ? 0 : (value > MAX - 1 ? MAX - 1 : value);
+			// Vertical edge
+			value = samples[(i - half)*this->chunkSize + edge] +
+				samples[(i + half)*this->chunkSize + edge] +
+				this->RandomValue(chunk, i, edge, maxValue);
+			value /= 2;
+			samples[i*this->chunkSize + edge] =
+				value < 0 ? 0 : (value > MAX - 1 ? MAX - 1 : value);
+		}
+	}
+}
+
+/*	PRIVATE
+*	Diamond step: it sets the center cell of a square with the
+*	average of the angles plus a random value.
+*		chunk: the chunk to compute
+*		row: row index of the center
+*		column: column index of the center
+*		adding: half of the square size
+*		maxValue: random seed
+*/
+void ChunkedDiamondSquare::DiamondStep(TerrainChunk* chunk, int row,
+	int column, int adding, int maxValue) const
+{
+	uint8* samples = chunk->samples;
+	int value = samples[(row - adding)*this->chunkSize + column - adding] +
+		samples[(row - adding)*this->chunkSize + column + adding] +
+		samples[(row + adding)*this->chunkSize + column - adding] +
+		samples[(row + adding)*this->chunkSize + column + adding] +
+		this->RandomValue(chunk, row, column, maxValue);
+	value /= 4;
+	samples[row*this->chunkSize + column] =
+		value < 0 ? 0 : (value > MAX - 1 ? MAX - 1 : value);
+}
+
+/*	PRIVATE
+*	Square step: it sets the center cell of a diamond with the
+*	average of the angles plus a random value. The cell must
+*	not be on an edge of the chunk
+*		chunk: the chunk to compute
+*		row: row index of the center
+*		column: column index of the center
+*		adding: half of the diamond size
+*		maxValue: random seed
+*/
+void ChunkedDiamondSquare::SquareStep(TerrainChunk* chunk, int row,
+	int column, int adding, int maxValue) const
+{
+	uint8* samples = chunk->samples;
+	int value = samples[(row - adding)*this->chunkSize + column] +
+		samples[(row + adding)*this->chunkSize + column] +
+		samples[row*this->chunkSize + column - adding] +
+		samples[row*this->chunkSize + column + adding] +
+		this->RandomValue(chunk, row, column, maxValue);
+	value /= 4;
+	samples[row*this->chunkSize + column] =
+		value < 0 ? 0 : (value > MAX - 1 ? MAX - 1 : value);
+}
+
+/*	PRIVATE
+*	It returns the random displacement of a cell in the range
+*	[-maxValue/2, maxValue/2). It is a hash of the world seed,
+*	of the level and of the world position of the cell
+*		chunk: the chunk that contains the cell
+*		row: row index in the chunk
+*		column: column index in the chunk
+*		maxValue: random seed
+*/
+int ChunkedDiamondSquare::RandomValue(const TerrainChunk* chunk, int row,
+	int column, int maxValue) const
+{
+	int last = this->chunkSize - 1;
+	int max = maxValue / 2 > 1 ? maxValue / 2 : 1;
+	int min = -max;
+	uint32 levelSeed = DiamondSquareHash(this->worldSeed, chunk->key.Level);
+	uint32 worldRow = (uint32)(chunk->key.Y * last + row);
+	uint32 worldCol = (uint32)(chunk->key.X * last + column);
+	uint32 hash = DiamondSquareHash(levelSeed,
+		((uint64)worldRow << 32) | worldCol);
+	return min + (int)(hash % (uint32)(max - min));
+}
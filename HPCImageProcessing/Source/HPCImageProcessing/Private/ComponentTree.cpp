@@ -0,0 +1,422 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ComponentTree.h"
+#include "MathematicalMorphology.h"
+
+/*
+*	ComponentTree constructor.
+*	It copies the channel and allocates the tree
+*		channel: input channel of width x height pixels
+*		width: width of the channel
+*		height: height of the channel
+*		isMaxTree: true for the max-tree (openings),
+*			false for the min-tree (closings)
+*/
+ComponentTree::ComponentTree(const uint8* channel, int width, int height,
+	bool isMaxTree)
+{
+	this->width = width;
+	this->height = height;
+	this->size = width * height;
+	this->isMaxTree = isMaxTree;
+	this->isBuilt = false;
+	this->tileCount = 0;
+	this->tileRows = 0;
+	this->segmentStart = NULL;
+	this->segmentCount = NULL;
+	this->values = (uint8*)malloc(sizeof(uint8)*this->size);
+	this->parent = (int*)malloc(sizeof(int)*this->size);
+	this->zpar = (int*)malloc(sizeof(int)*this->size);
+	this->area = (int64*)malloc(sizeof(int64)*this->size);
+	this->order = (int*)malloc(sizeof(int)*this->size);
+	if (this->values)
+	{
+		for (int i = 0; i < this->size; i++)
+		{
+			this->values[i] = isMaxTree ? channel[i] : WHITE - channel[i];
+		}
+	}
+}
+
+/*
+*	ComponentTree destructor.
+*	It frees the tree
+*/
+ComponentTree::~ComponentTree()
+{
+	free(this->values);
+	free(this->parent);
+	free(this->zpar);
+	free(this->area);
+	free(this->order);
+	free(this->segmentStart);
+	free(this->segmentCount);
+}
+
+/*
+*	It builds the tree and computes the area of the nodes.
+*	It returns false if the buffers could not be allocated
+*		threadNumber: the number of thread to use
+*/
+bool ComponentTree::Build(int threadNumber)
+{
+	int tileCount = threadNumber > 1 ? threadNumber : 1;
+	int tile, distance;
+	if (!this->values || !this->parent || !this->zpar
+		|| !this->area || !this->order)
+	{
+		return false;
+	}
+	tileCount = tileCount < this->height ? tileCount : this->height;
+	tileCount = tileCount > 0 ? tileCount : 1;
+	free(this->segmentStart);
+	free(this->segmentCount);
+	this->segmentStart = (int*)malloc(sizeof(int)*tileCount*TREE_LEVELS);
+	this->segmentCount = (int*)malloc(sizeof(int)*tileCount*TREE_LEVELS);
+	if (!this->segmentStart || !this->segmentCount)
+	{
+		return false;
+	}
+	this->tileRows = (this->height + tileCount - 1) / tileCount;
+	this->tileCount = (this->height + this->tileRows - 1) / this->tileRows;
+	this->SortPixels(threadNumber);
+	#pragma omp parallel for num_threads(threadNumber > 0 ? threadNumber : 1)
+	for (tile = 0; tile < this->tileCount; tile++)
+	{
+		this->BuildTile(tile);
+	}
+	// Tiles are merged in pairs of groups: a merge only touches
+	// the nodes of its two groups, so merges of a round are independent
+	for (distance = 1; distance < this->tileCount; distance *= 2)
+	{
+		#pragma omp parallel for num_threads(threadNumber > 0 ? threadNumber : 1)
+		for (tile = distance - 1; tile < this->tileCount - 1;
+			tile += 2 * distance)
+		{
+			this->MergeTiles(tile, tile + 1);
+		}
+	}
+	this->ComputeArea();
+	this->isBuilt = true;
+	return true;
+}
+
+/*
+*	It computes the area opening (max-tree) or closing (min-tree):
+*	components with less than minArea pixels are merged with
+*	their parent
+*		minArea: minimum area of the components to keep
+*		output: output channel of width x height pixels
+*/
+void ComponentTree::AreaFilter(int64 minArea, uint8* output) const
+{
+	const int64* area = this->area;
+	this->AttributeFilter([area, minArea](int node)
+	{
+		return area[node] >= minArea;
+	}, output);
+}
+
+/*
+*	It computes a generic attribute filter: each pixel takes the
+*	level of the closest node that contains it and satisfies the
+*	criterion. The criterion should be increasing (true for the
+*	parent of a node for which it is true), as area is
+*		criterion: function that returns true for the nodes to keep
+*		output: output channel of width x height pixels
+*/
+void ComponentTree::AttributeFilter(TFunction<bool(int node)> criterion,
+	uint8* output) const
+{
+	int i;
+	if (!this->isBuilt)
+	{
+		return;
+	}
+	// Nodes from the root, so the parent is always computed first
+	for (i = 0; i < this->size; i++)
+	{
+		int node = this->order[i];
+		if (this->IsNode(node))
+		{
+			output[node] = this->parent[node] == node || criterion(node) ?
+				this->values[node] : output[this->parent[node]];
+		}
+	}
+	for (i = 0; i < this->size; i++)
+	{
+		if (!this->IsNode(i))
+		{
+			output[i] = output[this->parent[i]];
+		}
+	}
+	if (!this->isMaxTree)
+	{
+		for (i = 0; i < this->size; i++)
+		{
+			output[i] = WHITE - output[i];
+		}
+	}
+}
+
+/*
+*	It returns true if a pixel is the level root of a node
+*		pixel: index of the pixel
+*/
+bool ComponentTree::IsNode(int pixel) const
+{
+	int parentPixel = this->parent[pixel];
+	return parentPixel == pixel ||
+		this->values[parentPixel] != this->values[pixel];
+}
+
+/*
+*	It returns the level of a node in the channel
+*		node: level root of the node
+*/
+uint8 ComponentTree::GetLevel(int node) const
+{
+	return this->isMaxTree ? this->values[node] : WHITE - this->values[node];
+}
+
+/*	PRIVATE
+*	It sorts the pixels by increasing value with a counting sort.
+*	Each tile counts and places its pixels in parallel, so the pixels
+*	of a level are stored tile by tile
+*		threadNumber: the number of thread to use
+*/
+void ComponentTree::SortPixels(int threadNumber)
+{
+	int tile, level, start = 0;
+	#pragma omp parallel for num_threads(threadNumber > 0 ? threadNumber : 1)
+	for (tile = 0; tile < this->tileCount; tile++)
+	{
+		int* count = this->segmentCount + tile * TREE_LEVELS;
+		int endRow = (tile + 1) * this->tileRows;
+		endRow = endRow < this->height ? endRow : this->height;
+		for (int i = 0; i < TREE_LEVELS; i++)
+		{
+			count[i] = 0;
+		}
+		for (int i = tile * this->tileRows * this->width;
+			i < endRow * this->width; i++)
+		{
+			count[this->values[i]]++;
+		}
+	}
+	for (level = 0; level < TREE_LEVELS; level++)
+	{
+		for (tile = 0; tile < this->tileCount; tile++)
+		{
+			this->segmentStart[tile * TREE_LEVELS + level] = start;
+			start += this->segmentCount[tile * TREE_LEVELS + level];
+		}
+	}
+	#pragma omp parallel for num_threads(threadNumber > 0 ? threadNumber : 1)
+	for (tile = 0; tile < this->tileCount; tile++)
+	{
+		int next[TREE_LEVELS];
+		int endRow = (tile + 1) * this->tileRows;
+		endRow = endRow < this->height ? endRow : this->height;
+		for (int i = 0; i < TREE_LEVELS; i++)
+		{
+			next[i] = this->segmentStart[tile * TREE_LEVELS + i];
+		}
+		for (int i = tile * this->tileRows * this->width;
+			i < endRow * this->width; i++)
+		{
+			this->order[next[this->values[i]]++] = i;
+		}
+	}
+}
+
+/*	PRIVATE
+*	It builds the tree of a tile with union-find: pixels are
+*	visited from the highest value and each one becomes the parent
+*	of the roots of the components of its visited neighbours
+*		tile: index of the tile
+*/
+void ComponentTree::BuildTile(int tile)
+{
+	int firstPixel = tile * this->tileRows * this->width;
+	int endRow = (tile + 1) * this->tileRows;
+	int endPixel = (endRow < this->height ? endRow : this->height) *
+		this->width;
+	int level, i, k;
+	for (i = firstPixel; i < endPixel; i++)
+	{
+		this->zpar[i] = -1;
+	}
+	for (level = TREE_LEVELS - 1; level >= 0; level--)
+	{
+		int start = this->segmentStart[tile * TREE_LEVELS + level];
+		int end = start + this->segmentCount[tile * TREE_LEVELS + level];
+		for (i = end - 1; i >= start; i--)
+		{
+			int pixel = this->order[i];
+			int col = pixel % this->width;
+			int neighbours[4] = { pixel - this->width, pixel - 1,
+				pixel + 1, pixel + this->width };
+			bool isInside[4] = { pixel - this->width >= firstPixel,
+				col > 0, col < this->width - 1,
+				pixel + this->width < endPixel };
+			this->parent[pixel] = pixel;
+			this->zpar[pixel] = pixel;
+			for (k = 0; k < 4; k++)
+			{
+				if (isInside[k] && this->zpar[neighbours[k]] != -1)
+				{
+					int root = this->FindRoot(neighbours[k]);
+					if (root != pixel)
+					{
+						this->parent[root] = pixel;
+						this->zpar[root] = pixel;
+					}
+				}
+			}
+		}
+	}
+}
+
+/*	PRIVATE
+*	It merges the trees of two groups of tiles connecting
+*	the pixels of the last row of the upper tile with the
+*	pixels of the first row of the lower tile
+*		upperTile: last tile of the upper group
+*		lowerTile: first tile of the lower group
+*/
+void ComponentTree::MergeTiles(int upperTile, int lowerTile)
+{
+	int firstPixel = lowerTile * this->tileRows * this->width;
+	for (int col = 0; col < this->width; col++)
+	{
+		this->Connect(firstPixel + col - this->width, firstPixel + col);
+	}
+}
+
+/*	PRIVATE
+*	It connects two neighbouring pixels of different trees: the
+*	branches from their nodes to the roots are merged like two lists
+*	sorted by level, and nodes with the same level are unified
+*		first: index of the first pixel
+*		second: index of the second pixel
+*/
+void ComponentTree::Connect(int first, int second)
+{
+	int upper = this->LevelRoot(first);
+	int lower = this->LevelRoot(second);
+	int swap, next;
+	if (this->values[upper] < this->values[lower])
+	{
+		swap = upper;
+		upper = lower;
+		lower = swap;
+	}
+	while (upper != lower && lower != -1)
+	{
+		next = this->ParentNode(upper);
+		if (next != -1 && this->values[next] >= this->values[lower])
+		{
+			// The lower node is below the parent of the upper one
+			upper = next;
+		}
+		else if (this->values[upper] == this->values[lower])
+		{
+			// Same level: the two nodes become one
+			next = this->ParentNode(lower);
+			this->parent[lower] = upper;
+			lower = next;
+		}
+		else
+		{
+			// The lower node is between the upper one and its parent
+			this->parent[upper] = lower;
+			upper = lower;
+			lower = next;
+		}
+	}
+}
+
+/*	PRIVATE
+*	It returns the root of the union-find tree of a pixel
+*	and compresses the path
+*		pixel: index of the pixel
+*/
+int ComponentTree::FindRoot(int pixel)
+{
+	int root = pixel;
+	while (this->zpar[root] != root)
+	{
+		root = this->zpar[root];
+	}
+	while (this->zpar[pixel] != root)
+	{
+		int next = this->zpar[pixel];
+		this->zpar[pixel] = root;
+		pixel = next;
+	}
+	return root;
+}
+
+/*	PRIVATE
+*	It returns the level root of the node of a pixel
+*	and compresses the path
+*		pixel: index of the pixel
+*/
+int ComponentTree::LevelRoot(int pixel)
+{
+	int root = pixel;
+	while (this->parent[root] != root &&
+		this->values[this->parent[root]] == this->values[root])
+	{
+		root = this->parent[root];
+	}
+	while (pixel != root)
+	{
+		int next = this->parent[pixel];
+		this->parent[pixel] = root;
+		pixel = next;
+	}
+	return root;
+}
+
+/*	PRIVATE
+*	It returns the level root of the parent of a node, -1 for the root
+*		node: level root of the node
+*/
+int ComponentTree::ParentNode(int node)
+{
+	return this->parent[node] == node ? -1 :
+		this->LevelRoot(this->parent[node]);
+}
+
+/*	PRIVATE
+*	It makes every pixel point to a level root and computes
+*	the area of the nodes, from the highest level
+*/
+void ComponentTree::ComputeArea()
+{
+	int i;
+	for (i = 0; i < this->size; i++)
+	{
+		int root = this->LevelRoot(i);
+		if (root == i && this->parent[i] != i)
+		{
+			this->parent[i] = this->LevelRoot(this->parent[i]);
+		}
+		this->area[i] = 0;
+	}
+	for (i = 0; i < this->size; i++)
+	{
+		this->area[this->IsNode(i) ? i : this->parent[i]]++;
+	}
+	for (i = this->size - 1; i >= 0; i--)
+	{
+		int node = this->order[i];
+		if (this->IsNode(node) && this->parent[node] != node)
+		{
+			this->area[this->parent[node]] += this->area[node];
+		}
+	}
+}
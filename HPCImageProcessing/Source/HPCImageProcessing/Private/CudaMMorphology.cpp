@@ -5,15 +5,34 @@
 /*
 *	It executes operations calling the function of
 *	MathematicalMorphologyCuda library that uses
-*	CUDA kernels
+*	CUDA kernels. The library stores the channels without
+*	pitch, so the offsets are computed again for its width.
+*	The first mip is computed by the library on the device
 */
 uint8* CudaMMorphology::ExecuteOpeningOrClosing(bool isOpening)
 {
-	uint8* output = CudaMathMorphology::ExecuteOpeningOrClosing(
-		this->structElem.width, this->structElem.height,
-		this->input->RawData.GetData(), this->input->SizeX,
-		this->input->SizeY, this->ErosionOffsets.offsets,
-		this->ErosionOffsets.count, this->DilationOffsets.offsets,
-		this->DilationOffsets.count, isOpening);
+	Offset erosion, dilation;
+	uint8* output = NULL;
+	int elemSize, width;
+	if (!this->input || !this->structElem.element)
+	{
+		return NULL;
+	}
+	elemSize = this->structElem.width*this->structElem.height;
+	width = this->input->SizeX + this->structElem.width - 1;
+	erosion.offsets = (int*)malloc(sizeof(int)*elemSize);
+	dilation.offsets = (int*)malloc(sizeof(int)*elemSize);
+	if (erosion.offsets && dilation.offsets)
+	{
+		this->SetOffsets(&erosion, false, width);
+		this->SetOffsets(&dilation, true, width);
+		output = CudaMathMorphology::ExecuteOpeningOrClosing(
+			this->structElem.width, this->structElem.height,
+			this->input->RawData.GetData(), this->input->SizeX,
+			this->input->SizeY, erosion.offsets, erosion.count,
+			dilation.offsets, dilation.count, isOpening, this->firstMip);
+	}
+	free(erosion.offsets);
+	free(dilation.offsets);
 	return output;
 }
\ No newline at end of file
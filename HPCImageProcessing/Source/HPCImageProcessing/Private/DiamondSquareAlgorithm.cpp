@@ -13,6 +13,9 @@ DiamondSquareAlgorithm::DiamondSquareAlgorithm(int size)
 	int imageSize = sizeof(uint8)*size*size;
 	this->image = (uint8*)malloc(imageSize);
 	this->size = size;
+	this->seed = (uint32)time(0);
+	this->previewInterval = 1;
+	this->maxPreviewSize = 0;
 }
 
 /*
@@ -23,3 +26,199 @@ DiamondSquareAlgorithm::~DiamondSquareAlgorithm()
 {
 	free(this->image);
 }
+
+/*
+*	It sets the seed used by the counter-based random generator.
+*	Two executions with the same seed and size produce the same terrain
+*		newSeed: the seed to use
+*/
+void DiamondSquareAlgorithm::SetSeed(uint32 newSeed)
+{
+	this->seed = newSeed;
+}
+
+/*
+*	It sets the function called each time a level is completed with a
+*	downsampled view of the matrix: the cells whose indices are multiple
+*	of the current step. The function can be called by any thread that
+*	computes the matrix, while the other threads compute the next levels.
+*	Views larger than maxPreviewSize are not sent, so the last levels,
+*	that are the most expensive ones, are not slowed down
+*		callback: the function, it receives the view, the length of the
+*			view row/column and the step between two cells of the view
+*		levelInterval: a view is sent every levelInterval levels
+*		maxPreviewSize: the largest length of the view row/column
+*/
+void DiamondSquareAlgorithm::SetPreviewCallback(TFunction<void(
+	const uint8* preview, int previewSize, int step)> callback,
+	int levelInterval, int maxPreviewSize)
+{
+	this->previewCallback = callback;
+	this->previewInterval = levelInterval > 0 ? levelInterval : 1;
+	this->maxPreviewSize = maxPreviewSize;
+}
+
+/*
+*	It computes the random displacements of count cells of a row,
+*	the ones RandomValue returns. The loop has no calls and no
+*	dependencies between the cells, so it is vectorised; the range is
+*	a power of two when maxValue starts from MAX, so the modulo is a mask
+*		row: row index
+*		column: column index of the first cell
+*		stride: distance between two cells
+*		count: number of cells
+*		maxValue: random seed
+*		values: the displacements
+*/
+void DiamondSquareAlgorithm::RandomRow(int row, int column, int stride,
+	int count, int maxValue, int* values) const
+{
+	int max = maxValue / 2 > 1 ? maxValue / 2 : 1;
+	uint32 range = (uint32)(2 * max);
+	uint64 index = (uint64)row * (uint64)this->size + (uint64)column;
+	uint32 seed = this->seed;
+	int k;
+	if ((range & (range - 1)) == 0)
+	{
+		for (k = 0; k < count; k++)
+		{
+			values[k] = (int)(DiamondSquareHash(seed,
+				index + (uint64)k * stride) & (range - 1)) - max;
+		}
+	}
+	else
+	{
+		for (k = 0; k < count; k++)
+		{
+			values[k] = (int)(DiamondSquareHash(seed,
+				index + (uint64)k * stride) % range) - max;
+		}
+	}
+}
+
+/*
+*	Diamond step of a whole row: it sets the centers of the squares
+*	whose center is in the row, as DiamondStep does for one of them.
+*	The corners are read from the rows above and below with the
+*	stride of the squares, without calls for each cell
+*		row: row index of the centers
+*		half: half of the size of the squares
+*		maxValue: random seed
+*/
+void DiamondSquareAlgorithm::DiamondRow(int row, int half, int maxValue)
+{
+	int matrixSize = 2 * half;
+	int count = (this->size - 1) / matrixSize;
+	int random[ROW_CHUNK];
+	int first, chunk, k;
+	uint8* target = this->image + (int64)row * this->size + half;
+	const uint8* up = target - (int64)half * this->size - half;
+	const uint8* down = target + (int64)half * this->size - half;
+	for (first = 0; first < count; first += ROW_CHUNK)
+	{
+		chunk = count - first < ROW_CHUNK ? count - first : ROW_CHUNK;
+		this->RandomRow(row, half + first * matrixSize, matrixSize,
+			chunk, maxValue, random);
+		for (k = 0; k < chunk; k++)
+		{
+			int c = (first + k) * matrixSize;
+			int value = up[c] + up[c + matrixSize] +
+				down[c] + down[c + matrixSize] + random[k];
+			target[c] = value / 4;
+		}
+	}
+}
+
+/*
+*	Square step of a whole row: it sets the centers of the diamonds
+*	that are in the row, as SquareStep does for one of them. The cells
+*	on the borders of the matrix have three neighbours, so they are
+*	computed by SquareStep
+*		row: row index of the centers
+*		half: half of the size of the diamonds
+*		maxValue: random seed
+*/
+void DiamondSquareAlgorithm::SquareRow(int row, int half, int maxValue)
+{
+	int matrixSize = 2 * half;
+	int last = this->size - 1;
+	// Diamonds of the rows of the corners start from half
+	int start = row % matrixSize == 0 ? half : matrixSize;
+	int count = (last - start) / matrixSize + (start == half);
+	int random[ROW_CHUNK];
+	int first, chunk, k, column;
+	uint8* target = this->image + (int64)row * this->size + start;
+	const uint8* up;
+	const uint8* down;
+	if (row == 0 || row == last)
+	{
+		for (column = row % matrixSize == 0 ? half : 0; column < this->size;
+			column += matrixSize)
+		{
+			this->SquareStep(row, column, half, maxValue);
+		}
+		return;
+	}
+	// Inner rows only, so both neighbour rows are inside the matrix
+	up = target - (int64)half * this->size;
+	down = target + (int64)half * this->size;
+	if (start != half)
+	{
+		this->SquareStep(row, 0, half, maxValue);
+		this->SquareStep(row, last, half, maxValue);
+	}
+	for (first = 0; first < count; first += ROW_CHUNK)
+	{
+		chunk = count - first < ROW_CHUNK ? count - first : ROW_CHUNK;
+		this->RandomRow(row, start + first * matrixSize, matrixSize,
+			chunk, maxValue, random);
+		for (k = 0; k < chunk; k++)
+		{
+			int c = (first + k) * matrixSize;
+			int value = up[c] + down[c] + target[c - half] +
+				target[c + half] + random[k];
+			target[c] = value / 4;
+		}
+	}
+}
+
+/*
+*	It sends the view of the matrix after a level has been completed.
+*	The cells of the view are not written by the next levels, so it
+*	can be copied while other threads compute them
+*		step: distance between the cells computed by the level
+*/
+void DiamondSquareAlgorithm::EmitPreview(int step)
+{
+	int last = this->size - 1;
+	int previewSize = last / step + 1;
+	int level = 0;
+	uint8* preview;
+	if (!this->previewCallback || previewSize > this->maxPreviewSize)
+	{
+		return;
+	}
+	for (int i = last; i > step; i /= 2)
+	{
+		level++;
+	}
+	if (level % this->previewInterval != 0 && step > 1)
+	{
+		return;
+	}
+	preview = (uint8*)malloc(sizeof(uint8)*previewSize*previewSize);
+	if (!preview)
+	{
+		return;
+	}
+	for (int i = 0; i < previewSize; i++)
+	{
+		for (int j = 0; j < previewSize; j++)
+		{
+			preview[i*previewSize + j] =
+				this->image[(int64)i*step*this->size + j*step];
+		}
+	}
+	this->previewCallback(preview, previewSize, step);
+	free(preview);
+}
@@ -0,0 +1,204 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DistanceTransform.h"
+#include "MathematicalMorphology.h"
+#include <cfloat>
+#include <cmath>
+
+/*
+*	DistanceTransform constructor.
+*	It allocates the distance map
+*		width: width of the mask
+*		height: height of the mask
+*		threadNumber: the number of thread to use
+*/
+DistanceTransform::DistanceTransform(int width, int height,
+	int threadNumber)
+{
+	this->width = width;
+	this->height = height;
+	this->threadNumber = threadNumber > 0 ? threadNumber : 1;
+	this->distances = (float*)malloc(sizeof(float)*width*height);
+}
+
+/*
+*	DistanceTransform destructor.
+*	It frees the distance map
+*/
+DistanceTransform::~DistanceTransform()
+{
+	free(this->distances);
+}
+
+/*
+*	It computes the squared distance of each pixel from the closest
+*	foreground pixel or from the closest background pixel of the mask.
+*	Pixels outside of the mask are ignored.
+*	It returns false if the buffers could not be allocated
+*		mask: mask of width x height pixels, foreground is FOREGROUND
+*		toForeground: true for the distance from the foreground,
+*			false for the distance from the background
+*/
+bool DistanceTransform::Compute(const uint8* mask, bool toForeground)
+{
+	int length = this->width > this->height ? this->width : this->height;
+	bool isCompleted = this->distances != NULL;
+	if (!isCompleted)
+	{
+		return false;
+	}
+	// Each thread clears its own copy of the flag
+#pragma omp parallel num_threads(this->threadNumber) reduction(&&:isCompleted)
+	{
+		float* scratch = (float*)malloc(sizeof(float)*(3 * length + 1));
+		int* vertices = (int*)malloc(sizeof(int)*length);
+		if (!scratch || !vertices)
+		{
+			isCompleted = false;
+		}
+		// Every thread has to reach the worksharing loops
+#pragma omp for
+		for (int row = 0; row < this->height; row++)
+		{
+			float* line = this->distances + row * this->width;
+			const uint8* maskRow = mask + row * this->width;
+			for (int col = 0; col < this->width; col++)
+			{
+				line[col] = (maskRow[col] == FOREGROUND) == toForeground ?
+					0 : DISTANCE_INFINITY;
+			}
+			if (scratch && vertices)
+			{
+				DistanceTransform::LowerEnvelope(line, this->width, 1,
+					scratch, vertices);
+			}
+		}
+#pragma omp for
+		for (int col = 0; col < this->width; col++)
+		{
+			if (scratch && vertices)
+			{
+				float* line = scratch + 2 * length + 1;
+				for (int row = 0; row < this->height; row++)
+				{
+					line[row] = this->distances[row * this->width + col];
+				}
+				DistanceTransform::LowerEnvelope(line, this->height, 1,
+					scratch, vertices);
+				for (int row = 0; row < this->height; row++)
+				{
+					this->distances[row * this->width + col] = line[row];
+				}
+			}
+		}
+		free(scratch);
+		free(vertices);
+	}
+	return isCompleted;
+}
+
+/*
+*	It computes the binary erosion of the mask by a disk: a pixel
+*	is kept if its distance from the background is more than radius
+*		mask: mask of width x height pixels, it is overwritten
+*		radius: radius of the disk
+*/
+bool DistanceTransform::Erode(uint8* mask, float radius)
+{
+	if (!this->Compute(mask, false))
+	{
+		return false;
+	}
+	for (int i = 0; i < this->width * this->height; i++)
+	{
+		mask[i] = this->distances[i] > radius * radius ? FOREGROUND : BLACK;
+	}
+	return true;
+}
+
+/*
+*	It computes the binary dilation of the mask by a disk: a pixel
+*	is set if its distance from the foreground is at most radius
+*		mask: mask of width x height pixels, it is overwritten
+*		radius: radius of the disk
+*/
+bool DistanceTransform::Dilate(uint8* mask, float radius)
+{
+	if (!this->Compute(mask, true))
+	{
+		return false;
+	}
+	for (int i = 0; i < this->width * this->height; i++)
+	{
+		mask[i] = this->distances[i] <= radius * radius ? FOREGROUND : BLACK;
+	}
+	return true;
+}
+
+/*
+*	It returns the distances of the last transform rounded
+*	to the closest integer and clamped to WHITE
+*		output: distance map of width x height pixels
+*/
+void DistanceTransform::GetDistances(uint8* output) const
+{
+	for (int i = 0; i < this->width * this->height; i++)
+	{
+		float distance = sqrtf(this->distances[i]);
+		output[i] = distance < WHITE ? (uint8)(distance + 0.5f) : WHITE;
+	}
+}
+
+/*
+*	It replaces values[p] with the minimum over q of
+*	values[q] + curvature*(p-q)^2. The minimum is the lower envelope
+*	of the parabolas centered in each q, that is built in linear time
+*		values: line to transform
+*		count: length of the line
+*		curvature: curvature of the parabolas
+*		scratch: 2*count+1 floats
+*		vertices: count integers
+*/
+void DistanceTransform::LowerEnvelope(float* values, int count,
+	float curvature, float* scratch, int* vertices)
+{
+	float* result = scratch;
+	// Boundaries between the parabolas of the envelope
+	float* bounds = scratch + count;
+	int k = 0;
+	int p, q;
+	vertices[0] = 0;
+	bounds[0] = -FLT_MAX;
+	bounds[1] = FLT_MAX;
+	for (q = 1; q < count; q++)
+	{
+		float s = ((values[q] + curvature * q * q) -
+			(values[vertices[k]] + curvature * vertices[k] * vertices[k])) /
+			(2 * curvature * (q - vertices[k]));
+		// Parabolas hidden by the new one are removed from the envelope
+		while (s <= bounds[k])
+		{
+			k--;
+			s = ((values[q] + curvature * q * q) -
+				(values[vertices[k]] + curvature * vertices[k] * vertices[k])) /
+				(2 * curvature * (q - vertices[k]));
+		}
+		k++;
+		vertices[k] = q;
+		bounds[k] = s;
+		bounds[k + 1] = FLT_MAX;
+	}
+	k = 0;
+	for (p = 0; p < count; p++)
+	{
+		while (bounds[k + 1] < p)
+		{
+			k++;
+		}
+		result[p] = values[vertices[k]] +
+			curvature * (p - vertices[k]) * (p - vertices[k]);
+	}
+	FMemory::Memcpy(values, result, sizeof(float)*count);
+}
+
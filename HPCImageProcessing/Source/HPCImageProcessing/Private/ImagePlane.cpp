@@ -0,0 +1,78 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ImagePlane.h"
+#if PLATFORM_LINUX
+#include <sys/mman.h>
+#endif
+
+// Huge pages are disabled by default
+bool ImagePlane::useHugePages = false;
+
+/*
+*	It returns the pitch of the rows of a plane in elements
+*		width: width of the plane in elements
+*		elementSize: size of an element in bytes
+*/
+int ImagePlane::GetPitch(int width, int elementSize)
+{
+	int64 pitch = (int64)width * elementSize;
+	pitch = (pitch + PLANE_ALIGNMENT - 1) / PLANE_ALIGNMENT * PLANE_ALIGNMENT;
+	if (pitch % PLANE_ALIASING_STRIDE == 0)
+	{
+		pitch += PLANE_ALIGNMENT;
+	}
+	return (int)(pitch / elementSize);
+}
+
+/*
+*	It allocates an aligned plane, NULL if there is no memory.
+*	The address returned by malloc is stored before the plane
+*		size: size of the plane in bytes
+*/
+void* ImagePlane::Allocate(int64 size)
+{
+	bool isHuge = ImagePlane::useHugePages && size >= PLANE_HUGE_PAGE;
+	int64 alignment = isHuge ? PLANE_HUGE_PAGE : PLANE_ALIGNMENT;
+	uint8* block = (uint8*)malloc(size + alignment + sizeof(void*));
+	uint8* plane;
+	if (!block)
+	{
+		return NULL;
+	}
+	plane = (uint8*)(((UPTRINT)block + sizeof(void*) + alignment - 1) /
+		alignment * alignment);
+	((void**)plane)[-1] = block;
+#if PLATFORM_LINUX
+	// Transparent huge pages back the aligned part of the block
+	if (isHuge)
+	{
+		madvise(plane, size / PLANE_HUGE_PAGE * PLANE_HUGE_PAGE,
+			MADV_HUGEPAGE);
+	}
+#endif
+	return plane;
+}
+
+/*
+*	It frees a plane allocated by Allocate
+*		plane: the plane, it can be NULL
+*/
+void ImagePlane::Free(void* plane)
+{
+	if (plane)
+	{
+		free(((void**)plane)[-1]);
+	}
+}
+
+/*
+*	It enables huge pages for the following allocations.
+*	They are used only on the platforms that give them without
+*	privileges, the other ones ignore the setting
+*		enable: true to back large planes with huge pages
+*/
+void ImagePlane::SetHugePages(bool enable)
+{
+	ImagePlane::useHugePages = enable;
+}
@@ -0,0 +1,333 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "IncrementalMMorphology.h"
+
+/*
+*	IncrementalMMorphology constructor.
+*	The buffers are allocated by the first execution
+*		image: input image
+*		size: size of the structuring element
+*/
+IncrementalMMorphology::IncrementalMMorphology(FImage* image, int size)
+	: SerialMMorphology(image, size)
+{
+	this->isOpening = true;
+	this->output = NULL;
+	for (int c = 0; c < 3; c++)
+	{
+		this->inputPlanes[c] = NULL;
+		this->middlePlanes[c] = NULL;
+		this->outputPlanes[c] = NULL;
+	}
+}
+
+/*
+*	IncrementalMMorphology destructor.
+*	It frees the buffers kept between the updates
+*/
+IncrementalMMorphology::~IncrementalMMorphology()
+{
+	this->FreePlanes();
+}
+
+/*
+*	It executes opening or closing on the whole image and keeps
+*	the buffers for the following updates. It returns a copy of the
+*	output, the one kept is returned by GetOutput
+*		isOpening: true if it has to execute opening
+*/
+uint8* IncrementalMMorphology::ExecuteOpeningOrClosing(bool isOpening)
+{
+	int32 size, imageSize, c;
+	uint8* result;
+	FIntRect image;
+	if (!this->input || !this->structElem.element)
+	{
+		return NULL;
+	}
+	this->FreePlanes();
+	this->isOpening = isOpening;
+	size = this->pitch * (this->input->SizeY + this->structElem.height - 1);
+	imageSize = this->input->SizeX * this->input->SizeY * CHANNELS;
+	for (c = 0; c < 3; c++)
+	{
+		this->inputPlanes[c] = (uint8*)ImagePlane::Allocate(sizeof(uint8)*size);
+		this->middlePlanes[c] = (uint8*)ImagePlane::Allocate(sizeof(uint8)*size);
+		this->outputPlanes[c] = (uint8*)ImagePlane::Allocate(sizeof(uint8)*size);
+	}
+	this->output = (uint8*)malloc(sizeof(uint8)*imageSize);
+	result = (uint8*)malloc(sizeof(uint8)*imageSize);
+	for (c = 0; c < 3; c++)
+	{
+		if (!this->inputPlanes[c] || !this->middlePlanes[c]
+			|| !this->outputPlanes[c])
+		{
+			break;
+		}
+	}
+	if (c < 3 || !this->output || !result)
+	{
+		this->FreePlanes();
+		free(result);
+		return NULL;
+	}
+	// Opening erodes first, so its ghost cells are white
+	this->SplitChannels(this->inputPlanes[0], this->inputPlanes[1],
+		this->inputPlanes[2], isOpening ? WHITE : BLACK);
+	this->FillGhostCells(this->middlePlanes[0], this->middlePlanes[1],
+		this->middlePlanes[2], isOpening ? BLACK : WHITE);
+	image = FIntRect(0, 0, this->input->SizeX, this->input->SizeY);
+	for (c = 0; c < 3; c++)
+	{
+		if (isOpening)
+		{
+			this->ErodeRegion(this->inputPlanes[c], this->middlePlanes[c], image);
+			this->DilateRegion(this->middlePlanes[c], this->outputPlanes[c], image);
+		}
+		else
+		{
+			this->DilateRegion(this->inputPlanes[c], this->middlePlanes[c], image);
+			this->ErodeRegion(this->middlePlanes[c], this->outputPlanes[c], image);
+		}
+	}
+	this->ComposeRegion(image);
+	FMemory::Memcpy(result, this->output, imageSize);
+	return result;
+}
+
+/*
+*	It reads again the changed rectangles of the input image and
+*	recomputes the output only where it can change.
+*	It returns false if the whole image was never computed
+*		changedRegions: rectangles of the input that changed,
+*			Max is the first pixel after the rectangle
+*		updatedRegions: rectangles of the output that were recomputed
+*/
+bool IncrementalMMorphology::UpdateRegions(
+	const TArray<FIntRect>& changedRegions, TArray<FIntRect>& updatedRegions)
+{
+	if (!this->output)
+	{
+		return false;
+	}
+	updatedRegions.Empty();
+	for (int i = 0; i < changedRegions.Num(); i++)
+	{
+		FIntRect changed = this->ExpandRegion(changedRegions[i], 0);
+		FIntRect middle = this->ExpandRegion(changedRegions[i], 1);
+		FIntRect updated = this->ExpandRegion(changedRegions[i], 2);
+		if (changed.Min.X >= changed.Max.X || changed.Min.Y >= changed.Max.Y)
+		{
+			continue;
+		}
+		this->ReadRegion(changed);
+		for (int c = 0; c < 3; c++)
+		{
+			if (this->isOpening)
+			{
+				this->ErodeRegion(this->inputPlanes[c],
+					this->middlePlanes[c], middle);
+				this->DilateRegion(this->middlePlanes[c],
+					this->outputPlanes[c], updated);
+			}
+			else
+			{
+				this->DilateRegion(this->inputPlanes[c],
+					this->middlePlanes[c], middle);
+				this->ErodeRegion(this->middlePlanes[c],
+					this->outputPlanes[c], updated);
+			}
+		}
+		this->ComposeRegion(updated);
+		updatedRegions.Add(updated);
+	}
+	return true;
+}
+
+/*	PRIVATE
+*	It expands a rectangle by a multiple of the extent of the
+*	structuring element and clips it to the image
+*		region: rectangle of the image
+*		times: number of times the extent is added
+*/
+FIntRect IncrementalMMorphology::ExpandRegion(const FIntRect& region,
+	int times) const
+{
+	int extentX = times * (this->structElem.width / 2);
+	int extentY = times * (this->structElem.height / 2);
+	FIntRect expanded;
+	expanded.Min.X = region.Min.X - extentX > 0 ? region.Min.X - extentX : 0;
+	expanded.Min.Y = region.Min.Y - extentY > 0 ? region.Min.Y - extentY : 0;
+	expanded.Max.X = region.Max.X + extentX < this->input->SizeX ?
+		region.Max.X + extentX : this->input->SizeX;
+	expanded.Max.Y = region.Max.Y + extentY < this->input->SizeY ?
+		region.Max.Y + extentY : this->input->SizeY;
+	return expanded;
+}
+
+/*	PRIVATE
+*	It copies a rectangle of the input image in the input channels
+*		region: rectangle of the image
+*/
+void IncrementalMMorphology::ReadRegion(const FIntRect& region)
+{
+	FColor* colors = this->input->AsBGRA8();
+	int width = this->pitch;
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	for (int row = region.Min.Y; row < region.Max.Y; row++)
+	{
+		for (int col = region.Min.X; col < region.Max.X; col++)
+		{
+			int i = (row + firstRow) * width + col + firstCol;
+			const FColor& color = colors[row * this->input->SizeX + col];
+			this->inputPlanes[0][i] = color.R;
+			this->inputPlanes[1][i] = color.G;
+			this->inputPlanes[2][i] = color.B;
+		}
+	}
+}
+
+/*	PRIVATE
+*	It executes the erosion on a rectangle of the image.
+*	The non-flat element ignores the pixels outside of the image
+*		in: input channel
+*		out: output channel
+*		region: rectangle of the image
+*/
+void IncrementalMMorphology::ErodeRegion(const uint8* in, uint8* out,
+	const FIntRect& region) const
+{
+	int width = this->pitch;
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	for (int row = region.Min.Y; row < region.Max.Y; row++)
+	{
+		for (int col = region.Min.X; col < region.Max.X; col++)
+		{
+			int center = (row + firstRow) * width + col + firstCol;
+			uint8 minValue = WHITE;
+			if (this->isNonFlat)
+			{
+				for (int i = 0; i < this->ErosionWeights.count; i++)
+				{
+					int sourceRow = row + this->ErosionWeights.rows[i];
+					int sourceCol = col + this->ErosionWeights.cols[i];
+					uint8 weight = this->ErosionWeights.weights[i];
+					uint8 value;
+					if (sourceRow < 0 || sourceRow >= this->input->SizeY
+						|| sourceCol < 0 || sourceCol >= this->input->SizeX)
+					{
+						continue;
+					}
+					value = in[center + this->ErosionWeights.rows[i] * width +
+						this->ErosionWeights.cols[i]];
+					value = value > weight ? value - weight : 0;
+					minValue = value < minValue ? value : minValue;
+				}
+			}
+			else
+			{
+				for (int i = 0; i < this->ErosionOffsets.count; i++)
+				{
+					uint8 value = in[center + this->ErosionOffsets.offsets[i]];
+					minValue = value < minValue ? value : minValue;
+				}
+			}
+			out[center] = minValue;
+		}
+	}
+}
+
+/*	PRIVATE
+*	It executes the dilation on a rectangle of the image.
+*	The non-flat element ignores the pixels outside of the image
+*		in: input channel
+*		out: output channel
+*		region: rectangle of the image
+*/
+void IncrementalMMorphology::DilateRegion(const uint8* in, uint8* out,
+	const FIntRect& region) const
+{
+	int width = this->pitch;
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	for (int row = region.Min.Y; row < region.Max.Y; row++)
+	{
+		for (int col = region.Min.X; col < region.Max.X; col++)
+		{
+			int center = (row + firstRow) * width + col + firstCol;
+			uint8 maxValue = BLACK;
+			if (this->isNonFlat)
+			{
+				for (int i = 0; i < this->DilationWeights.count; i++)
+				{
+					int sourceRow = row + this->DilationWeights.rows[i];
+					int sourceCol = col + this->DilationWeights.cols[i];
+					uint8 weight = this->DilationWeights.weights[i];
+					uint8 value;
+					if (sourceRow < 0 || sourceRow >= this->input->SizeY
+						|| sourceCol < 0 || sourceCol >= this->input->SizeX)
+					{
+						continue;
+					}
+					value = in[center + this->DilationWeights.rows[i] * width +
+						this->DilationWeights.cols[i]];
+					value = value < WHITE - weight ? value + weight : WHITE;
+					maxValue = value > maxValue ? value : maxValue;
+				}
+			}
+			else
+			{
+				for (int i = 0; i < this->DilationOffsets.count; i++)
+				{
+					uint8 value = in[center + this->DilationOffsets.offsets[i]];
+					maxValue = value > maxValue ? value : maxValue;
+				}
+			}
+			out[center] = maxValue;
+		}
+	}
+}
+
+/*	PRIVATE
+*	It copies a rectangle of the output channels in the output image
+*		region: rectangle of the image
+*/
+void IncrementalMMorphology::ComposeRegion(const FIntRect& region)
+{
+	int width = this->pitch;
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	for (int row = region.Min.Y; row < region.Max.Y; row++)
+	{
+		for (int col = region.Min.X; col < region.Max.X; col++)
+		{
+			int i = (row + firstRow) * width + col + firstCol;
+			int j = (row * this->input->SizeX + col) * CHANNELS;
+			this->output[j] = this->outputPlanes[2][i];
+			this->output[j + 1] = this->outputPlanes[1][i];
+			this->output[j + 2] = this->outputPlanes[0][i];
+			this->output[j + 3] = ALPHA;
+		}
+	}
+}
+
+/*	PRIVATE
+*	It frees the buffers kept between the updates
+*/
+void IncrementalMMorphology::FreePlanes()
+{
+	for (int c = 0; c < 3; c++)
+	{
+		ImagePlane::Free(this->inputPlanes[c]);
+		ImagePlane::Free(this->middlePlanes[c]);
+		ImagePlane::Free(this->outputPlanes[c]);
+		this->inputPlanes[c] = NULL;
+		this->middlePlanes[c] = NULL;
+		this->outputPlanes[c] = NULL;
+	}
+	free(this->output);
+	this->output = NULL;
+}
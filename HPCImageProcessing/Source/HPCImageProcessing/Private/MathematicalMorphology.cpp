@@ -2,12 +2,16 @@
 
 
 #include "MathematicalMorphology.h"
+#include "MorphologyPipeline.h"
 
 // File name of the structuring element
 const FString MathematicalMorphology::fileName = 
 FPaths::ConvertRelativePathToFull(FPaths::ProjectDir()) 
 + "InputImages/StructuringElement";
 const FString MathematicalMorphology::extension = ".png";
+// Elements already decoded, by size
+TMap<int, StructuringElement> MathematicalMorphology::loadedElements;
+FCriticalSection MathematicalMorphology::elementLock;
 
 /*
 *	Mathematical morphology constructor.
@@ -18,20 +22,36 @@ MathematicalMorphology::MathematicalMorphology(FImage* image, int size)
 {
 	int elemSize;
 	this->input = image;
+	this->firstMip = NULL;
+	this->threadNumber = 1;
+	this->isNonFlat = false;
+	this->paraboloidCurvature = 0;
+	this->paraboloidBuffer = NULL;
+	this->elementSize = size;
+	this->kernel = MK_Offsets;
+	this->executedKernel = MK_Offsets;
+	this->isSeparable = false;
+	this->transposeBuffer = NULL;
+	this->transposePitch = 0;
+	this->ErosionWeights = WeightedOffset();
+	this->DilationWeights = WeightedOffset();
 	this->structElem = StructuringElement();
+	this->pitch = 0;
 	if (image)
 	{
-		this->LoadStructuringElement(size);
+		this->structElem = MathematicalMorphology::LoadStructuringElement(size);
 		if (this->structElem.element)
 		{
 			elemSize = this->structElem.width*
 				this->structElem.height;
+			this->pitch = ImagePlane::GetPitch(
+				image->SizeX + this->structElem.width - 1);
 			this->ErosionOffsets = Offset();
 			this->DilationOffsets = Offset();
 			this->ErosionOffsets.offsets = (int*)malloc(sizeof(int)*elemSize);
 			this->DilationOffsets.offsets = (int*)malloc(sizeof(int)*elemSize);
-			this->SetOffsets(&ErosionOffsets, false);
-			this->SetOffsets(&DilationOffsets, true);
+			this->SetOffsets(&ErosionOffsets, false, this->pitch);
+			this->SetOffsets(&DilationOffsets, true, this->pitch);
 		}
 	}
 }
@@ -42,22 +62,967 @@ MathematicalMorphology::MathematicalMorphology(FImage* image, int size)
 MathematicalMorphology::~MathematicalMorphology()
 {
 	this->input = NULL;
-	this->structElem.element = NULL;
+	free(this->structElem.element);
 	free(ErosionOffsets.offsets);
 	free(DilationOffsets.offsets);
+	free(this->firstMip);
+	free(this->paraboloidBuffer);
+	ImagePlane::Free(this->transposeBuffer);
+	this->FreeWeightedOffsets();
 }
 
-/*	PRIVATE
+/*
+*	It enables the computation of the first mip of the output.
+*	The mip is a box filter of the output computed by the compose
+*	pass while the output rows are still in cache
+*		generate: true if the mip has to be computed
+*/
+void MathematicalMorphology::SetGenerateMips(bool generate)
+{
+	int mipWidth, mipHeight;
+	free(this->firstMip);
+	this->firstMip = NULL;
+	if (generate && this->input)
+	{
+		mipWidth = this->input->SizeX > 1 ? this->input->SizeX / 2 : 1;
+		mipHeight = this->input->SizeY > 1 ? this->input->SizeY / 2 : 1;
+		this->firstMip = (uint8*)malloc(sizeof(uint8)*CHANNELS*
+			mipWidth*mipHeight);
+	}
+}
+
+/*
+*	It computes a row of the first mip as the average of 2x2 pixels
+*	of the output. It has to be called after the two output rows
+*	2*mipRow and 2*mipRow+1 have been composed
+*		output: output image
+*		mipRow: row of the mip
+*/
+void MathematicalMorphology::DownsampleRows(const uint8* output, int mipRow)
+{
+	int mipWidth = this->input->SizeX > 1 ? this->input->SizeX / 2 : 1;
+	int lastCol = this->input->SizeX - 1;
+	int rowSize = this->input->SizeX * CHANNELS;
+	const uint8* top = output + 2 * mipRow * rowSize;
+	const uint8* bottom = 2 * mipRow + 1 < this->input->SizeY ?
+		top + rowSize : top;
+	uint8* mip = this->firstMip + mipRow * mipWidth * CHANNELS;
+	for (int j = 0; j < mipWidth; j++)
+	{
+		int left = 2 * j * CHANNELS;
+		int right = (2 * j + 1 < lastCol ? 2 * j + 1 : lastCol) * CHANNELS;
+		for (int c = 0; c < CHANNELS; c++)
+		{
+			mip[j*CHANNELS + c] = (top[left + c] + top[right + c] +
+				bottom[left + c] + bottom[right + c] + 2) / 4;
+		}
+	}
+}
+
+/*
+*	It executes the path opening or closing of the image: the
+*	maximum of the path openings in the four cones of directions.
+*	The closing is the complement of the opening of the complement.
+*	The structuring element is not used
+*		isOpening: true if it has to execute opening
+*		length: minimum length of the paths in pixels
+*/
+uint8* MathematicalMorphology::ExecutePathOpeningOrClosing(bool isOpening,
+	int length)
+{
+	int size, channel, cone, i;
+	uint8 *planes, *results, *coneResult, *output = NULL;
+	bool isCompleted = true;
+	if (!this->input)
+	{
+		return NULL;
+	}
+	size = this->input->SizeX * this->input->SizeY;
+	planes = (uint8*)malloc(sizeof(uint8) * 3 * size);
+	results = (uint8*)malloc(sizeof(uint8) * 3 * size);
+	coneResult = (uint8*)malloc(sizeof(uint8)*size);
+	PathOpening path(this->input->SizeX, this->input->SizeY, length);
+	if (planes && results && coneResult)
+	{
+		this->SplitPlanes(planes, !isOpening);
+		FMemory::Memset(results, BLACK, 3 * size);
+		for (channel = 0; channel < 3; channel++)
+		{
+			uint8* result = results + channel * size;
+			for (cone = 0; cone < PATH_CONES; cone++)
+			{
+				if (!path.ExecutePathOpening(planes + channel * size,
+					coneResult, (PathCone)cone))
+				{
+					isCompleted = false;
+					break;
+				}
+				for (i = 0; i < size; i++)
+				{
+					result[i] = coneResult[i] > result[i] ?
+						coneResult[i] : result[i];
+				}
+			}
+		}
+		if (isCompleted)
+		{
+			output = this->ComposePlanes(results, !isOpening);
+		}
+	}
+	free(planes);
+	free(results);
+	free(coneResult);
+	return output;
+}
+
+/*
+*	It executes the binary opening or closing of the image by a disk.
+*	Each channel is a binary mask (values from BINARY_THRESHOLD are
+*	foreground); erosion and dilation are thresholds of its distance
+*	transform, so the cost does not depend on the radius.
+*	The structuring element is not used
+*		isOpening: true if it has to execute opening
+*		radius: radius of the disk in pixels
+*/
+uint8* MathematicalMorphology::ExecuteDiskOpeningOrClosing(bool isOpening,
+	float radius)
+{
+	int size, channel;
+	uint8 *planes, *output = NULL;
+	bool isCompleted = true;
+	if (!this->input)
+	{
+		return NULL;
+	}
+	size = this->input->SizeX * this->input->SizeY;
+	planes = (uint8*)malloc(sizeof(uint8) * 3 * size);
+	DistanceTransform transform(this->input->SizeX, this->input->SizeY,
+		this->threadNumber);
+	if (planes)
+	{
+		this->SplitPlanes(planes, false);
+		this->BinarizePlanes(planes);
+		for (channel = 0; channel < 3 && isCompleted; channel++)
+		{
+			uint8* mask = planes + channel * size;
+			isCompleted = isOpening ?
+				transform.Erode(mask, radius) && transform.Dilate(mask, radius) :
+				transform.Dilate(mask, radius) && transform.Erode(mask, radius);
+		}
+		if (isCompleted)
+		{
+			output = this->ComposePlanes(planes, false);
+		}
+	}
+	free(planes);
+	return output;
+}
+
+/*
+*	It returns the distance map of the image: each channel is a
+*	binary mask and each pixel takes its distance from the background
+*	of the channel, in pixels and clamped to WHITE
+*/
+uint8* MathematicalMorphology::ExecuteDistanceMap()
+{
+	int size, channel;
+	uint8 *planes, *output = NULL;
+	bool isCompleted = true;
+	if (!this->input)
+	{
+		return NULL;
+	}
+	size = this->input->SizeX * this->input->SizeY;
+	planes = (uint8*)malloc(sizeof(uint8) * 3 * size);
+	DistanceTransform transform(this->input->SizeX, this->input->SizeY,
+		this->threadNumber);
+	if (planes)
+	{
+		this->SplitPlanes(planes, false);
+		this->BinarizePlanes(planes);
+		for (channel = 0; channel < 3 && isCompleted; channel++)
+		{
+			isCompleted = transform.Compute(planes + channel * size, false);
+			if (isCompleted)
+			{
+				transform.GetDistances(planes + channel * size);
+			}
+		}
+		if (isCompleted)
+		{
+			output = this->ComposePlanes(planes, false);
+		}
+	}
+	free(planes);
+	return output;
+}
+
+/*
+*	It executes the rank filter of the image with the flat structuring
+*	element: each channel of a pixel takes the value at a percentile
+*	of the window. Percentile 50 is the median filter, that removes
+*	the noise before an opening or closing, 0 and 100 are the erosion
+*	and the dilation with a symmetric element
+*		percentile: percentile of the window, from 0 to 100
+*/
+uint8* MathematicalMorphology::ExecuteRankFilter(float percentile)
+{
+	int size, channel;
+	uint8 *planes, *results, *output = NULL;
+	bool isCompleted = true;
+	if (!this->input || !this->structElem.element)
+	{
+		return NULL;
+	}
+	size = this->input->SizeX * this->input->SizeY;
+	planes = (uint8*)malloc(sizeof(uint8) * 3 * size);
+	results = (uint8*)malloc(sizeof(uint8) * 3 * size);
+	RankFilter filter(this->input->SizeX, this->input->SizeY,
+		this->structElem.element, this->structElem.width,
+		this->structElem.height, this->threadNumber);
+	if (planes && results)
+	{
+		this->SplitPlanes(planes, false);
+		for (channel = 0; channel < 3 && isCompleted; channel++)
+		{
+			isCompleted = filter.Execute(planes + channel * size,
+				results + channel * size, percentile);
+		}
+		if (isCompleted)
+		{
+			output = this->ComposePlanes(results, false);
+		}
+	}
+	free(planes);
+	free(results);
+	return output;
+}
+
+/*
+*	It executes the vector opening or closing of the image with the
+*	flat structuring element. Colours are ordered by luminance, then
+*	by red, green and blue, and each pixel is packed in a 32 bit key:
+*	8 bits of luminance followed by the three channels. The minimum or
+*	maximum of a window is an integer minimum or maximum of the keys,
+*	so the three channels cost as one and every output pixel is a
+*	colour of the input
+*		isOpening: true if it has to execute opening
+*/
+uint8* MathematicalMorphology::ExecuteVectorOpeningOrClosing(bool isOpening)
+{
+	int size;
+	uint32 *keys, *middle;
+	uint8* output = NULL;
+	if (!this->input || !this->structElem.element)
+	{
+		return NULL;
+	}
+	// Keys use the pitch of the planes, so the offsets are the same
+	size = this->pitch * (this->input->SizeY + this->structElem.height - 1);
+	keys = (uint32*)ImagePlane::Allocate(sizeof(uint32)*size);
+	middle = (uint32*)ImagePlane::Allocate(sizeof(uint32)*size);
+	if (keys && middle)
+	{
+		// Ghost cells never win the first pass, then the second one
+		this->PackKeys(keys, isOpening ? KEY_MAX : KEY_MIN);
+		this->FillKeyGhostCells(middle, isOpening ? KEY_MIN : KEY_MAX);
+		this->VectorPass(keys, middle, isOpening);
+		this->VectorPass(middle, keys, !isOpening);
+		output = this->ComposeKeys(keys);
+	}
+	ImagePlane::Free(keys);
+	ImagePlane::Free(middle);
+	return output;
+}
+
+/*
+*	It splits the channels of the input image without ghost cells:
+*	red, green and blue planes of SizeX x SizeY pixels
+*		planes: buffer of the three planes
+*		invert: true if the complement of the image is needed
+*/
+void MathematicalMorphology::SplitPlanes(uint8* planes, bool invert) const
+{
+	FColor* colors = this->input->AsBGRA8();
+	int size = this->input->SizeX * this->input->SizeY;
+	for (int i = 0; i < size; i++)
+	{
+		planes[i] = invert ? WHITE - colors[i].R : colors[i].R;
+		planes[size + i] = invert ? WHITE - colors[i].G : colors[i].G;
+		planes[2 * size + i] = invert ? WHITE - colors[i].B : colors[i].B;
+	}
+}
+
+/*
+*	It turns the planes into binary masks
+*		planes: buffer of the three planes
+*/
+void MathematicalMorphology::BinarizePlanes(uint8* planes) const
+{
+	int size = 3 * this->input->SizeX * this->input->SizeY;
+	for (int i = 0; i < size; i++)
+	{
+		planes[i] = planes[i] >= BINARY_THRESHOLD ? FOREGROUND : BLACK;
+	}
+}
+
+/*
+*	It composes the output image from red, green and blue planes.
+*	If the first mip is enabled it is computed in the same pass
+*		planes: buffer of the three planes
+*		invert: true if the planes contain the complement
+*/
+uint8* MathematicalMorphology::ComposePlanes(const uint8* planes, bool invert)
+{
+	int size = this->input->SizeX * this->input->SizeY;
+	uint8* output = (uint8*)malloc(sizeof(uint8)*size*CHANNELS);
+	if (!output)
+	{
+		return NULL;
+	}
+	for (int row = 0; row < this->input->SizeY; row++)
+	{
+		for (int col = 0; col < this->input->SizeX; col++)
+		{
+			int i = row * this->input->SizeX + col;
+			output[i*CHANNELS] = invert ?
+				WHITE - planes[2 * size + i] : planes[2 * size + i];
+			output[i*CHANNELS + 1] = invert ?
+				WHITE - planes[size + i] : planes[size + i];
+			output[i*CHANNELS + 2] = invert ? WHITE - planes[i] : planes[i];
+			output[i*CHANNELS + 3] = ALPHA;
+		}
+		if (this->firstMip && (row % 2 == 1 || this->input->SizeY == 1))
+		{
+			this->DownsampleRows(output, row / 2);
+		}
+	}
+	return output;
+}
+
+/*
+*	It enables the non-flat structuring element: the gray value of
+*	each pixel of the element is added in dilation and subtracted in
+*	erosion, with saturation. Black pixels are outside of the element.
+*	Pixels outside of the image are ignored instead of using ghost cells
+*		nonFlat: true if the element has to be used as non-flat
+*/
+void MathematicalMorphology::SetNonFlat(bool nonFlat)
+{
+	int elemSize;
+	this->FreeWeightedOffsets();
+	this->isNonFlat = false;
+	if (nonFlat && this->structElem.element)
+	{
+		elemSize = this->structElem.width*this->structElem.height;
+		this->ErosionWeights.rows = (int*)malloc(sizeof(int)*elemSize);
+		this->ErosionWeights.cols = (int*)malloc(sizeof(int)*elemSize);
+		this->ErosionWeights.weights = (uint8*)malloc(sizeof(uint8)*elemSize);
+		this->DilationWeights.rows = (int*)malloc(sizeof(int)*elemSize);
+		this->DilationWeights.cols = (int*)malloc(sizeof(int)*elemSize);
+		this->DilationWeights.weights = (uint8*)malloc(sizeof(uint8)*elemSize);
+		this->SetWeightedOffsets(&ErosionWeights, false);
+		this->SetWeightedOffsets(&DilationWeights, true);
+		this->isNonFlat = this->ErosionWeights.count > 0;
+	}
+}
+
+/*
+*	It enables the paraboloid structuring element that approximates
+*	a ball of the given radius near its top. The paraboloid is
+*	separable, so erosion and dilation are computed with a column and
+*	a row pass of lower envelopes of parabolas: the cost per pixel does
+*	not depend on the radius. It is used instead of the loaded element
+*		radius: radius of the ball in pixels, 0 to disable the paraboloid
+*/
+void MathematicalMorphology::SetParaboloidElement(float radius)
+{
+	free(this->paraboloidBuffer);
+	this->paraboloidBuffer = NULL;
+	this->paraboloidCurvature = 0;
+	if (radius > 0 && this->input)
+	{
+		this->paraboloidBuffer = (float*)malloc(sizeof(float)*
+			this->input->SizeX*this->input->SizeY);
+		if (this->paraboloidBuffer)
+		{
+			this->paraboloidCurvature = 1 / (2 * radius);
+		}
+	}
+}
+
+/*
+*	It computes a row of the non-flat erosion. The element is applied
+*	one pixel at a time on the whole row, so the inner loop is a
+*	saturating subtraction and a minimum on contiguous values
+*		in: input channel
+*		out: output channel
+*		row: row of the channel, ghost rows included
+*/
+void MathematicalMorphology::NonFlatErosionRow(const uint8* in,
+	uint8* out, int row) const
+{
+	int width = this->pitch;
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	uint8* target = out + row * width + firstCol;
+	int i, col;
+	for (col = 0; col < this->input->SizeX; col++)
+	{
+		target[col] = WHITE;
+	}
+	for (i = 0; i < this->ErosionWeights.count; i++)
+	{
+		int sourceRow = row + this->ErosionWeights.rows[i];
+		int offsetCol = this->ErosionWeights.cols[i];
+		uint8 weight = this->ErosionWeights.weights[i];
+		int firstColumn = offsetCol < 0 ? -offsetCol : 0;
+		int endColumn = offsetCol > 0 ?
+			this->input->SizeX - offsetCol : this->input->SizeX;
+		if (sourceRow < firstRow || sourceRow >= firstRow + this->input->SizeY)
+		{
+			continue;
+		}
+		const uint8* source = in + sourceRow * width + firstCol + offsetCol;
+		for (col = firstColumn; col < endColumn; col++)
+		{
+			uint8 value = source[col] > weight ? source[col] - weight : 0;
+			target[col] = value < target[col] ? value : target[col];
+		}
+	}
+}
+
+/*
+*	It computes a row of the non-flat dilation with a saturating
+*	addition and a maximum on contiguous values
+*		in: input channel
+*		out: output channel
+*		row: row of the channel, ghost rows included
+*/
+void MathematicalMorphology::NonFlatDilationRow(const uint8* in,
+	uint8* out, int row) const
+{
+	int width = this->pitch;
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	uint8* target = out + row * width + firstCol;
+	int i, col;
+	for (col = 0; col < this->input->SizeX; col++)
+	{
+		target[col] = BLACK;
+	}
+	for (i = 0; i < this->DilationWeights.count; i++)
+	{
+		int sourceRow = row + this->DilationWeights.rows[i];
+		int offsetCol = this->DilationWeights.cols[i];
+		uint8 weight = this->DilationWeights.weights[i];
+		int firstColumn = offsetCol < 0 ? -offsetCol : 0;
+		int endColumn = offsetCol > 0 ?
+			this->input->SizeX - offsetCol : this->input->SizeX;
+		if (sourceRow < firstRow || sourceRow >= firstRow + this->input->SizeY)
+		{
+			continue;
+		}
+		const uint8* source = in + sourceRow * width + firstCol + offsetCol;
+		for (col = firstColumn; col < endColumn; col++)
+		{
+			uint8 value = source[col] < WHITE - weight ?
+				source[col] + weight : WHITE;
+			target[col] = value > target[col] ? value : target[col];
+		}
+	}
+}
+
+/*
+*	It computes the column pass of the paraboloid element on a
+*	column of the image and stores it in paraboloidBuffer.
+*	Dilation is computed as the erosion of the negated values
+*		in: input channel
+*		column: column of the image, ghost columns excluded
+*		isErosion: true for erosion, false for dilation
+*		scratch: GetEnvelopeLength()*3+1 floats
+*		vertices: GetEnvelopeLength() integers
+*/
+void MathematicalMorphology::ParaboloidColumn(const uint8* in, int column,
+	bool isErosion, float* scratch, int* vertices)
+{
+	int width = this->pitch;
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	int row;
+	const uint8* source = in + firstRow * width + firstCol + column;
+	for (row = 0; row < this->input->SizeY; row++)
+	{
+		scratch[row] = isErosion ? source[row * width] : -source[row * width];
+	}
+	DistanceTransform::LowerEnvelope(scratch, this->input->SizeY,
+		this->paraboloidCurvature, scratch + this->GetEnvelopeLength(),
+		vertices);
+	for (row = 0; row < this->input->SizeY; row++)
+	{
+		this->paraboloidBuffer[row * this->input->SizeX + column] =
+			scratch[row];
+	}
+}
+
+/*
+*	It computes the row pass of the paraboloid element on a row
+*	of paraboloidBuffer and writes the result in the output channel
+*		out: output channel
+*		row: row of the image, ghost rows excluded
+*		isErosion: true for erosion, false for dilation
+*		scratch: GetEnvelopeLength()*3+1 floats
+*		vertices: GetEnvelopeLength() integers
+*/
+void MathematicalMorphology::ParaboloidRow(uint8* out, int row,
+	bool isErosion, float* scratch, int* vertices)
+{
+	int width = this->pitch;
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	uint8* target = out + (row + firstRow) * width + firstCol;
+	int col;
+	FMemory::Memcpy(scratch, this->paraboloidBuffer + row * this->input->SizeX,
+		sizeof(float)*this->input->SizeX);
+	DistanceTransform::LowerEnvelope(scratch, this->input->SizeX,
+		this->paraboloidCurvature, scratch + this->GetEnvelopeLength(),
+		vertices);
+	for (col = 0; col < this->input->SizeX; col++)
+	{
+		float value = isErosion ? scratch[col] : -scratch[col];
+		value = value < BLACK ? BLACK : value > WHITE ? WHITE : value;
+		target[col] = (uint8)(value + 0.5f);
+	}
+}
+
+/*
+*	It sets the kernel of opening and closing, MK_Offsets by default.
+*	MK_Auto uses the kernel of the autotuner, or the forced one if
+*	it is set
+*		kernel: the kernel
+*/
+void MathematicalMorphology::SetKernel(MorphologyKernel kernel)
+{
+	this->kernel = kernel;
+}
+
+/*
+*	It measures the kernels of opening or closing if the kernel is
+*	MK_Auto and the autotuner has not measured the case yet, so the
+*	next execution only runs the fastest one
+*		isOpening: true if it has to measure opening
+*/
+void MathematicalMorphology::TuneKernel(bool isOpening)
+{
+	if (this->input && this->structElem.element
+		&& this->SelectKernel() == MK_Auto)
+	{
+		free(this->ExecuteTunedOpeningOrClosing(isOpening));
+	}
+}
+
+/*
+*	It returns the kernel of the next opening or closing and prepares
+*	its buffers, MK_Auto if the case has to be measured. Kernels that
+*	cannot compute the case are replaced by MK_Offsets: non-flat and
+*	paraboloid elements have their own passes
+*/
+MorphologyKernel MathematicalMorphology::SelectKernel()
+{
+	MorphologyKernel selected = this->kernel;
+	if (selected == MK_Auto)
+	{
+		selected = MorphologyAutotuner::FindKernel(this->elementSize,
+			this->input->SizeX, this->input->SizeY, this->threadNumber);
+	}
+	if (this->isNonFlat || this->paraboloidCurvature > 0)
+	{
+		selected = MK_Offsets;
+	}
+	this->SetSeparable(selected == MK_Separable);
+	if (selected == MK_Separable && !this->isSeparable)
+	{
+		selected = MK_Offsets;
+	}
+	this->executedKernel = selected;
+	return selected;
+}
+
+/*
+*	It executes opening or closing with every kernel, returns the
+*	output of the fastest one and stores it in the autotuner.
+*	Only one thread at a time measures a case, the others wait for
+*	its result instead of measuring it again.
+*	The kernels compute the same output
+*		isOpening: true if it has to execute opening
+*/
+uint8* MathematicalMorphology::ExecuteTunedOpeningOrClosing(bool isOpening)
+{
+	MorphologyKernel candidates[3] = { MK_Offsets, MK_Separable, MK_Pipeline };
+	MorphologyKernel fastest = MK_Offsets;
+	uint8 *output, *best = NULL;
+	double start, time, bestTime = 0;
+	bool isMeasured;
+	{
+		FScopeLock lock(MorphologyAutotuner::GetTuningLock(this->elementSize,
+			this->input->SizeX, this->input->SizeY, this->threadNumber));
+		// Another thread may have measured the case while this one waited
+		isMeasured = MorphologyAutotuner::FindKernel(this->elementSize,
+			this->input->SizeX, this->input->SizeY,
+			this->threadNumber) != MK_Auto;
+		for (int i = 0; i < 3 && !isMeasured; i++)
+		{
+			this->kernel = candidates[i];
+			start = omp_get_wtime();
+			output = this->ExecuteOpeningOrClosing(isOpening);
+			time = omp_get_wtime() - start;
+			// A kernel replaced by MK_Offsets is not measured again
+			if (output && this->executedKernel == candidates[i]
+				&& (!best || time < bestTime))
+			{
+				free(best);
+				best = output;
+				bestTime = time;
+				fastest = candidates[i];
+			}
+			else
+			{
+				free(output);
+			}
+		}
+		this->kernel = MK_Auto;
+		if (best)
+		{
+			MorphologyAutotuner::AddKernel(this->elementSize,
+				this->input->SizeX, this->input->SizeY, this->threadNumber,
+				fastest);
+		}
+	}
+	if (isMeasured)
+	{
+		return this->ExecuteOpeningOrClosing(isOpening);
+	}
+	if (best)
+	{
+		// The buffers of the fastest kernel are kept for the next execution
+		this->SetSeparable(fastest == MK_Separable);
+	}
+	this->executedKernel = fastest;
+	return best;
+}
+
+/*
+*	It executes opening or closing with the fused passes of
+*	MorphologyPipeline
+*		isOpening: true if it has to execute opening
+*/
+uint8* MathematicalMorphology::ExecutePipelineOpeningOrClosing(
+	bool isOpening)
+{
+	MorphologyPipeline pipeline(this->input, this->threadNumber);
+	int node = pipeline.AddOperation(isOpening ? PO_Opening : PO_Closing,
+		this->elementSize, pipeline.GetSource());
+	return node >= 0 ? pipeline.Execute(node, this->firstMip) : NULL;
+}
+
+/*
+*	It enables the separable passes if the element is a rectangle
+*	with odd sides: erosion and dilation are computed as a pass on the
+*	rows, a transpose, a pass on the rows of the transposed image and
+*	a transpose back. Both passes read contiguous memory and the
+*	transposes work on tiles that stay in cache, instead of walking
+*	the columns with the stride of a row
+*		separable: true to use the separable passes
+*/
+void MathematicalMorphology::SetSeparable(bool separable)
+{
+	int i, elemSize;
+	if (separable && this->isSeparable)
+	{
+		return;
+	}
+	ImagePlane::Free(this->transposeBuffer);
+	this->transposeBuffer = NULL;
+	this->isSeparable = false;
+	if (!separable || !this->input || !this->structElem.element
+		|| this->structElem.width % 2 == 0 || this->structElem.height % 2 == 0)
+	{
+		return;
+	}
+	elemSize = this->structElem.width*this->structElem.height;
+	for (i = 0; i < elemSize; i++)
+	{
+		if (this->structElem.element[i] != FOREGROUND)
+		{
+			return;
+		}
+	}
+	this->transposePitch = ImagePlane::GetPitch(
+		this->input->SizeY + this->structElem.height - 1);
+	this->transposeBuffer = (uint8*)ImagePlane::Allocate(
+		sizeof(uint8) * 2 * this->input->SizeX * this->transposePitch);
+	this->isSeparable = this->transposeBuffer != NULL;
+}
+
+/*
+*	It executes erosion or dilation with the separable passes.
+*	The loops are shared by the threads of the calling parallel
+*	region, if any
+*		in: input channel, with ghost cells
+*		out: output channel
+*		isErosion: true for erosion, false for dilation
+*/
+void MathematicalMorphology::ExecuteSeparable(const uint8* in, uint8* out,
+	bool isErosion)
+{
+	// The rectangle is symmetric, so dilation uses the same runs
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	uint8 ghost = isErosion ? WHITE : BLACK;
+	uint8* columns = this->transposeBuffer;
+	uint8* result = this->transposeBuffer +
+		this->input->SizeX * this->transposePitch;
+	uint8* image = out + firstRow * this->pitch + firstCol;
+#pragma omp for
+	for (int row = 0; row < this->input->SizeY; row++)
+	{
+		this->MinMaxRow(in + (row + firstRow) * this->pitch,
+			image + row * this->pitch, this->input->SizeX,
+			this->structElem.width, isErosion);
+	}
+	this->TransposeTiles(image, this->pitch, columns + firstRow,
+		this->transposePitch, this->input->SizeY, this->input->SizeX);
+#pragma omp for
+	for (int col = 0; col < this->input->SizeX; col++)
+	{
+		uint8* column = columns + col * this->transposePitch;
+		FMemory::Memset(column, ghost, firstRow);
+		FMemory::Memset(column + firstRow + this->input->SizeY, ghost,
+			firstRow);
+		this->MinMaxRow(column, result + col * this->transposePitch,
+			this->input->SizeY, this->structElem.height, isErosion);
+	}
+	this->TransposeTiles(result, this->transposePitch, image, this->pitch,
+		this->input->SizeX, this->input->SizeY);
+}
+
+/*
+*	It computes the minimum or maximum of each run of length
+*	contiguous values. The inner loops work on whole rows
+*		source: first value of the first run
+*		target: output values
+*		count: number of runs
+*		length: length of the runs
+*		isErosion: true for the minimum, false for the maximum
+*/
+void MathematicalMorphology::MinMaxRow(const uint8* source, uint8* target,
+	int count, int length, bool isErosion) const
+{
+	int i, k;
+	FMemory::Memcpy(target, source, count);
+	for (k = 1; k < length; k++)
+	{
+		const uint8* shifted = source + k;
+		if (isErosion)
+		{
+			for (i = 0; i < count; i++)
+			{
+				target[i] = shifted[i] < target[i] ? shifted[i] : target[i];
+			}
+		}
+		else
+		{
+			for (i = 0; i < count; i++)
+			{
+				target[i] = shifted[i] > target[i] ? shifted[i] : target[i];
+			}
+		}
+	}
+}
+
+/*
+*	It transposes a matrix by tiles of TRANSPOSE_TILE x TRANSPOSE_TILE
+*	values, so the rows read and written by a tile stay in cache.
+*	The tiles are shared by the threads of the calling parallel
+*	region, if any
+*		source: the matrix
+*		sourcePitch: distance between the rows of the matrix
+*		target: the transposed matrix
+*		targetPitch: distance between the rows of the transposed matrix
+*		rows: rows of the matrix
+*		cols: columns of the matrix
+*/
+void MathematicalMorphology::TransposeTiles(const uint8* source,
+	int sourcePitch, uint8* target, int targetPitch, int rows, int cols) const
+{
+	int tileRows = (rows + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+	int tileCols = (cols + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+#pragma omp for
+	for (int tile = 0; tile < tileRows * tileCols; tile++)
+	{
+		int firstRow = tile / tileCols * TRANSPOSE_TILE;
+		int firstCol = tile % tileCols * TRANSPOSE_TILE;
+		int endRow = firstRow + TRANSPOSE_TILE < rows ?
+			firstRow + TRANSPOSE_TILE : rows;
+		int endCol = firstCol + TRANSPOSE_TILE < cols ?
+			firstCol + TRANSPOSE_TILE : cols;
+		for (int row = firstRow; row < endRow; row++)
+		{
+			for (int col = firstCol; col < endCol; col++)
+			{
+				target[col * targetPitch + row] = source[row * sourcePitch + col];
+			}
+		}
+	}
+}
+
+/*
+*	It packs the pixels of the input image in ordering keys with
+*	ghost cells of the size of the structuring element
+*		keys: buffer of the keys
+*		ghost: key of the ghost cells
+*/
+void MathematicalMorphology::PackKeys(uint32* keys, uint32 ghost) const
+{
+	FColor* colors = this->input->AsBGRA8();
+	int width = this->pitch;
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	int row;
+	this->FillKeyGhostCells(keys, ghost);
+	#pragma omp parallel for num_threads(this->threadNumber)
+	for (row = 0; row < this->input->SizeY; row++)
+	{
+		const FColor* source = colors + row * this->input->SizeX;
+		uint32* target = keys + (row + firstRow) * width + firstCol;
+		for (int col = 0; col < this->input->SizeX; col++)
+		{
+			uint32 luminance = (77 * source[col].R + 150 * source[col].G +
+				29 * source[col].B) >> 8;
+			target[col] = luminance << 24 | (uint32)source[col].R << 16 |
+				(uint32)source[col].G << 8 | source[col].B;
+		}
+	}
+}
+
+/*
+*	It fills the ghost cells of a buffer of keys
+*		keys: buffer of the keys
+*		ghost: key of the ghost cells
+*/
+void MathematicalMorphology::FillKeyGhostCells(uint32* keys,
+	uint32 ghost) const
+{
+	int width = this->input->SizeX + this->structElem.width - 1;
+	int height = this->input->SizeY + this->structElem.height - 1;
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	for (int row = 0; row < height; row++)
+	{
+		bool isGhostRow = row < firstRow || row >= firstRow + this->input->SizeY;
+		for (int col = 0; col < width; col++)
+		{
+			if (isGhostRow || col < firstCol
+				|| col >= firstCol + this->input->SizeX)
+			{
+				keys[row * this->pitch + col] = ghost;
+			}
+		}
+	}
+}
+
+/*
+*	It computes a vector erosion or dilation of the keys
+*		in: input keys
+*		out: output keys
+*		isErosion: true for erosion, false for dilation
+*/
+void MathematicalMorphology::VectorPass(const uint32* in, uint32* out,
+	bool isErosion) const
+{
+	int width = this->pitch;
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	const Offset& offsets = isErosion ?
+		this->ErosionOffsets : this->DilationOffsets;
+	int row;
+	#pragma omp parallel for num_threads(this->threadNumber)
+	for (row = firstRow; row < firstRow + this->input->SizeY; row++)
+	{
+		const uint32* source = in + row * width + firstCol;
+		uint32* target = out + row * width + firstCol;
+		for (int col = 0; col < this->input->SizeX; col++)
+		{
+			uint32 value = isErosion ? KEY_MAX : KEY_MIN;
+			for (int i = 0; i < offsets.count; i++)
+			{
+				uint32 key = source[col + offsets.offsets[i]];
+				value = isErosion ? (key < value ? key : value) :
+					(key > value ? key : value);
+			}
+			target[col] = value;
+		}
+	}
+}
+
+/*
+*	It composes the output image from the keys, whose low 24 bits
+*	are the colour. If the first mip is enabled it is computed
+*	in the same pass
+*		keys: buffer of the keys
+*/
+uint8* MathematicalMorphology::ComposeKeys(const uint32* keys)
+{
+	int width = this->pitch;
+	int firstRow = (this->structElem.height - 1) / 2;
+	int firstCol = (this->structElem.width - 1) / 2;
+	uint8* output = (uint8*)malloc(sizeof(uint8)*
+		this->input->SizeX*this->input->SizeY*CHANNELS);
+	if (!output)
+	{
+		return NULL;
+	}
+	for (int row = 0; row < this->input->SizeY; row++)
+	{
+		const uint32* source = keys + (row + firstRow) * width + firstCol;
+		uint8* target = output + row * this->input->SizeX * CHANNELS;
+		for (int col = 0; col < this->input->SizeX; col++)
+		{
+			target[col*CHANNELS] = source[col] & 0xFF;
+			target[col*CHANNELS + 1] = (source[col] >> 8) & 0xFF;
+			target[col*CHANNELS + 2] = (source[col] >> 16) & 0xFF;
+			target[col*CHANNELS + 3] = ALPHA;
+		}
+		if (this->firstMip && (row % 2 == 1 || this->input->SizeY == 1))
+		{
+			this->DownsampleRows(output, row / 2);
+		}
+	}
+	return output;
+}
+
+/*
+*	It returns the length of the longest line of the image, used
+*	to allocate the scratch buffers of the paraboloid passes
+*/
+int MathematicalMorphology::GetEnvelopeLength() const
+{
+	return this->input->SizeX > this->input->SizeY ?
+		this->input->SizeX : this->input->SizeY;
+}
+
+/*
 *	It sets the offsets for the input image
 *		offset: array of offsets that has to be set
 *		reflect: true if the structuring element has to
 *			be reflected (for dilation)
+*		imageWidth: distance between the rows of the channels
 */
-void MathematicalMorphology::SetOffsets(Offset *offset, bool reflect)
+void MathematicalMorphology::SetOffsets(Offset *offset, bool reflect,
+	int imageWidth) const
 {
 	int halfWidth = (this->structElem.width - 1) / 2;
 	int halfHeight = (this->structElem.height - 1) / 2;
-	int imageWidth = this->input->SizeX + this->structElem.width - 1;
 	if (offset->offsets)
 	{
 		for (int row = 0; row < this->structElem.height; row++)
@@ -86,33 +1051,105 @@ void MathematicalMorphology::SetOffsets(Offset *offset, bool reflect)
 }
 
 /*	PRIVATE
-*	It loads the structuring element
+*	It sets the offsets of the non-flat element as rows and columns
+*	from the center, with the gray value of each pixel as weight
+*		offset: offsets that have to be set
+*		reflect: true if the structuring element has to
+*			be reflected (for dilation)
+*/
+void MathematicalMorphology::SetWeightedOffsets(WeightedOffset *offset,
+	bool reflect)
+{
+	int halfWidth = (this->structElem.width - 1) / 2;
+	int halfHeight = (this->structElem.height - 1) / 2;
+	if (offset->rows && offset->cols && offset->weights)
+	{
+		for (int row = 0; row < this->structElem.height; row++)
+		{
+			for (int col = 0; col < this->structElem.width; col++)
+			{
+				uint8 weight = this->structElem
+					.element[row*this->structElem.width + col];
+				if (weight != BLACK)
+				{
+					offset->rows[offset->count] = reflect ?
+						halfHeight - row : row - halfHeight;
+					offset->cols[offset->count] = reflect ?
+						halfWidth - col : col - halfWidth;
+					offset->weights[offset->count] = weight;
+					offset->count++;
+				}
+			}
+		}
+	}
+}
+
+/*	PRIVATE
+*	It frees the offsets of the non-flat element
+*/
+void MathematicalMorphology::FreeWeightedOffsets()
+{
+	free(this->ErosionWeights.rows);
+	free(this->ErosionWeights.cols);
+	free(this->ErosionWeights.weights);
+	free(this->DilationWeights.rows);
+	free(this->DilationWeights.cols);
+	free(this->DilationWeights.weights);
+	this->ErosionWeights = WeightedOffset();
+	this->DilationWeights = WeightedOffset();
+}
+
+/*
+*	It loads the structuring element of the given size from file.
+*	The file is decoded once and each call returns a copy, that the
+*	caller frees. The element is NULL if the file cannot be loaded
+*		size: size of the structuring element
 */
-void MathematicalMorphology::LoadStructuringElement(int size)
+StructuringElement MathematicalMorphology::LoadStructuringElement(int size)
 {
 	FString file = MathematicalMorphology::fileName +
 		FString::FromInt(size) + MathematicalMorphology::extension;
-	FImage* elem = UTextureUtilities::LoadImageFromFile(file);
-	this->structElem.element = NULL;
-	if (elem)
-	{
-		this->structElem.width = elem->SizeX;
-		this->structElem.height = elem->SizeY;
-		this->structElem.element = 
-			(uint8*)malloc(sizeof(uint8)*this->structElem.height
-			*this->structElem.width);
+	StructuringElement structElem = StructuringElement();
+	StructuringElement* loaded;
+	FScopeLock lock(&MathematicalMorphology::elementLock);
+	structElem.element = NULL;
+	loaded = MathematicalMorphology::loadedElements.Find(size);
+	if (!loaded)
+	{
+		FImage* elem = UTextureUtilities::LoadImageFromFile(file);
+		StructuringElement decoded = StructuringElement();
+		if (!elem)
+		{
+			return structElem;
+		}
+		decoded.width = elem->SizeX;
+		decoded.height = elem->SizeY;
+		decoded.element = (uint8*)malloc(sizeof(uint8)*decoded.height
+			*decoded.width);
 		FColor* colors = elem->AsBGRA8();
-		if (this->structElem.element)
+		for (int i = 0; decoded.element && i < decoded.height; i++)
 		{
-			for (int i = 0; i < this->structElem.height; i++)
+			for (int j = 0; j < decoded.width; j++)
 			{
-				for (int j = 0; j < this->structElem.width; j++)
-				{
-					this->structElem.element
-						[i*this->structElem.width + j] =
-						colors[i*this->structElem.width + j].R;
-				}
+				decoded.element[i*decoded.width + j] =
+					colors[i*decoded.width + j].R;
 			}
 		}
+		delete elem;
+		if (!decoded.element)
+		{
+			return structElem;
+		}
+		loaded = &MathematicalMorphology::loadedElements.Add(size, decoded);
+	}
+	structElem.width = loaded->width;
+	structElem.height = loaded->height;
+	structElem.element = (uint8*)malloc(sizeof(uint8)*structElem.height
+		*structElem.width);
+	if (structElem.element)
+	{
+		FMemory::Memcpy(structElem.element, loaded->element,
+			structElem.height*structElem.width);
 	}
+	return structElem;
 }
\ No newline at end of file
@@ -0,0 +1,202 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MorphologyAutotuner.h"
+
+// Fastest kernel of each case
+TMap<uint64, MorphologyKernel> MorphologyAutotuner::profile;
+// True if the profile was read from file
+bool MorphologyAutotuner::isLoaded = false;
+// Kernel used instead of the profile, MK_Auto if none
+std::atomic<MorphologyKernel> MorphologyAutotuner::forcedKernel(MK_Auto);
+// Lock of the profile
+FCriticalSection MorphologyAutotuner::profileLock;
+// Locks of the measurements, one for each case
+TMap<uint64, TSharedPtr<FCriticalSection>> MorphologyAutotuner::tuningLocks;
+
+/*
+*	It returns the kernel to use for a case: the forced kernel if it
+*	is set, else the fastest one measured, MK_Auto if the case has
+*	to be measured
+*		elementSize: size of the structuring element
+*		width: width of the image
+*		height: height of the image
+*		threadNumber: number of threads
+*/
+MorphologyKernel MorphologyAutotuner::FindKernel(int elementSize, int width,
+	int height, int threadNumber)
+{
+	MorphologyKernel forced = MorphologyAutotuner::forcedKernel;
+	if (forced != MK_Auto)
+	{
+		return forced;
+	}
+	FScopeLock lock(&MorphologyAutotuner::profileLock);
+	if (!MorphologyAutotuner::isLoaded)
+	{
+		MorphologyAutotuner::Load();
+	}
+	return MorphologyAutotuner::profile.FindRef(MorphologyAutotuner::GetKey(
+		elementSize, width, height, threadNumber));
+}
+
+/*
+*	It stores the fastest kernel of a case and writes the profile
+*		elementSize: size of the structuring element
+*		width: width of the image
+*		height: height of the image
+*		threadNumber: number of threads
+*		kernel: the fastest kernel
+*/
+void MorphologyAutotuner::AddKernel(int elementSize, int width, int height,
+	int threadNumber, MorphologyKernel kernel)
+{
+	FScopeLock lock(&MorphologyAutotuner::profileLock);
+	if (!MorphologyAutotuner::isLoaded)
+	{
+		MorphologyAutotuner::Load();
+	}
+	MorphologyAutotuner::profile.Add(MorphologyAutotuner::GetKey(
+		elementSize, width, height, threadNumber), kernel);
+	MorphologyAutotuner::Save();
+}
+
+/*
+*	It returns the lock held while a case is measured. Only one
+*	thread measures a case; the threads that measure other cases
+*	or use measured ones do not wait
+*		elementSize: size of the structuring element
+*		width: width of the image
+*		height: height of the image
+*		threadNumber: number of threads
+*/
+FCriticalSection* MorphologyAutotuner::GetTuningLock(int elementSize,
+	int width, int height, int threadNumber)
+{
+	uint64 key = MorphologyAutotuner::GetKey(elementSize, width, height,
+		threadNumber);
+	FScopeLock lock(&MorphologyAutotuner::profileLock);
+	TSharedPtr<FCriticalSection>* tuningLock =
+		MorphologyAutotuner::tuningLocks.Find(key);
+	if (!tuningLock)
+	{
+		tuningLock = &MorphologyAutotuner::tuningLocks.Add(key,
+			MakeShareable(new FCriticalSection()));
+	}
+	return tuningLock->Get();
+}
+
+/*
+*	It forces a kernel for all the cases, to compare them.
+*	Kernels that cannot compute a case fall back to MK_Offsets
+*		kernel: the kernel, MK_Auto to use the profile
+*/
+void MorphologyAutotuner::SetForcedKernel(MorphologyKernel kernel)
+{
+	MorphologyAutotuner::forcedKernel = kernel;
+}
+
+/*
+*	It removes all the measurements and empties the profile file,
+*	so the cases are measured again
+*/
+void MorphologyAutotuner::Empty()
+{
+	FScopeLock lock(&MorphologyAutotuner::profileLock);
+	MorphologyAutotuner::profile.Empty();
+	MorphologyAutotuner::isLoaded = true;
+	MorphologyAutotuner::Save();
+}
+
+/*	PRIVATE
+*	It returns the key of a case
+*		elementSize: size of the structuring element
+*		width: width of the image
+*		height: height of the image
+*		threadNumber: number of threads
+*/
+uint64 MorphologyAutotuner::GetKey(int elementSize, int width, int height,
+	int threadNumber)
+{
+	return (uint64)(elementSize & 0xFFFF) << 32 |
+		(uint64)MorphologyAutotuner::GetSizeClass(width) << 24 |
+		(uint64)MorphologyAutotuner::GetSizeClass(height) << 16 |
+		(uint64)(threadNumber & 0xFFFF);
+}
+
+/*	PRIVATE
+*	It returns the class of a size, the exponent of the
+*	smallest power of two not less than it
+*		size: the size
+*/
+int MorphologyAutotuner::GetSizeClass(int size)
+{
+	int sizeClass = 0;
+	while (sizeClass < 31 && (1 << sizeClass) < size)
+	{
+		sizeClass++;
+	}
+	return sizeClass;
+}
+
+/*	PRIVATE
+*	It returns the path of the profile, in the saved directory
+*/
+FString MorphologyAutotuner::GetProfileFile()
+{
+	return FPaths::ConvertRelativePathToFull(FPaths::ProjectSavedDir())
+		+ "MorphologyProfile.txt";
+}
+
+/*	PRIVATE
+*	It reads the profile. Each line is a case: element size,
+*	width and height classes, threads and kernel
+*/
+void MorphologyAutotuner::Load()
+{
+	TArray<FString> lines;
+	MorphologyAutotuner::isLoaded = true;
+	if (!FFileHelper::LoadFileToStringArray(lines,
+		*MorphologyAutotuner::GetProfileFile()))
+	{
+		return;
+	}
+	for (int i = 0; i < lines.Num(); i++)
+	{
+		TArray<FString> words;
+		int values[5], k;
+		if (lines[i].ParseIntoArrayWS(words) != 5)
+		{
+			continue;
+		}
+		for (k = 0; k < 5; k++)
+		{
+			values[k] = FCString::Atoi(*words[k]);
+		}
+		if (values[4] <= MK_Auto || values[4] > MK_Pipeline)
+		{
+			continue;
+		}
+		MorphologyAutotuner::profile.Add((uint64)(values[0] & 0xFFFF) << 32 |
+			(uint64)(values[1] & 0xFF) << 24 | (uint64)(values[2] & 0xFF) << 16 |
+			(uint64)(values[3] & 0xFFFF), (MorphologyKernel)values[4]);
+	}
+}
+
+/*	PRIVATE
+*	It writes the profile
+*/
+void MorphologyAutotuner::Save()
+{
+	TArray<FString> lines;
+	TArray<uint64> keys;
+	MorphologyAutotuner::profile.GetKeys(keys);
+	for (int i = 0; i < keys.Num(); i++)
+	{
+		lines.Add(FString::Printf(TEXT("%d %d %d %d %d"),
+			(int)(keys[i] >> 32 & 0xFFFF), (int)(keys[i] >> 24 & 0xFF),
+			(int)(keys[i] >> 16 & 0xFF), (int)(keys[i] & 0xFFFF),
+			(int)MorphologyAutotuner::profile.FindRef(keys[i])));
+	}
+	FFileHelper::SaveStringArrayToFile(lines, *MorphologyAutotuner::GetProfileFile());
+}
@@ -0,0 +1,618 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MorphologyPipeline.h"
+
+/*
+*	MorphologyPipeline constructor.
+*	The graph contains only the source node, that is the input image
+*		image: input image
+*		threadNumber: the number of thread to use
+*/
+MorphologyPipeline::MorphologyPipeline(FImage* image, int threadNumber)
+{
+	this->input = image;
+	this->threadNumber = threadNumber > 0 ? threadNumber : 1;
+	this->padX = -1;
+	this->padY = -1;
+	this->pitch = 0;
+	this->paddedHeight = 0;
+	this->planeSize = 0;
+	this->fusedCount = 0;
+	this->AddNode(PS_Source, -1, -1, -1);
+}
+
+/*
+*	MorphologyPipeline destructor.
+*	It frees the buffers and the structuring elements
+*/
+MorphologyPipeline::~MorphologyPipeline()
+{
+	this->FreeBuffers();
+	for (int i = 0; i < this->elements.Num(); i++)
+	{
+		free(this->elements[i].element.element);
+		free(this->elements[i].offsets);
+		free(this->elements[i].reflectedOffsets);
+	}
+}
+
+/*
+*	It adds an operation to the graph without computing it.
+*	It returns the node of the result, -1 if the input node does not
+*	exist or the structuring element cannot be loaded
+*		operation: the operation to add
+*		elementSize: size of the structuring element
+*		input: node of the input, GetSource() for the image
+*/
+int MorphologyPipeline::AddOperation(PipelineOperation operation,
+	int elementSize, int input)
+{
+	int element = this->FindElement(elementSize);
+	int first;
+	if (element < 0 || input < 0 || input >= this->nodes.Num())
+	{
+		return -1;
+	}
+	switch (operation)
+	{
+	case PO_Erosion:
+		return this->AddNode(PS_Erosion, input, -1, element);
+	case PO_Dilation:
+		return this->AddNode(PS_Dilation, input, -1, element);
+	case PO_Opening:
+		first = this->AddNode(PS_Erosion, input, -1, element);
+		return this->AddNode(PS_Dilation, first, -1, element);
+	case PO_Closing:
+		first = this->AddNode(PS_Dilation, input, -1, element);
+		return this->AddNode(PS_Erosion, first, -1, element);
+	case PO_Gradient:
+		first = this->AddNode(PS_Dilation, input, -1, element);
+		return this->AddNode(PS_Subtract, first,
+			this->AddNode(PS_Erosion, input, -1, element), -1);
+	default:
+		return -1;
+	}
+}
+
+/*
+*	It computes the nodes needed by a node and returns its result
+*	as an image, NULL if the buffers could not be allocated
+*		output: node of the result
+*		firstMip: half-size image computed while the result is
+*			composed, NULL if not used
+*/
+uint8* MorphologyPipeline::Execute(int output, uint8* firstMip)
+{
+	uint8 *bands = NULL, *result = NULL;
+	int i;
+	if (!this->input || output < 0 || output >= this->nodes.Num()
+		|| !this->PlanExecution(output))
+	{
+		return NULL;
+	}
+	if (this->fusedCount > 0)
+	{
+		bands = (uint8*)ImagePlane::Allocate(sizeof(uint8)*this->threadNumber*
+			(PIPELINE_BAND_ROWS + 2 * this->padY)*this->pitch);
+		if (!bands)
+		{
+			return NULL;
+		}
+	}
+	for (i = 0; i <= output; i++)
+	{
+		const PipelineNode& node = this->nodes[i];
+		uint8* out;
+		if (!node.isNeeded || node.isFused)
+		{
+			continue;
+		}
+		out = this->buffers[node.buffer];
+		if (node.step == PS_Source)
+		{
+			this->SplitSource(out);
+		}
+		else if (node.step == PS_Subtract)
+		{
+			this->ExecuteSubtraction(
+				this->buffers[this->nodes[node.inputs[0]].buffer],
+				this->buffers[this->nodes[node.inputs[1]].buffer], out);
+		}
+		else
+		{
+			// Ghost cells are filled for the pass that reads them
+			const PipelineNode& first = node.fusedInput != -1 ?
+				this->nodes[node.fusedInput] : node;
+			uint8* in = this->buffers[this->nodes[first.inputs[0]].buffer];
+			this->FillGhostCells(in, first.step == PS_Erosion ? WHITE : BLACK);
+			if (node.fusedInput != -1)
+			{
+				this->ExecuteFusedPasses(first, node, in, out, bands);
+			}
+			else
+			{
+				this->ExecutePass(node, in, out);
+			}
+		}
+	}
+	result = this->ComposeImage(this->buffers[this->nodes[output].buffer],
+		firstMip);
+	ImagePlane::Free(bands);
+	return result;
+}
+
+/*	PRIVATE
+*	It adds a node to the graph and returns its index
+*		step: step executed by the node
+*		first: first input node, -1 for the source
+*		second: second input node, -1 if not used
+*		element: index of the structuring element, -1 if not used
+*/
+int MorphologyPipeline::AddNode(PipelineStep step, int first, int second,
+	int element)
+{
+	PipelineNode node;
+	node.step = step;
+	node.inputs[0] = first;
+	node.inputs[1] = second;
+	node.element = element;
+	node.isNeeded = false;
+	node.lastUse = -1;
+	node.buffer = -1;
+	node.fusedInput = -1;
+	node.isFused = false;
+	this->nodes.Add(node);
+	return this->nodes.Num() - 1;
+}
+
+/*	PRIVATE
+*	It returns the index of the structuring element of a size,
+*	loading it the first time. It returns -1 if it cannot be loaded
+*		size: size of the structuring element
+*/
+int MorphologyPipeline::FindElement(int size)
+{
+	PipelineElement element;
+	for (int i = 0; i < this->elements.Num(); i++)
+	{
+		if (this->elements[i].size == size)
+		{
+			return i;
+		}
+	}
+	element.size = size;
+	element.element = MathematicalMorphology::LoadStructuringElement(size);
+	element.offsets = NULL;
+	element.reflectedOffsets = NULL;
+	element.count = 0;
+	if (!element.element.element)
+	{
+		return -1;
+	}
+	this->elements.Add(element);
+	return this->elements.Num() - 1;
+}
+
+/*	PRIVATE
+*	It plans an execution: it marks the nodes needed by the output,
+*	fuses the passes whose result has only the next pass as user and
+*	assigns the buffers, reusing the buffer of a result after its last
+*	use. It returns false if the buffers could not be allocated
+*		output: node of the result
+*/
+bool MorphologyPipeline::PlanExecution(int output)
+{
+	TArray<int> users;
+	int i, k;
+	if (!this->SetPadding())
+	{
+		return false;
+	}
+	for (i = 0; i < this->nodes.Num(); i++)
+	{
+		PipelineNode& node = this->nodes[i];
+		node.isNeeded = i == output;
+		node.lastUse = -1;
+		node.buffer = -1;
+		node.fusedInput = -1;
+		node.isFused = false;
+		users.Add(0);
+	}
+	for (i = output; i >= 0; i--)
+	{
+		for (k = 0; k < 2 && this->nodes[i].isNeeded; k++)
+		{
+			if (this->nodes[i].inputs[k] >= 0)
+			{
+				this->nodes[this->nodes[i].inputs[k]].isNeeded = true;
+				users[this->nodes[i].inputs[k]]++;
+			}
+		}
+	}
+	this->fusedCount = 0;
+	for (i = 1; i <= output; i++)
+	{
+		PipelineNode& node = this->nodes[i];
+		int previous = node.inputs[0];
+		if (node.isNeeded && (node.step == PS_Erosion ||
+			node.step == PS_Dilation) && previous != output &&
+			users[previous] == 1 && this->nodes[previous].fusedInput == -1 &&
+			(this->nodes[previous].step == PS_Erosion ||
+			this->nodes[previous].step == PS_Dilation))
+		{
+			this->nodes[previous].isFused = true;
+			node.fusedInput = previous;
+			this->fusedCount++;
+		}
+	}
+	// A node reads the inputs of the pass fused with it
+	for (i = 0; i <= output; i++)
+	{
+		const PipelineNode& node = this->nodes[i];
+		const PipelineNode& reader = node.fusedInput != -1 ?
+			this->nodes[node.fusedInput] : node;
+		for (k = 0; k < 2 && node.isNeeded && !node.isFused; k++)
+		{
+			if (reader.inputs[k] >= 0)
+			{
+				this->nodes[reader.inputs[k]].lastUse = i;
+			}
+		}
+	}
+	for (i = 0; i < this->isBufferFree.Num(); i++)
+	{
+		this->isBufferFree[i] = true;
+	}
+	for (i = 0; i <= output; i++)
+	{
+		PipelineNode& node = this->nodes[i];
+		if (!node.isNeeded || node.isFused)
+		{
+			continue;
+		}
+		// The output buffer is taken before the inputs are released,
+		// because the passes cannot work in place
+		node.buffer = this->TakeBuffer();
+		if (node.buffer < 0)
+		{
+			return false;
+		}
+		for (k = 0; k < this->nodes.Num(); k++)
+		{
+			if (this->nodes[k].lastUse == i && this->nodes[k].buffer >= 0)
+			{
+				this->isBufferFree[this->nodes[k].buffer] = true;
+			}
+		}
+	}
+	return true;
+}
+
+/*	PRIVATE
+*	It sets the ghost cells to the size of the largest element and
+*	computes the offsets of the elements in the planes. Buffers are
+*	allocated again if the size of the planes changes, the offsets of
+*	all the elements are computed again if the pitch changes and the
+*	ones of the elements added since the last call are always computed.
+*	It returns false if the offsets could not be allocated
+*/
+bool MorphologyPipeline::SetPadding()
+{
+	int newPadX = 0, newPadY = 0, newPitch;
+	bool isPitchChanged;
+	int i, row, col;
+	for (i = 0; i < this->elements.Num(); i++)
+	{
+		const StructuringElement& element = this->elements[i].element;
+		newPadX = element.width / 2 > newPadX ? element.width / 2 : newPadX;
+		newPadY = element.height / 2 > newPadY ? element.height / 2 : newPadY;
+	}
+	newPitch = ImagePlane::GetPitch(this->input->SizeX + 2 * newPadX);
+	isPitchChanged = this->padX < 0 || newPitch != this->pitch;
+	if (newPadX != this->padX || newPadY != this->padY)
+	{
+		this->FreeBuffers();
+		this->padX = newPadX;
+		this->padY = newPadY;
+		this->pitch = newPitch;
+		this->paddedHeight = this->input->SizeY + 2 * newPadY;
+		this->planeSize = (int64)this->pitch * this->paddedHeight;
+	}
+	for (i = 0; i < this->elements.Num(); i++)
+	{
+		PipelineElement& element = this->elements[i];
+		int width = element.element.width;
+		int height = element.element.height;
+		if (element.offsets && element.reflectedOffsets && !isPitchChanged)
+		{
+			continue;
+		}
+		free(element.offsets);
+		free(element.reflectedOffsets);
+		element.offsets = (int*)malloc(sizeof(int)*width*height);
+		element.reflectedOffsets = (int*)malloc(sizeof(int)*width*height);
+		element.count = 0;
+		if (!element.offsets || !element.reflectedOffsets)
+		{
+			this->padX = -1;
+			return false;
+		}
+		for (row = 0; row < height; row++)
+		{
+			for (col = 0; col < width; col++)
+			{
+				if (element.element.element[row * width + col] == FOREGROUND)
+				{
+					// Dilation uses the reflected element
+					element.offsets[element.count] =
+						(row - (height - 1) / 2) * this->pitch +
+						col - (width - 1) / 2;
+					element.reflectedOffsets[element.count] =
+						(height - 1 - row - (height - 1) / 2) *
+						this->pitch + width - 1 - col - (width - 1) / 2;
+					element.count++;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+/*	PRIVATE
+*	It returns a free buffer, allocating a new one if all the
+*	buffers are used. It returns -1 if it cannot be allocated
+*/
+int MorphologyPipeline::TakeBuffer()
+{
+	uint8* buffer;
+	for (int i = 0; i < this->buffers.Num(); i++)
+	{
+		if (this->isBufferFree[i])
+		{
+			this->isBufferFree[i] = false;
+			return i;
+		}
+	}
+	buffer = (uint8*)ImagePlane::Allocate(sizeof(uint8) * 3 * this->planeSize);
+	if (!buffer)
+	{
+		return -1;
+	}
+	this->buffers.Add(buffer);
+	this->isBufferFree.Add(false);
+	return this->buffers.Num() - 1;
+}
+
+/*	PRIVATE
+*	It splits the channels of the input image in red, green
+*	and blue planes. Ghost cells are filled by the passes
+*		planes: buffer of the three planes
+*/
+void MorphologyPipeline::SplitSource(uint8* planes) const
+{
+	FColor* colors = this->input->AsBGRA8();
+	int row;
+	#pragma omp parallel for num_threads(this->threadNumber)
+	for (row = 0; row < this->input->SizeY; row++)
+	{
+		int64 first = (int64)(row + this->padY) * this->pitch + this->padX;
+		const FColor* source = colors + (int64)row * this->input->SizeX;
+		for (int col = 0; col < this->input->SizeX; col++)
+		{
+			planes[first + col] = source[col].R;
+			planes[this->planeSize + first + col] = source[col].G;
+			planes[2 * this->planeSize + first + col] = source[col].B;
+		}
+	}
+}
+
+/*	PRIVATE
+*	It fills the ghost cells of the three planes
+*		planes: buffer of the three planes
+*		value: value for ghost cells
+*/
+void MorphologyPipeline::FillGhostCells(uint8* planes, uint8 value) const
+{
+	int rightPad = this->pitch - this->padX - this->input->SizeX;
+	for (int c = 0; c < 3; c++)
+	{
+		uint8* plane = planes + c * this->planeSize;
+		FMemory::Memset(plane, value, this->padY * this->pitch);
+		FMemory::Memset(plane + (int64)(this->padY + this->input->SizeY) *
+			this->pitch, value, this->padY * this->pitch);
+		for (int row = this->padY; row < this->padY + this->input->SizeY; row++)
+		{
+			uint8* line = plane + (int64)row * this->pitch;
+			FMemory::Memset(line, value, this->padX);
+			FMemory::Memset(line + this->padX + this->input->SizeX,
+				value, rightPad);
+		}
+	}
+}
+
+/*	PRIVATE
+*	It executes an erosion or a dilation on the three planes
+*		node: the node of the pass
+*		in: input planes with the ghost cells filled
+*		out: output planes
+*/
+void MorphologyPipeline::ExecutePass(const PipelineNode& node,
+	const uint8* in, uint8* out) const
+{
+	int rows = 3 * this->input->SizeY;
+	int i;
+	#pragma omp parallel for num_threads(this->threadNumber)
+	for (i = 0; i < rows; i++)
+	{
+		int64 first = (int64)(i / this->input->SizeY) * this->planeSize +
+			(int64)(i % this->input->SizeY + this->padY) * this->pitch +
+			this->padX;
+		this->FilterRow(in + first, out + first, node);
+	}
+}
+
+/*	PRIVATE
+*	It executes two passes band by band: the first pass computes the
+*	rows of a band and the ghost rows the second pass needs in a
+*	buffer of the thread, then the second pass computes the band.
+*	The band buffer has the width of the planes, so the offsets of
+*	the elements are the same
+*		first: the node of the first pass
+*		second: the node of the second pass
+*		in: input planes with the ghost cells filled for the first pass
+*		out: output planes
+*		bands: PIPELINE_BAND_ROWS + 2 * padY rows for each thread
+*/
+void MorphologyPipeline::ExecuteFusedPasses(const PipelineNode& first,
+	const PipelineNode& second, const uint8* in, uint8* out,
+	uint8* bands) const
+{
+	int bandCount = (this->input->SizeY + PIPELINE_BAND_ROWS - 1) /
+		PIPELINE_BAND_ROWS;
+	int64 bandSize = (int64)(PIPELINE_BAND_ROWS + 2 * this->padY) *
+		this->pitch;
+	uint8 ghost = second.step == PS_Erosion ? WHITE : BLACK;
+	int i;
+	#pragma omp parallel for num_threads(this->threadNumber)
+	for (i = 0; i < 3 * bandCount; i++)
+	{
+		const uint8* inPlane = in + (i / bandCount) * this->planeSize;
+		uint8* outPlane = out + (i / bandCount) * this->planeSize;
+		uint8* band = bands + omp_get_thread_num() * bandSize;
+		int firstRow = (i % bandCount) * PIPELINE_BAND_ROWS;
+		int endRow = firstRow + PIPELINE_BAND_ROWS < this->input->SizeY ?
+			firstRow + PIPELINE_BAND_ROWS : this->input->SizeY;
+		int row;
+		for (row = firstRow - this->padY; row < endRow + this->padY; row++)
+		{
+			uint8* line = band + (int64)(row - firstRow + this->padY) *
+				this->pitch;
+			if (row < 0 || row >= this->input->SizeY)
+			{
+				FMemory::Memset(line, ghost, this->pitch);
+				continue;
+			}
+			FMemory::Memset(line, ghost, this->padX);
+			FMemory::Memset(line + this->padX + this->input->SizeX, ghost,
+				this->pitch - this->padX - this->input->SizeX);
+			this->FilterRow(inPlane + (int64)(row + this->padY) *
+				this->pitch + this->padX, line + this->padX, first);
+		}
+		for (row = firstRow; row < endRow; row++)
+		{
+			this->FilterRow(band + (int64)(row - firstRow + this->padY) *
+				this->pitch + this->padX, outPlane +
+				(int64)(row + this->padY) * this->pitch + this->padX,
+				second);
+		}
+	}
+}
+
+/*	PRIVATE
+*	It subtracts the second planes from the first ones with
+*	saturation, used by the morphological gradient
+*		first: first planes
+*		second: second planes
+*		out: output planes
+*/
+void MorphologyPipeline::ExecuteSubtraction(const uint8* first,
+	const uint8* second, uint8* out) const
+{
+	int rows = 3 * this->input->SizeY;
+	int i;
+	#pragma omp parallel for num_threads(this->threadNumber)
+	for (i = 0; i < rows; i++)
+	{
+		int64 start = (int64)(i / this->input->SizeY) * this->planeSize +
+			(int64)(i % this->input->SizeY + this->padY) * this->pitch +
+			this->padX;
+		for (int64 j = start; j < start + this->input->SizeX; j++)
+		{
+			out[j] = first[j] > second[j] ? first[j] - second[j] : 0;
+		}
+	}
+}
+
+/*	PRIVATE
+*	It computes a row of an erosion or a dilation
+*		in: first pixel of the input row
+*		out: first pixel of the output row
+*		node: the node of the pass
+*/
+void MorphologyPipeline::FilterRow(const uint8* in, uint8* out,
+	const PipelineNode& node) const
+{
+	const PipelineElement& element = this->elements[node.element];
+	bool isErosion = node.step == PS_Erosion;
+	const int* offsets = isErosion ?
+		element.offsets : element.reflectedOffsets;
+	for (int col = 0; col < this->input->SizeX; col++)
+	{
+		uint8 value = isErosion ? WHITE : BLACK;
+		for (int i = 0; i < element.count; i++)
+		{
+			uint8 pixel = in[col + offsets[i]];
+			value = isErosion ? (pixel < value ? pixel : value) :
+				(pixel > value ? pixel : value);
+		}
+		out[col] = value;
+	}
+}
+
+/*	PRIVATE
+*	It interleaves the planes of the result in the output image
+*		planes: buffer of the three planes
+*		firstMip: half-size image computed from the output rows
+*			while they are in cache, NULL if not used
+*/
+uint8* MorphologyPipeline::ComposeImage(const uint8* planes,
+	uint8* firstMip) const
+{
+	int64 size = (int64)this->input->SizeX * this->input->SizeY;
+	uint8* output = (uint8*)malloc(sizeof(uint8)*size*CHANNELS);
+	int pairCount = (this->input->SizeY + 1) / 2;
+	int pair;
+	if (!output)
+	{
+		return NULL;
+	}
+	// Rows are composed in pairs, which give a row of the first mip
+	#pragma omp parallel for num_threads(this->threadNumber)
+	for (pair = 0; pair < pairCount; pair++)
+	{
+		int last = 2 * pair + 2 < this->input->SizeY ?
+			2 * pair + 2 : this->input->SizeY;
+		for (int row = 2 * pair; row < last; row++)
+		{
+			int64 first = (int64)(row + this->padY) * this->pitch + this->padX;
+			uint8* target = output + (int64)row * this->input->SizeX * CHANNELS;
+			for (int col = 0; col < this->input->SizeX; col++)
+			{
+				target[col*CHANNELS] = planes[2 * this->planeSize + first + col];
+				target[col*CHANNELS + 1] = planes[this->planeSize + first + col];
+				target[col*CHANNELS + 2] = planes[first + col];
+				target[col*CHANNELS + 3] = ALPHA;
+			}
+		}
+		if (firstMip && (last - 2 * pair == 2 || this->input->SizeY == 1))
+		{
+			UTextureUtilities::DownsampleRow(output, this->input->SizeX,
+				this->input->SizeY, pair, firstMip);
+		}
+	}
+	return output;
+}
+
+/*	PRIVATE
+*	It frees the buffers of the planes
+*/
+void MorphologyPipeline::FreeBuffers()
+{
+	for (int i = 0; i < this->buffers.Num(); i++)
+	{
+		ImagePlane::Free(this->buffers[i]);
+	}
+	this->buffers.Empty();
+	this->isBufferFree.Empty();
+}
@@ -3,6 +3,11 @@
 
 #include "OpenMPDiamondSquare.h"
 #include "TextureUtilities.h"
+#include <thread>
+
+// Minimum number of row bands per thread to run a level in parallel
+#define BANDS_PER_THREAD 2
+
 /*
 *	OpenMPDiamondSquare constructor.
 *	It allocates space for the image matrix
@@ -27,65 +32,195 @@ uint8 * OpenMPDiamondSquare::ExecuteDiamondSquare()
 	{
 		return NULL;
 	}
-	srand((unsigned)time(0));
 	/*It initializes matrix angles using random values*/
-	this->image[0 * size + 0] = rand() % MAX;
-	this->image[0 * size + last] = rand() % MAX;
-	this->image[last*size + 0] = rand() % MAX;
-	this->image[last*size + last] = rand() % MAX;
-#pragma omp parallel
-	{
-		this->DiamondSquare(last, MAX);
-	}
+	this->image[0 * size + 0] = this->RandomHash(0, 0) % MAX;
+	this->image[0 * size + last] = this->RandomHash(0, last) % MAX;
+	this->image[last*size + 0] = this->RandomHash(last, 0) % MAX;
+	this->image[last*size + last] = this->RandomHash(last, last) % MAX;
+	this->DiamondSquare(last, MAX);
 	return this->image;
 }
-	
+
 /*
-*	Recursive function.
-*	It starts the diamond-square algorithm
+*	It executes the levels of the diamond-square algorithm.
+*	Coarse levels have fewer rows than threads, so they are computed
+*	serially by the calling thread; when a level has enough rows
+*	the remaining levels are computed in parallel by row bands
 *		matrixSize: size of the matrix row/column
 *			which the algorithm has to be executed on
 *		maxValue: random seed to use
 */
 void OpenMPDiamondSquare::DiamondSquare(int matrixSize, int maxValue)
 {
-	int last = size - 1;
-	int half = matrixSize / 2;
-	if (matrixSize > 1)
+	int last = this->size - 1;
+	for (; matrixSize > 1; matrixSize /= 2, maxValue /= 2)
 	{
-		int startIndex, endSquare;
-		int i, j;
-		unsigned int seed = (unsigned)time(0)*(omp_get_thread_num() + 1);
-		srand(seed);
-		//Diamond step
-#pragma omp for private(j)
-		for (i = half; i < last; i += matrixSize)
+		if (last / matrixSize >= BANDS_PER_THREAD * this->threadNum)
 		{
-			for (j = half; j < last; j += matrixSize)
-			{
-				this->DiamondStep(i, j, half, maxValue);
-			}
+			this->ParallelDiamondSquare(matrixSize, maxValue);
+			return;
 		}
-		//Square step
-#pragma omp for private(j, startIndex, endSquare)
-		for (i = 0; i < this->size; i += half)
+		this->DiamondRows(matrixSize, maxValue, 0, this->size);
+		this->SquareRows(matrixSize, maxValue, 0, this->size);
+		this->EmitPreview(matrixSize / 2);
+	}
+}
+
+/*	PRIVATE
+*	It computes all the levels from matrixSize down to 2 in a single
+*	parallel region without barriers. The matrix is split in bands of
+*	matrixSize rows and the work items (level, band) are handed out in
+*	wavefront order. The diamond step of a band at level k waits only
+*	for the square step of the band and of the band below at level k-1,
+*	the square step waits only for the diamond step of the band above,
+*	so a band can go on with the next level while other bands are
+*	still computing the previous one.
+*		matrixSize: size of the squares of the first level to compute
+*		maxValue: random seed of the first level to compute
+*/
+void OpenMPDiamondSquare::ParallelDiamondSquare(int matrixSize, int maxValue)
+{
+	int last = this->size - 1;
+	int bandCount = last / matrixSize;
+	int levelCount = 0;
+	int itemCount;
+	std::atomic<int> nextItem(0);
+	// Number of diamond and square steps completed by each band
+	std::atomic<int>* progress = new std::atomic<int>[bandCount];
+	// Number of bands that completed each level
+	std::atomic<int>* completedBands;
+	for (int step = matrixSize; step > 1; step /= 2)
+	{
+		levelCount++;
+	}
+	completedBands = new std::atomic<int>[levelCount];
+	for (int level = 0; level < levelCount; level++)
+	{
+		completedBands[level].store(0);
+	}
+	for (int band = 0; band < bandCount; band++)
+	{
+		progress[band].store(0);
+	}
+	itemCount = (bandCount + levelCount - 1) * levelCount;
+#pragma omp parallel
+	{
+		int item = nextItem.fetch_add(1);
+		while (item < itemCount)
 		{
-			if (i%matrixSize == 0)
-			{
-				startIndex = half;
-				endSquare = last;
-			}
-			else
-			{
-				startIndex = 0;
-				endSquare = this->size;
-			}
-			for (j = startIndex; j < endSquare; j += matrixSize)
+			/*The item-th (level, band) pair of the wavefront: at each
+			step t the band t - k is computed at level k, levels in
+			increasing order*/
+			int step = item / levelCount;
+			int level = item % levelCount;
+			int band = step - level;
+			if (band >= 0 && band < bandCount)
 			{
-				this->SquareStep(i, j, half, maxValue);
+				int firstRow = band * matrixSize;
+				int endRow = band == bandCount - 1 ?
+					this->size : firstRow + matrixSize;
+				int below = band + 1 < bandCount ? band + 1 : band;
+				int above = band > 0 ? band - 1 : band;
+				WaitProgress(&progress[band], 2 * level);
+				WaitProgress(&progress[below], 2 * level);
+				this->DiamondRows(matrixSize >> level, maxValue >> level,
+					firstRow, endRow);
+				progress[band].store(2 * level + 1, std::memory_order_release);
+				WaitProgress(&progress[above], 2 * level + 1);
+				this->SquareRows(matrixSize >> level, maxValue >> level,
+					firstRow, endRow);
+				progress[band].store(2 * level + 2, std::memory_order_release);
+				if (completedBands[level].fetch_add(1) + 1 == bandCount)
+				{
+					this->EmitPreview((matrixSize >> level) / 2);
+				}
 			}
+			item = nextItem.fetch_add(1);
+		}
+	}
+	delete[] progress;
+	delete[] completedBands;
+}
+
+/*	PRIVATE
+*	It waits until a band has completed the given number of steps
+*		progress: steps completed by the band
+*		value: steps that have to be completed
+*/
+void OpenMPDiamondSquare::WaitProgress(std::atomic<int>* progress, int value)
+{
+	while (progress->load(std::memory_order_acquire) < value)
+	{
+		std::this_thread::yield();
+	}
+}
+
+/*	PRIVATE
+*	It executes the diamond step of a level on the rows
+*	in [firstRow, endRow). The fine levels are computed a row
+*	at a time by DiamondRow
+*		matrixSize: size of the squares of the level
+*		maxValue: random seed to use
+*		firstRow: first row of the range, multiple of matrixSize
+*		endRow: row after the last one of the range
+*/
+void OpenMPDiamondSquare::DiamondRows(int matrixSize, int maxValue,
+	int firstRow, int endRow)
+{
+	int i, j;
+	int last = this->size - 1;
+	int half = matrixSize / 2;
+	for (i = firstRow + half; i < endRow && i < last; i += matrixSize)
+	{
+		if (matrixSize <= FINE_LEVEL_SIZE)
+		{
+			this->DiamondRow(i, half, maxValue);
+			continue;
+		}
+		for (j = half; j < last; j += matrixSize)
+		{
+			this->DiamondStep(i, j, half, maxValue);
+		}
+	}
+}
+
+/*	PRIVATE
+*	It executes the square step of a level on the rows
+*	in [firstRow, endRow). The fine levels are computed a row
+*	at a time by SquareRow
+*		matrixSize: size of the squares of the level
+*		maxValue: random seed to use
+*		firstRow: first row of the range, multiple of matrixSize
+*		endRow: row after the last one of the range
+*/
+void OpenMPDiamondSquare::SquareRows(int matrixSize, int maxValue,
+	int firstRow, int endRow)
+{
+	int i, j;
+	int startIndex, endSquare;
+	int last = this->size - 1;
+	int half = matrixSize / 2;
+	for (i = firstRow; i < endRow; i += half)
+	{
+		if (matrixSize <= FINE_LEVEL_SIZE)
+		{
+			this->SquareRow(i, half, maxValue);
+			continue;
+		}
+		if (i%matrixSize == 0)
+		{
+			startIndex = half;
+			endSquare = last;
+		}
+		else
+		{
+			startIndex = 0;
+			endSquare = this->size;
+		}
+		for (j = startIndex; j < endSquare; j += matrixSize)
+		{
+			this->SquareStep(i, j, half, maxValue);
 		}
-		this->DiamondSquare(half, maxValue / 2);
 	}
 }
 
@@ -101,9 +236,7 @@ void OpenMPDiamondSquare::DiamondSquare(int matrixSize, int maxValue)
 void OpenMPDiamondSquare::DiamondStep(int row, int column,
 	int adding, int maxValue)
 {
-	int max = maxValue / 2 > 1 ? maxValue / 2 : 1;
-	int min = -max;
-	int random = min + rand() % (max - min);
+	int random = this->RandomValue(row, column, maxValue);
 	int value = this->image[(row - adding)*this->size + (column - adding)] +
 		this->image[(row - adding)*this->size + column + adding] +
 		this->image[(row + adding) * this->size + (column - adding)] +
@@ -126,9 +259,7 @@ void OpenMPDiamondSquare::SquareStep(int row, int column,
 {
 	int value = 0;
 	int div = 0;
-	int max = maxValue / 2 > 1 ? maxValue / 2 : 1;
-	int min = -max;
-	int random = min + rand() % (max - min);
+	int random = this->RandomValue(row, column, maxValue);
 	if (row != 0)
 	{
 		value += this->image[(row - adding) * this->size + column];
@@ -153,4 +284,4 @@ void OpenMPDiamondSquare::SquareStep(int row, int column,
 	value /= div;
 
 	this->image[row* this->size + column] = value;
-}
\ No newline at end of file
+}
@@ -14,6 +14,7 @@ OpenMPMMorphology::OpenMPMMorphology(FImage* image, int size,
 	int threadNum) : MathematicalMorphology(image, size)
 {
 	omp_set_num_threads(threadNum);
+	this->threadNumber = threadNum;
 }
 
 /*
@@ -29,19 +30,35 @@ uint8* OpenMPMMorphology::ExecuteOpeningOrClosing(bool isOpening)
 	{
 		return NULL;
 	}
+	switch (this->SelectKernel())
+	{
+	case MK_Auto:
+		return this->ExecuteTunedOpeningOrClosing(isOpening);
+	case MK_Pipeline:
+		return this->ExecutePipelineOpeningOrClosing(isOpening);
+	default:
+		break;
+	}
 	dataSize = this->input->SizeX*this->input->SizeY*CHANNELS;
-	width = this->input->SizeX + structElem.width - 1;
+	width = this->pitch;
 	height = this->input->SizeY + structElem.height - 1;
 	output = (uint8*)malloc(sizeof(uint8)*dataSize);
-	redChannel = (uint8*)malloc(sizeof(uint8)*width*height);
-	greenChannel = (uint8*)malloc(sizeof(uint8)*width*height);
-	blueChannel = (uint8*)malloc(sizeof(uint8)*width*height);
-	outRed = (uint8*)malloc(sizeof(uint8)*width*height);
-	outGreen = (uint8*)malloc(sizeof(uint8)*width*height);
-	outBlue = (uint8*)malloc(sizeof(uint8)*width*height);
+	redChannel = (uint8*)ImagePlane::Allocate(sizeof(uint8)*width*height);
+	greenChannel = (uint8*)ImagePlane::Allocate(sizeof(uint8)*width*height);
+	blueChannel = (uint8*)ImagePlane::Allocate(sizeof(uint8)*width*height);
+	outRed = (uint8*)ImagePlane::Allocate(sizeof(uint8)*width*height);
+	outGreen = (uint8*)ImagePlane::Allocate(sizeof(uint8)*width*height);
+	outBlue = (uint8*)ImagePlane::Allocate(sizeof(uint8)*width*height);
 	if (!redChannel || !greenChannel || !blueChannel
 		|| !outRed || !outGreen || !outBlue || !output)
 	{
+		ImagePlane::Free(redChannel);
+		ImagePlane::Free(greenChannel);
+		ImagePlane::Free(blueChannel);
+		ImagePlane::Free(outRed);
+		ImagePlane::Free(outGreen);
+		ImagePlane::Free(outBlue);
+		free(output);
 		return NULL;
 	}
 #pragma omp parallel
@@ -152,9 +169,71 @@ uint8* OpenMPMMorphology::ExecuteOpeningOrClosing(bool isOpening)
 		}
 		this->ComposeImage(redChannel, greenChannel, blueChannel, output);
 	}
-	free(outRed);
-	free(outGreen);
-	free(outBlue);
+	ImagePlane::Free(redChannel);
+	ImagePlane::Free(greenChannel);
+	ImagePlane::Free(blueChannel);
+	ImagePlane::Free(outRed);
+	ImagePlane::Free(outGreen);
+	ImagePlane::Free(outBlue);
+	return output;
+}
+
+/*
+*	It executes the path opening or closing of the image.
+*	The channels and the cones are computed one at a time with the
+*	same buffers, whose passes over the channel are split among the
+*	threads; the result of each cone is merged as soon as it is
+*	computed, so only one cone result is kept
+*		isOpening: true if it has to execute opening
+*		length: minimum length of the paths in pixels
+*/
+uint8* OpenMPMMorphology::ExecutePathOpeningOrClosing(bool isOpening,
+	int length)
+{
+	int size, channel, cone, i;
+	uint8 *planes, *results, *coneResult, *output = NULL;
+	bool isCompleted = true;
+	if (!this->input)
+	{
+		return NULL;
+	}
+	size = this->input->SizeX * this->input->SizeY;
+	planes = (uint8*)malloc(sizeof(uint8) * 3 * size);
+	results = (uint8*)malloc(sizeof(uint8) * 3 * size);
+	coneResult = (uint8*)malloc(sizeof(uint8)*size);
+	PathOpening path(this->input->SizeX, this->input->SizeY, length,
+		this->threadNumber);
+	if (planes && results && coneResult)
+	{
+		this->SplitPlanes(planes, !isOpening);
+		for (channel = 0; channel < 3 && isCompleted; channel++)
+		{
+			uint8* result = results + channel * size;
+			for (cone = 0; cone < PATH_CONES && isCompleted; cone++)
+			{
+				// The first cone is written directly in the result
+				isCompleted = path.ExecutePathOpening(planes + channel * size,
+					cone == 0 ? result : coneResult, (PathCone)cone);
+				if (cone == 0 || !isCompleted)
+				{
+					continue;
+				}
+#pragma omp parallel for num_threads(this->threadNumber)
+				for (i = 0; i < size; i++)
+				{
+					result[i] = coneResult[i] > result[i] ?
+						coneResult[i] : result[i];
+				}
+			}
+		}
+		if (isCompleted)
+		{
+			output = this->ComposePlanes(results, !isOpening);
+		}
+	}
+	free(planes);
+	free(results);
+	free(coneResult);
 	return output;
 }
 
@@ -183,19 +262,19 @@ void OpenMPMMorphology::SplitChannels(uint8* redChannel,
 			if (i < firstRow || i >= lastRow
 				|| j < firstCol || j >= lastCol)
 			{
-				redChannel[i*width + j] = ghost;
-				greenChannel[i*width + j] = ghost;
-				blueChannel[i*width + j] = ghost;
+				redChannel[i*this->pitch + j] = ghost;
+				greenChannel[i*this->pitch + j] = ghost;
+				blueChannel[i*this->pitch + j] = ghost;
 			}
 			else
 			{
-				redChannel[i*width + j] =
+				redChannel[i*this->pitch + j] =
 					colors[(i - firstRow)*this->input->SizeX
 					+ j - firstCol].R;
-				greenChannel[i*width + j] =
+				greenChannel[i*this->pitch + j] =
 					colors[(i - firstRow)*this->input->SizeX
 					+ j - firstCol].G;
-				blueChannel[i*width + j] =
+				blueChannel[i*this->pitch + j] =
 					colors[(i - firstRow)*this->input->SizeX
 					+ j - firstCol].B;
 			}
@@ -225,16 +304,17 @@ void OpenMPMMorphology::FillGhostCells(uint8* red, uint8* green,
 			if (i < halfHeight || i >= height - halfHeight
 				|| j < halfWidth || j >= width - halfWidth)
 			{
-				red[i*width + j] = value;
-				green[i*width + j] = value;
-				blue[i*width + j] = value;
+				red[i*this->pitch + j] = value;
+				green[i*this->pitch + j] = value;
+				blue[i*this->pitch + j] = value;
 			}
 		}
 	}
 }
 
 /*
-*	It composes the image using channels
+*	It composes the image using channels. If the first mip
+*	is enabled it is computed in the same pass
 *		redChannel: red channel
 *		greenChannel: green channel
 *		blueChannel: blue channel
@@ -249,26 +329,36 @@ void OpenMPMMorphology::ComposeImage(uint8* redChannel,
 	int firstCol = (this->structElem.width - 1) / 2;
 	int lastRow = this->input->SizeY + firstRow;
 	int lastCol = this->input->SizeX + firstCol;
-	int width = this->input->SizeX + this->structElem.width - 1;
+	int width = this->pitch;
+	// Rows are split in pairs, so each mip row is computed by one thread
 #pragma omp for
-	for (int i = firstRow; i < lastRow; i++)
+	for (int pair = 0; pair < (this->input->SizeY + 1) / 2; pair++)
 	{
-		for (int k = firstCol; k < lastCol; k++)
+		for (int i = firstRow + 2 * pair;
+			i < firstRow + 2 * pair + 2 && i < lastRow; i++)
 		{
-			int index = (i - firstRow)*this->input->SizeX + k - firstCol;
-			int j = 0;
-			//blue channel
-			output[index*CHANNELS + j] = blueChannel[i*width + k];
-			j++;
-			//green channel
-			output[index*CHANNELS + j] = greenChannel[i*width + k];
-			j++;
-			//red channel
-			output[index*CHANNELS + j] = redChannel[i*width + k];
-			j++;
-			//alpha channel
-			output[index*CHANNELS + j] = ALPHA;
-			j++;
+			for (int k = firstCol; k < lastCol; k++)
+			{
+				int index = (i - firstRow)*this->input->SizeX + k - firstCol;
+				int j = 0;
+				//blue channel
+				output[index*CHANNELS + j] = blueChannel[i*width + k];
+				j++;
+				//green channel
+				output[index*CHANNELS + j] = greenChannel[i*width + k];
+				j++;
+				//red channel
+				output[index*CHANNELS + j] = redChannel[i*width + k];
+				j++;
+				//alpha channel
+				output[index*CHANNELS + j] = ALPHA;
+				j++;
+			}
+		}
+		if (this->firstMip && (2 * pair + 1 < this->input->SizeY
+			|| this->input->SizeY == 1))
+		{
+			this->DownsampleRows(output, pair);
 		}
 	}
 }
@@ -280,11 +370,30 @@ void OpenMPMMorphology::ComposeImage(uint8* redChannel,
 */
 void OpenMPMMorphology::ExecuteErosion(uint8* in, uint8* out)
 {
-	int width = this->input->SizeX + this->structElem.width - 1;
+	int width = this->pitch;
 	int firstRow = (this->structElem.height - 1) / 2;
 	int firstCol = (this->structElem.width - 1) / 2;
 	int rowSize = this->input->SizeY + firstRow;
 	int colSize = this->input->SizeX + firstCol;
+	if (this->paraboloidCurvature > 0)
+	{
+		this->ExecuteParaboloid(in, out, true);
+		return;
+	}
+	if (this->isNonFlat)
+	{
+#pragma omp for
+		for (int row = firstRow; row < rowSize; row++)
+		{
+			this->NonFlatErosionRow(in, out, row);
+		}
+		return;
+	}
+	if (this->isSeparable)
+	{
+		this->ExecuteSeparable(in, out, true);
+		return;
+	}
 #pragma omp for // only for version 2
 	for (int row = firstRow; row < rowSize; row++)
 	{
@@ -312,11 +421,30 @@ void OpenMPMMorphology::ExecuteErosion(uint8* in, uint8* out)
 */
 void OpenMPMMorphology::ExecuteDilation(uint8* in, uint8* out)
 {
-	int width = this->input->SizeX + this->structElem.width - 1;
+	int width = this->pitch;
 	int firstRow = (this->structElem.height - 1) / 2;
 	int firstCol = (this->structElem.width - 1) / 2;
 	int rowSize = this->input->SizeY + this->structElem.height / 2;
 	int colSize = this->input->SizeX + this->structElem.width / 2;
+	if (this->paraboloidCurvature > 0)
+	{
+		this->ExecuteParaboloid(in, out, false);
+		return;
+	}
+	if (this->isNonFlat)
+	{
+#pragma omp for
+		for (int row = firstRow; row < rowSize; row++)
+		{
+			this->NonFlatDilationRow(in, out, row);
+		}
+		return;
+	}
+	if (this->isSeparable)
+	{
+		this->ExecuteSeparable(in, out, false);
+		return;
+	}
 #pragma omp for // only for VERSION 2
 	for (int row = firstRow; row < rowSize; row++)
 	{
@@ -336,3 +464,38 @@ void OpenMPMMorphology::ExecuteDilation(uint8* in, uint8* out)
 		}
 	}
 }
+
+/*	PRIVATE
+*	It executes erosion or dilation with the paraboloid element
+*	as a column pass followed by a row pass.
+*	Each thread uses its own scratch buffers
+*		in: input channel
+*		out: output channel
+*		isErosion: true for erosion, false for dilation
+*/
+void OpenMPMMorphology::ExecuteParaboloid(uint8* in, uint8* out,
+	bool isErosion)
+{
+	int length = this->GetEnvelopeLength();
+	float* scratch = (float*)malloc(sizeof(float)*(3 * length + 1));
+	int* vertices = (int*)malloc(sizeof(int)*length);
+	// Every thread has to reach the worksharing loops
+#pragma omp for
+	for (int col = 0; col < this->input->SizeX; col++)
+	{
+		if (scratch && vertices)
+		{
+			this->ParaboloidColumn(in, col, isErosion, scratch, vertices);
+		}
+	}
+#pragma omp for
+	for (int row = 0; row < this->input->SizeY; row++)
+	{
+		if (scratch && vertices)
+		{
+			this->ParaboloidRow(out, row, isErosion, scratch, vertices);
+		}
+	}
+	free(scratch);
+	free(vertices);
+}
@@ -0,0 +1,451 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "OutOfCoreDiamondSquare.h"
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <windows.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+*	OutOfCoreDiamondSquare constructor.
+*	It chooses the tile size: the largest power of two such that the
+*	bands the wavefront keeps in memory (one per level plus the two
+*	neighbours) and the lattice buffer fit in the memory budget.
+*	If no tile size fits, it takes the one that uses less memory
+*		size: the length of the matrix row/column
+*		fileName: path of the output file
+*		memoryBudget: bytes of memory the algorithm can keep resident
+*/
+OutOfCoreDiamondSquare::OutOfCoreDiamondSquare(int size, FString fileName,
+	int64 memoryBudget)
+{
+	int last = size - 1;
+	int levels = 0;
+	int64 minBytes = -1;
+	this->size = size;
+	this->seed = (uint32)time(0);
+	this->fileName = fileName;
+	this->tileSize = 2;
+	for (int tile = 2; tile <= last; tile *= 2)
+	{
+		int64 latticeBytes = (int64)(last / tile + 1) * (last / tile + 1);
+		int64 bytes = (int64)(++levels + 2) * tile * size + latticeBytes;
+		if (bytes <= memoryBudget || minBytes < 0 ||
+			(minBytes > memoryBudget && bytes < minBytes))
+		{
+			this->tileSize = tile;
+			minBytes = bytes;
+		}
+	}
+	this->latticeSize = last / this->tileSize + 1;
+	this->lattice = NULL;
+	this->image = NULL;
+	this->imageSize = (int64)size * size;
+	this->fileHandle = NULL;
+	this->mappingHandle = NULL;
+}
+
+/*
+*	OutOfCoreDiamondSquare destructor.
+*	It unmaps the file and frees the lattice buffer
+*/
+OutOfCoreDiamondSquare::~OutOfCoreDiamondSquare()
+{
+	this->UnmapFile();
+	free(this->lattice);
+}
+
+/*
+*	It executes the diamond-square algorithm writing the
+*	matrix in the output file, row after row.
+*	It returns false if the file cannot be created
+*/
+bool OutOfCoreDiamondSquare::ExecuteDiamondSquare()
+{
+	int last = this->size - 1;
+	int bandCount, levelCount = 0;
+	int firstLevelSize, firstMaxValue = MAX;
+	if (this->size < 3)
+	{
+		return false;
+	}
+	// The lattice has the same size at every execution, so it is reused
+	if (!this->lattice)
+	{
+		this->lattice = (uint8*)malloc(sizeof(uint8)*
+			this->latticeSize*this->latticeSize);
+	}
+	if (!this->lattice || !this->MapFile())
+	{
+		return false;
+	}
+	// Coarse levels, on the lattice buffer
+	this->LatticeDiamondSquare();
+	for (firstLevelSize = last; firstLevelSize > this->tileSize;
+		firstLevelSize /= 2)
+	{
+		firstMaxValue /= 2;
+	}
+	for (int step = firstLevelSize; step > 1; step /= 2)
+	{
+		levelCount++;
+	}
+	// Fine levels, band by band in wavefront order
+	bandCount = last / this->tileSize;
+	this->CopyLatticeRow(0);
+	this->PrefetchBand(0);
+	for (int step = 0; step < bandCount + levelCount - 1; step++)
+	{
+		if (step < bandCount)
+		{
+			this->CopyLatticeRow((step + 1) * this->tileSize);
+			this->PrefetchBand(step + 1);
+		}
+		for (int level = 0; level < levelCount; level++)
+		{
+			int band = step - level;
+			int firstRow = band * this->tileSize;
+			int endRow = band == bandCount - 1 ?
+				this->size : firstRow + this->tileSize;
+			if (band < 0 || band >= bandCount)
+			{
+				continue;
+			}
+			this->DiamondRows(firstLevelSize >> level,
+				firstMaxValue >> level, firstRow, endRow);
+			this->SquareRows(firstLevelSize >> level,
+				firstMaxValue >> level, firstRow, endRow);
+		}
+		/*The band completed levelCount steps ago is no longer read
+		by the square step of the band below*/
+		this->ReleaseBand(step - levelCount);
+	}
+	this->UnmapFile();
+	return true;
+}
+
+/*	PRIVATE
+*	It executes the levels with a step larger than the tile size on
+*	the lattice buffer. The cell (i, j) of the buffer is the cell
+*	(i*tileSize, j*tileSize) of the matrix, and random values use the
+*	matrix indices, so the result is the one of the full matrix
+*/
+void OutOfCoreDiamondSquare::LatticeDiamondSquare()
+{
+	int n = this->latticeSize;
+	int last = n - 1;
+	int64 tile = this->tileSize;
+	int64 fullLast = this->size - 1;
+	uint8* l = this->lattice;
+	int maxValue = MAX;
+	l[0] = DiamondSquareHash(this->seed, 0) % MAX;
+	l[last] = DiamondSquareHash(this->seed, fullLast) % MAX;
+	l[last * n] = DiamondSquareHash(this->seed, fullLast * this->size) % MAX;
+	l[last * n + last] = DiamondSquareHash(this->seed,
+		fullLast * this->size + fullLast) % MAX;
+	for (int matrixSize = last; matrixSize > 1; matrixSize /= 2)
+	{
+		int half = matrixSize / 2;
+		for (int i = half; i < last; i += matrixSize)
+		{
+			for (int j = half; j < last; j += matrixSize)
+			{
+				int value = l[(i - half)*n + j - half] +
+					l[(i - half)*n + j + half] +
+					l[(i + half)*n + j - half] +
+					l[(i + half)*n + j + half];
+				value += this->RandomValue(i * tile, j * tile, maxValue);
+				value /= 4;
+				l[i*n + j] = value;
+			}
+		}
+		for (int i = 0; i < n; i += half)
+		{
+			int startIndex = i % matrixSize == 0 ? half : 0;
+			int endSquare = i % matrixSize == 0 ? last : n;
+			for (int j = startIndex; j < endSquare; j += matrixSize)
+			{
+				int value = 0;
+				int div = 0;
+				if (i != 0)
+				{
+					value += l[(i - half)*n + j];
+					div++;
+				}
+				if (i != last)
+				{
+					value += l[(i + half)*n + j];
+					div++;
+				}
+				if (j != 0)
+				{
+					value += l[i*n + j - half];
+					div++;
+				}
+				if (j != last)
+				{
+					value += l[i*n + j + half];
+					div++;
+				}
+				value += this->RandomValue(i * tile, j * tile, maxValue);
+				value /= div;
+				l[i*n + j] = value;
+			}
+		}
+		maxValue /= 2;
+	}
+}
+
+/*	PRIVATE
+*	It copies the lattice cells of a row in the mapped file
+*		row: row of the matrix, multiple of tileSize
+*/
+void OutOfCoreDiamondSquare::CopyLatticeRow(int row)
+{
+	uint8* out = this->image + (int64)row * this->size;
+	const uint8* in = this->lattice +
+		(int64)(row / this->tileSize) * this->latticeSize;
+	for (int j = 0; j < this->latticeSize; j++)
+	{
+		out[(int64)j * this->tileSize] = in[j];
+	}
+}
+
+/*	PRIVATE
+*	It executes the diamond step of a level on the rows
+*	in [firstRow, endRow)
+*		matrixSize: size of the squares of the level
+*		maxValue: random seed to use
+*		firstRow: first row of the range, multiple of matrixSize
+*		endRow: row after the last one of the range
+*/
+void OutOfCoreDiamondSquare::DiamondRows(int matrixSize, int maxValue,
+	int firstRow, int endRow)
+{
+	int last = this->size - 1;
+	int half = matrixSize / 2;
+	for (int i = firstRow + half; i < endRow && i < last; i += matrixSize)
+	{
+		const uint8* up = this->image + (int64)(i - half) * this->size;
+		const uint8* down = this->image + (int64)(i + half) * this->size;
+		uint8* out = this->image + (int64)i * this->size;
+		for (int j = half; j < last; j += matrixSize)
+		{
+			int value = up[j - half] + up[j + half] +
+				down[j - half] + down[j + half];
+			value += this->RandomValue(i, j, maxValue);
+			value /= 4;
+			out[j] = value;
+		}
+	}
+}
+
+/*	PRIVATE
+*	It executes the square step of a level on the rows
+*	in [firstRow, endRow)
+*		matrixSize: size of the squares of the level
+*		maxValue: random seed to use
+*		firstRow: first row of the range, multiple of matrixSize
+*		endRow: row after the last one of the range
+*/
+void OutOfCoreDiamondSquare::SquareRows(int matrixSize, int maxValue,
+	int firstRow, int endRow)
+{
+	int last = this->size - 1;
+	int half = matrixSize / 2;
+	for (int i = firstRow; i < endRow; i += half)
+	{
+		uint8* out = this->image + (int64)i * this->size;
+		int startIndex = i % matrixSize == 0 ? half : 0;
+		int endSquare = i % matrixSize == 0 ? last : this->size;
+		for (int j = startIndex; j < endSquare; j += matrixSize)
+		{
+			int value = 0;
+			int div = 0;
+			if (i != 0)
+			{
+				value += out[j - (int64)half * this->size];
+				div++;
+			}
+			if (i != last)
+			{
+				value += out[j + (int64)half * this->size];
+				div++;
+			}
+			if (j != 0)
+			{
+				value += out[j - half];
+				div++;
+			}
+			if (j != last)
+			{
+				value += out[j + half];
+				div++;
+			}
+			value += this->RandomValue(i, j, maxValue);
+			value /= div;
+			out[j] = value;
+		}
+	}
+}
+
+/*	PRIVATE
+*	It returns the random displacement of a cell
+*	in the range [-maxValue/2, maxValue/2)
+*		row: row index
+*		column: column index
+*		maxValue: random seed
+*/
+int OutOfCoreDiamondSquare::RandomValue(int64 row, int64 column,
+	int maxValue) const
+{
+	int max = maxValue / 2 > 1 ? maxValue / 2 : 1;
+	int min = -max;
+	uint32 hash = DiamondSquareHash(this->seed,
+		(uint64)row * (uint64)this->size + (uint64)column);
+	return min + (int)(hash % (uint32)(max - min));
+}
+
+/*	PRIVATE
+*	It creates the output file with the size of the matrix and maps it.
+*	The access pattern is declared sequential
+*/
+bool OutOfCoreDiamondSquare::MapFile()
+{
+#if PLATFORM_WINDOWS
+	SYSTEM_INFO info;
+	HANDLE file = CreateFileW(*this->fileName, GENERIC_READ | GENERIC_WRITE,
+		0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	HANDLE mapping;
+	GetSystemInfo(&info);
+	this->pageSize = info.dwPageSize;
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	this->fileHandle = file;
+	mapping = CreateFileMappingW(file, NULL, PAGE_READWRITE,
+		(DWORD)(this->imageSize >> 32), (DWORD)this->imageSize, NULL);
+	if (!mapping)
+	{
+		return false;
+	}
+	this->mappingHandle = mapping;
+	this->image = (uint8*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS,
+		0, 0, this->imageSize);
+	return this->image != NULL;
+#else
+	void* address;
+	int file = open(TCHAR_TO_UTF8(*this->fileName),
+		O_RDWR | O_CREAT | O_TRUNC, 0644);
+	this->pageSize = sysconf(_SC_PAGESIZE);
+	if (file < 0)
+	{
+		return false;
+	}
+	this->fileHandle = (void*)(intptr_t)(file + 1);
+	if (ftruncate(file, this->imageSize) != 0)
+	{
+		return false;
+	}
+	address = mmap(NULL, this->imageSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED, file, 0);
+	if (address == MAP_FAILED)
+	{
+		return false;
+	}
+	this->image = (uint8*)address;
+	madvise(this->image, this->imageSize, MADV_SEQUENTIAL);
+	return true;
+#endif
+}
+
+/*	PRIVATE
+*	It writes the mapped pages to the file and closes it
+*/
+void OutOfCoreDiamondSquare::UnmapFile()
+{
+#if PLATFORM_WINDOWS
+	if (this->image)
+	{
+		FlushViewOfFile(this->image, 0);
+		UnmapViewOfFile(this->image);
+	}
+	if (this->mappingHandle)
+	{
+		CloseHandle((HANDLE)this->mappingHandle);
+	}
+	if (this->fileHandle)
+	{
+		CloseHandle((HANDLE)this->fileHandle);
+	}
+#else
+	if (this->image)
+	{
+		msync(this->image, this->imageSize, MS_SYNC);
+		munmap(this->image, this->imageSize);
+	}
+	if (this->fileHandle)
+	{
+		close((int)(intptr_t)this->fileHandle - 1);
+	}
+#endif
+	this->image = NULL;
+	this->mappingHandle = NULL;
+	this->fileHandle = NULL;
+}
+
+/*	PRIVATE
+*	It tells the system that a band will be used soon
+*		band: index of the band
+*/
+void OutOfCoreDiamondSquare::PrefetchBand(int band)
+{
+	int64 first = (int64)band * this->tileSize * this->size;
+	int64 end = first + (int64)(this->tileSize + 1) * this->size;
+	if (first >= this->imageSize)
+	{
+		return;
+	}
+	end = end < this->imageSize ? end : this->imageSize;
+	first -= first % this->pageSize;
+#if !PLATFORM_WINDOWS
+	madvise(this->image + first, end - first, MADV_WILLNEED);
+#endif
+}
+
+/*	PRIVATE
+*	It starts writing a completed band to the file and removes its
+*	pages from the process memory. Only the pages that are fully
+*	inside the band are released
+*		band: index of the band
+*/
+void OutOfCoreDiamondSquare::ReleaseBand(int band)
+{
+	int64 first = (int64)band * this->tileSize * this->size;
+	int64 end = first + (int64)this->tileSize * this->size;
+	if (band < 0)
+	{
+		return;
+	}
+	first += (this->pageSize - first % this->pageSize) % this->pageSize;
+	end -= end % this->pageSize;
+	if (end <= first)
+	{
+		return;
+	}
+#if PLATFORM_WINDOWS
+	FlushViewOfFile(this->image + first, end - first);
+	// Unlocking pages that are not locked removes them from the working set
+	VirtualUnlock(this->image + first, end - first);
+#else
+	msync(this->image + first, end - first, MS_ASYNC);
+	madvise(this->image + first, end - first, MADV_DONTNEED);
+#endif
+}
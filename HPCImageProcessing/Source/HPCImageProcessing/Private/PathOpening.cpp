@@ -0,0 +1,383 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PathOpening.h"
+
+/*
+*	PathOpening constructor.
+*	It allocates the buffers used for a channel
+*		width: width of the channel
+*		height: height of the channel
+*		length: minimum length of the paths in pixels
+*		threadNumber: number of threads of the passes over the channel
+*/
+PathOpening::PathOpening(int width, int height, int length, int threadNumber)
+{
+	int size = width * height;
+	this->width = width;
+	this->height = height;
+	this->length = length > 1 ? length : 1;
+	this->threadNumber = threadNumber > 1 ? threadNumber : 1;
+	this->rankCount = width + height;
+	this->forwardLengths = (int*)malloc(sizeof(int)*size);
+	this->backwardLengths = (int*)malloc(sizeof(int)*size);
+	this->isActive = (uint8*)malloc(sizeof(uint8)*size);
+	this->isDone = (uint8*)malloc(sizeof(uint8)*size);
+	this->isQueued = (uint8*)malloc(sizeof(uint8)*size);
+	this->pixelOrder = (int*)malloc(sizeof(int)*size);
+	this->next = (int*)malloc(sizeof(int)*size);
+	this->heads = (int*)malloc(sizeof(int)*this->rankCount);
+	this->SetCone(PC_NorthSouth);
+}
+
+/*
+*	PathOpening destructor.
+*	It frees the buffers
+*/
+PathOpening::~PathOpening()
+{
+	free(this->forwardLengths);
+	free(this->backwardLengths);
+	free(this->isActive);
+	free(this->isDone);
+	free(this->isQueued);
+	free(this->pixelOrder);
+	free(this->next);
+	free(this->heads);
+}
+
+/*
+*	It computes the path opening of a channel in a cone.
+*	It returns false if the buffers could not be allocated
+*		channel: input channel of width x height pixels
+*		result: output channel of width x height pixels
+*		cone: directions of the paths
+*/
+bool PathOpening::ExecutePathOpening(const uint8* channel, uint8* result,
+	PathCone cone)
+{
+	int size = this->width * this->height;
+	int count[PATH_LEVELS] = { 0 };
+	int i, level;
+	if (!this->forwardLengths || !this->backwardLengths || !this->isActive
+		|| !this->isDone || !this->isQueued || !this->pixelOrder
+		|| !this->next || !this->heads)
+	{
+		return false;
+	}
+	this->SetCone(cone);
+	// Counting sort of the pixels by value
+	for (i = 0; i < size; i++)
+	{
+		count[channel[i]]++;
+	}
+	this->levelStart[0] = 0;
+	for (level = 0; level < PATH_LEVELS; level++)
+	{
+		this->levelStart[level + 1] = this->levelStart[level] + count[level];
+		count[level] = this->levelStart[level];
+	}
+	for (i = 0; i < size; i++)
+	{
+		this->pixelOrder[count[channel[i]]++] = i;
+	}
+	for (i = 0; i < this->rankCount; i++)
+	{
+		this->heads[i] = -1;
+	}
+	this->firstRank = this->rankCount;
+	this->lastRank = -1;
+#pragma omp parallel for num_threads(this->threadNumber)
+	for (i = 0; i < size; i++)
+	{
+		this->forwardLengths[i] = 0;
+		this->backwardLengths[i] = 0;
+		this->isActive[i] = 1;
+		this->isDone[i] = 0;
+		this->isQueued[i] = 0;
+		result[i] = 0;
+	}
+	// Lengths of the whole image, every pixel is visited once
+	this->ComputeLengths(false);
+	this->ComputeLengths(true);
+#pragma omp parallel for num_threads(this->threadNumber)
+	for (i = 0; i < size; i++)
+	{
+		this->UpdateResult(i, result, 0);
+	}
+	// Pixels of each level are removed and the lengths are updated
+	for (level = 0; level < PATH_LEVELS; level++)
+	{
+		for (i = this->levelStart[level]; i < this->levelStart[level + 1]; i++)
+		{
+			int pixel = this->pixelOrder[i];
+			this->isActive[pixel] = 0;
+			this->forwardLengths[pixel] = 0;
+			this->backwardLengths[pixel] = 0;
+			if (!this->isDone[pixel])
+			{
+				result[pixel] = level;
+				this->isDone[pixel] = 1;
+			}
+			this->EnqueueNeighbours(pixel, true);
+		}
+		this->Propagate(false, result, level);
+		for (i = this->levelStart[level]; i < this->levelStart[level + 1]; i++)
+		{
+			this->EnqueueNeighbours(this->pixelOrder[i], false);
+		}
+		this->Propagate(true, result, level);
+	}
+	return true;
+}
+
+/*	PRIVATE
+*	It sets the steps of the paths of a cone. Each cone
+*	has three steps: a main direction and its two diagonals
+*		cone: directions of the paths
+*/
+void PathOpening::SetCone(PathCone cone)
+{
+	int rowSteps[PATH_CONES][3] = {
+		{ 1, 1, 1 }, { -1, 0, 1 }, { -1, -1, 0 }, { 1, 1, 0 } };
+	int colSteps[PATH_CONES][3] = {
+		{ -1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 }, { 0, 1, 1 } };
+	this->cone = cone;
+	for (int i = 0; i < 3; i++)
+	{
+		this->rowSteps[i] = rowSteps[cone][i];
+		this->colSteps[i] = colSteps[cone][i];
+	}
+}
+
+/*	PRIVATE
+*	It returns the rank of a pixel in the cone: every step
+*	of a path goes to a pixel with a higher rank
+*		pixel: index of the pixel
+*/
+int PathOpening::GetRank(int pixel) const
+{
+	int row = pixel / this->width;
+	int col = pixel % this->width;
+	switch (this->cone)
+	{
+	case PC_NorthSouth:
+		return row;
+	case PC_EastWest:
+		return col;
+	case PC_NorthEastSouthWest:
+		return col - row + this->height - 1;
+	default:
+		return row + col;
+	}
+}
+
+/*	PRIVATE
+*	It returns a pixel of the line of a rank and false if the line
+*	has no pixel at that index. The lines of the north-south cone are
+*	rows and are indexed by column, the other ones by row
+*		rank: rank of the line
+*		index: column or row of the pixel
+*		pixel: index of the pixel
+*/
+bool PathOpening::GetLinePixel(int rank, int index, int* pixel) const
+{
+	int row = index;
+	int col;
+	switch (this->cone)
+	{
+	case PC_NorthSouth:
+		row = rank;
+		col = index;
+		break;
+	case PC_EastWest:
+		col = rank;
+		break;
+	case PC_NorthEastSouthWest:
+		col = rank + index - this->height + 1;
+		break;
+	default:
+		col = rank - index;
+		break;
+	}
+	if (row < 0 || row >= this->height || col < 0 || col >= this->width)
+	{
+		return false;
+	}
+	*pixel = row * this->width + col;
+	return true;
+}
+
+/*	PRIVATE
+*	It computes the lengths of all the pixels, visiting the lines of
+*	the ranks in the order of the cone. The steps of the paths go to
+*	a higher rank, so the pixels of a line are split among the threads
+*	and the lines are separated by the barrier of the loop
+*		forward: true to compute the forward lengths
+*/
+void PathOpening::ComputeLengths(bool forward)
+{
+	int* lengths = forward ? this->forwardLengths : this->backwardLengths;
+	int lineLength = this->cone == PC_NorthSouth ? this->width : this->height;
+	int lineCount = this->cone == PC_NorthSouth ? this->height :
+		this->cone == PC_EastWest ? this->width : this->width + this->height - 1;
+#pragma omp parallel num_threads(this->threadNumber)
+	for (int line = 0; line < lineCount; line++)
+	{
+		int rank = forward ? lineCount - 1 - line : line;
+		int index, pixel;
+#pragma omp for
+		for (index = 0; index < lineLength; index++)
+		{
+			if (this->GetLinePixel(rank, index, &pixel))
+			{
+				lengths[pixel] = this->ComputeLength(pixel, forward);
+			}
+		}
+	}
+}
+
+/*	PRIVATE
+*	It returns the neighbour of a pixel along a step of the cone
+*	and false if it is outside of the channel
+*		pixel: index of the pixel
+*		step: index of the step
+*		forward: true for the next pixel of the path,
+*			false for the previous one
+*		neighbour: index of the neighbour
+*/
+bool PathOpening::GetNeighbour(int pixel, int step, bool forward,
+	int* neighbour) const
+{
+	int row = pixel / this->width;
+	int col = pixel % this->width;
+	row += forward ? this->rowSteps[step] : -this->rowSteps[step];
+	col += forward ? this->colSteps[step] : -this->colSteps[step];
+	if (row < 0 || row >= this->height || col < 0 || col >= this->width)
+	{
+		return false;
+	}
+	*neighbour = row * this->width + col;
+	return true;
+}
+
+/*	PRIVATE
+*	It returns the length of the longest path that starts (forward)
+*	or ends (backward) in a pixel, truncated to the path length
+*		pixel: index of the pixel
+*		forward: true for the paths that start in the pixel
+*/
+int PathOpening::ComputeLength(int pixel, bool forward) const
+{
+	const int* lengths = forward ?
+		this->forwardLengths : this->backwardLengths;
+	int maxLength = 0;
+	int neighbour;
+	if (!this->isActive[pixel])
+	{
+		return 0;
+	}
+	for (int step = 0; step < 3; step++)
+	{
+		if (this->GetNeighbour(pixel, step, forward, &neighbour)
+			&& lengths[neighbour] > maxLength)
+		{
+			maxLength = lengths[neighbour];
+		}
+	}
+	return maxLength + 1 < this->length ? maxLength + 1 : this->length;
+}
+
+/*	PRIVATE
+*	It adds to the queue the pixels whose length depends on the
+*	length of a pixel: the next pixels of the paths for backward
+*	lengths, the previous ones for forward lengths
+*		pixel: index of the pixel
+*		forward: true if the pixels that follow it have to be added
+*/
+void PathOpening::EnqueueNeighbours(int pixel, bool forward)
+{
+	int neighbour;
+	for (int step = 0; step < 3; step++)
+	{
+		if (this->GetNeighbour(pixel, step, forward, &neighbour))
+		{
+			this->Enqueue(neighbour);
+		}
+	}
+}
+
+/*	PRIVATE
+*	It adds a pixel to the list of its rank if it is not queued
+*		pixel: index of the pixel
+*/
+void PathOpening::Enqueue(int pixel)
+{
+	int rank;
+	if (this->isQueued[pixel])
+	{
+		return;
+	}
+	rank = this->GetRank(pixel);
+	this->isQueued[pixel] = 1;
+	this->next[pixel] = this->heads[rank];
+	this->heads[rank] = pixel;
+	this->firstRank = rank < this->firstRank ? rank : this->firstRank;
+	this->lastRank = rank > this->lastRank ? rank : this->lastRank;
+}
+
+/*	PRIVATE
+*	It updates the lengths of the queued pixels. Backward lengths
+*	are updated from the lowest rank, forward lengths from the highest
+*	one, so each pixel is computed after the pixels it depends on
+*		forward: true to update the forward lengths
+*		result: output channel, NULL to skip the results
+*		level: current level
+*/
+void PathOpening::Propagate(bool forward, uint8* result, int level)
+{
+	int* lengths = forward ? this->forwardLengths : this->backwardLengths;
+	int rank = forward ? this->lastRank : this->firstRank;
+	while (forward ? rank >= this->firstRank : rank <= this->lastRank)
+	{
+		int pixel = this->heads[rank];
+		this->heads[rank] = -1;
+		while (pixel != -1)
+		{
+			int nextPixel = this->next[pixel];
+			int newLength = this->ComputeLength(pixel, forward);
+			this->isQueued[pixel] = 0;
+			if (newLength != lengths[pixel])
+			{
+				lengths[pixel] = newLength;
+				this->EnqueueNeighbours(pixel, !forward);
+				if (result)
+				{
+					this->UpdateResult(pixel, result, level);
+				}
+			}
+			pixel = nextPixel;
+		}
+		rank += forward ? -1 : 1;
+	}
+	this->firstRank = this->rankCount;
+	this->lastRank = -1;
+}
+
+/*	PRIVATE
+*	It sets the result of a pixel that is no longer on a path of
+*	the required length. Lengths only decrease, so the check is
+*	right even if the lengths of the other direction are not updated
+*		pixel: index of the pixel
+*		result: output channel
+*		level: current level
+*/
+void PathOpening::UpdateResult(int pixel, uint8* result, int level)
+{
+	if (!this->isDone[pixel] && this->forwardLengths[pixel] +
+		this->backwardLengths[pixel] - 1 < this->length)
+	{
+		result[pixel] = level;
+		this->isDone[pixel] = 1;
+	}
+}
@@ -0,0 +1,916 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ProcessingDaemon.h"
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <winsock2.h>
+#include <afunix.h>
+#include <windows.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+#elif PLATFORM_LINUX || PLATFORM_MAC
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+// Platforms that have the socket and the shared memory
+#define DAEMON_SUPPORTED (PLATFORM_WINDOWS || PLATFORM_LINUX || PLATFORM_MAC)
+#if PLATFORM_WINDOWS
+#define poll WSAPoll
+// True if the last call failed only because it would have blocked
+#define DAEMON_IS_WAITING() (WSAGetLastError() == WSAEWOULDBLOCK \
+	|| WSAGetLastError() == WSAEINTR)
+#define DAEMON_REMOVE_SOCKET(path) DeleteFileA(path)
+#else
+#define DAEMON_IS_WAITING() (errno == EAGAIN || errno == EWOULDBLOCK \
+	|| errno == EINTR)
+#define DAEMON_REMOVE_SOCKET(path) unlink(path)
+#endif
+
+/*
+*	ProcessingDaemon constructor.
+*		socketPath: file of the Unix domain socket
+*		workerCount: number of jobs executed at the same time
+*		queueCapacity: number of jobs that can wait for a worker
+*		cacheBudget: bytes of results kept in memory, 0 to disable
+*/
+ProcessingDaemon::ProcessingDaemon(FString socketPath, int workerCount,
+	int queueCapacity, int64 cacheBudget)
+	: isRunning(false)
+{
+	this->socketPath = socketPath;
+	this->workerCount = workerCount > 0 ? workerCount : 1;
+	this->queueCapacity = queueCapacity > 0 ? queueCapacity : 1;
+	this->listener = DAEMON_NO_SOCKET;
+	this->jobEvent = NULL;
+	this->results = cacheBudget > 0 ?
+		new ResultCache(cacheBudget, FString()) : NULL;
+	this->statistics = DaemonStatistics();
+	this->totalQueueTime = 0;
+	this->totalLatency = 0;
+}
+
+/*
+*	ProcessingDaemon destructor.
+*	It stops the daemon and frees the results
+*/
+ProcessingDaemon::~ProcessingDaemon()
+{
+	this->Stop();
+	delete this->results;
+}
+
+/*
+*	It creates the socket and starts the thread that accepts the
+*	clients and the workers.
+*	It returns false if the daemon is running or the socket cannot
+*	be created
+*/
+bool ProcessingDaemon::Start()
+{
+#if DAEMON_SUPPORTED
+	sockaddr_un address;
+	FTCHARToUTF8 path(*this->socketPath);
+	if (this->isRunning || path.Length() >= (int)sizeof(address.sun_path))
+	{
+		return false;
+	}
+#if PLATFORM_WINDOWS
+	WSADATA version;
+	if (WSAStartup(MAKEWORD(2, 2), &version) != 0)
+	{
+		return false;
+	}
+#endif
+	FMemory::Memzero(&address, sizeof(address));
+	address.sun_family = AF_UNIX;
+	FMemory::Memcpy(address.sun_path, path.Get(), path.Length());
+	this->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	// A socket left by a previous daemon would make bind fail
+	DAEMON_REMOVE_SOCKET(path.Get());
+	if (this->listener == DAEMON_NO_SOCKET
+		|| bind(this->listener, (sockaddr*)&address, sizeof(address)) != 0
+		|| listen(this->listener, this->queueCapacity) != 0)
+	{
+		if (this->listener != DAEMON_NO_SOCKET)
+		{
+			ProcessingDaemon::CloseClient(this->listener);
+		}
+		this->listener = DAEMON_NO_SOCKET;
+#if PLATFORM_WINDOWS
+		WSACleanup();
+#endif
+		return false;
+	}
+	// The workers find the image module without loading it
+	FModuleManager::LoadModuleChecked<IImageWrapperModule>(
+		FName("ImageWrapper"));
+	this->jobEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	this->isRunning = true;
+	this->threads.Add(Async<void>(EAsyncExecution::Thread, [this]()
+	{
+		this->AcceptClients();
+	}));
+	for (int i = 0; i < this->workerCount; i++)
+	{
+		this->threads.Add(Async<void>(EAsyncExecution::Thread, [this]()
+		{
+			this->RunWorker();
+		}));
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+*	It stops the daemon: it waits for the running jobs, refuses the
+*	queued ones and removes the socket
+*/
+void ProcessingDaemon::Stop()
+{
+	if (!this->isRunning.exchange(false))
+	{
+		return;
+	}
+	this->jobEvent->Trigger();
+	for (int i = 0; i < this->threads.Num(); i++)
+	{
+		this->threads[i].Wait();
+	}
+	this->threads.Empty();
+	FPlatformProcess::ReturnSynchEventToPool(this->jobEvent);
+	this->jobEvent = NULL;
+	for (int i = 0; i < this->queue.Num(); i++)
+	{
+		ProcessingDaemon::Reply(this->queue[i].client, TEXT("error stopped"));
+		ProcessingDaemon::CloseClient(this->queue[i].client);
+	}
+	this->queue.Empty();
+#if DAEMON_SUPPORTED
+	ProcessingDaemon::CloseClient(this->listener);
+	this->listener = DAEMON_NO_SOCKET;
+	DAEMON_REMOVE_SOCKET(TCHAR_TO_UTF8(*this->socketPath));
+#if PLATFORM_WINDOWS
+	WSACleanup();
+#endif
+#endif
+}
+
+/*
+*	It returns the counters of the daemon and the average times
+*	of the completed and failed jobs
+*/
+DaemonStatistics ProcessingDaemon::GetStatistics()
+{
+	FScopeLock lock(&this->queueLock);
+	DaemonStatistics current = this->statistics;
+	int finished = current.completedJobs + current.failedJobs;
+	current.queueDepth = this->queue.Num();
+	current.averageQueueTime = finished > 0 ?
+		this->totalQueueTime / finished : 0;
+	current.averageLatency = finished > 0 ?
+		this->totalLatency / finished : 0;
+	return current;
+}
+
+/*	PRIVATE
+*	It accepts the clients and reads their requests until the daemon
+*	is stopped. The sockets are polled together and read without
+*	blocking, and a client that does not send its whole request
+*	within DAEMON_READ_TIMEOUT seconds is closed
+*/
+void ProcessingDaemon::AcceptClients()
+{
+#if DAEMON_SUPPORTED
+	TArray<DaemonClient> clients;
+	TArray<pollfd> sockets;
+	double now;
+	DaemonSocket client;
+	int i;
+	bool isComplete;
+	ProcessingDaemon::SetNonBlocking(this->listener);
+	while (this->isRunning)
+	{
+		// The listener is the first socket, the clients follow in order
+		sockets.SetNum(clients.Num() + 1);
+		sockets[0].fd = this->listener;
+		sockets[0].events = POLLIN;
+		sockets[0].revents = 0;
+		for (i = 0; i < clients.Num(); i++)
+		{
+			sockets[i + 1].fd = clients[i].socket;
+			sockets[i + 1].events = POLLIN;
+			sockets[i + 1].revents = 0;
+		}
+		// The wait is short, so the thread sees when the daemon stops
+		poll(sockets.GetData(), sockets.Num(), DAEMON_WAIT_TIME);
+		now = omp_get_wtime();
+		for (i = clients.Num() - 1; i >= 0; i--)
+		{
+			if (sockets[i + 1].revents != 0)
+			{
+				if (!ProcessingDaemon::ReadLine(clients[i], isComplete))
+				{
+					ProcessingDaemon::CloseClient(clients[i].socket);
+					clients.RemoveAt(i);
+				}
+				else if (isComplete)
+				{
+					this->HandleRequest(clients[i].socket,
+						FString(UTF8_TO_TCHAR(clients[i].line)));
+					clients.RemoveAt(i);
+				}
+				continue;
+			}
+			if (now > clients[i].deadline)
+			{
+				ProcessingDaemon::CloseClient(clients[i].socket);
+				clients.RemoveAt(i);
+			}
+		}
+		if (!(sockets[0].revents & POLLIN))
+		{
+			continue;
+		}
+		client = accept(this->listener, NULL, NULL);
+		if (client == DAEMON_NO_SOCKET)
+		{
+			continue;
+		}
+#ifdef SO_NOSIGPIPE
+		int enable = 1;
+		setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+#endif
+		if (clients.Num() >= DAEMON_MAX_CLIENTS)
+		{
+			ProcessingDaemon::Reply(client, FString::Printf(TEXT("busy %d"),
+				clients.Num()));
+			ProcessingDaemon::CloseClient(client);
+			continue;
+		}
+		ProcessingDaemon::SetNonBlocking(client);
+		clients.AddDefaulted();
+		clients.Last().socket = client;
+		clients.Last().length = 0;
+		clients.Last().deadline = now + DAEMON_READ_TIMEOUT;
+	}
+	for (i = 0; i < clients.Num(); i++)
+	{
+		ProcessingDaemon::CloseClient(clients[i].socket);
+	}
+#endif
+}
+
+/*	PRIVATE
+*	It answers a request that is not a job or queues the job,
+*	refusing it if the queue is full
+*		client: socket of the client
+*		line: the request
+*/
+void ProcessingDaemon::HandleRequest(DaemonSocket client, FString line)
+{
+	DaemonJob job;
+	int depth;
+	bool isQueued;
+	if (line.TrimStartAndEnd() == TEXT("stats"))
+	{
+		ProcessingDaemon::Reply(client, this->GetStatisticsLine());
+		ProcessingDaemon::CloseClient(client);
+		return;
+	}
+	if (!this->ParseJob(line, job))
+	{
+		ProcessingDaemon::Reply(client, TEXT("error request"));
+		ProcessingDaemon::CloseClient(client);
+		return;
+	}
+	job.client = client;
+	job.queuedTime = omp_get_wtime();
+	{
+		FScopeLock lock(&this->queueLock);
+		isQueued = this->queue.Num() < this->queueCapacity;
+		if (isQueued)
+		{
+			this->queue.Add(job);
+		}
+		else
+		{
+			this->statistics.rejectedJobs++;
+		}
+		depth = this->queue.Num();
+	}
+	if (isQueued)
+	{
+		this->jobEvent->Trigger();
+	}
+	else
+	{
+		ProcessingDaemon::Reply(client, FString::Printf(TEXT("busy %d"),
+			depth));
+		ProcessingDaemon::CloseClient(client);
+	}
+}
+
+/*	PRIVATE
+*	It executes the queued jobs until the daemon is stopped
+*	and answers their clients
+*/
+void ProcessingDaemon::RunWorker()
+{
+	double start, end;
+	bool isFound, isCompleted, hasMore;
+	while (this->isRunning)
+	{
+		DaemonJob job;
+		FString error;
+		{
+			FScopeLock lock(&this->queueLock);
+			isFound = this->queue.Num() > 0;
+			if (isFound)
+			{
+				job = this->queue[0];
+				this->queue.RemoveAt(0);
+				this->statistics.runningJobs++;
+			}
+			hasMore = this->queue.Num() > 0;
+		}
+		if (!isFound)
+		{
+			this->jobEvent->Wait(DAEMON_WAIT_TIME);
+			continue;
+		}
+		// The event wakes one worker, the next one takes the other jobs
+		if (hasMore)
+		{
+			this->jobEvent->Trigger();
+		}
+		start = omp_get_wtime();
+		isCompleted = this->ExecuteJob(job, error);
+		end = omp_get_wtime();
+		{
+			FScopeLock lock(&this->queueLock);
+			this->statistics.runningJobs--;
+			if (isCompleted)
+			{
+				this->statistics.completedJobs++;
+			}
+			else
+			{
+				this->statistics.failedJobs++;
+			}
+			this->totalQueueTime += start - job.queuedTime;
+			this->totalLatency += end - job.queuedTime;
+			if (end - job.queuedTime > this->statistics.maxLatency)
+			{
+				this->statistics.maxLatency = end - job.queuedTime;
+			}
+		}
+		ProcessingDaemon::Reply(job.client, isCompleted ?
+			FString::Printf(TEXT("ok %.3f %.3f"), (start - job.queuedTime) * 1000,
+				(end - start) * 1000) : TEXT("error ") + error);
+		ProcessingDaemon::CloseClient(job.client);
+	}
+}
+
+/*	PRIVATE
+*	It reads a job from a request line.
+*	It returns false if the line is not a valid job
+*		line: the request
+*		job: the job
+*/
+bool ProcessingDaemon::ParseJob(const FString& line, DaemonJob& job) const
+{
+	TArray<FString> words;
+	if (line.ParseIntoArrayWS(words) != 6)
+	{
+		return false;
+	}
+	if (words[0] == TEXT("opening"))
+	{
+		job.operation = DO_Opening;
+	}
+	else if (words[0] == TEXT("closing"))
+	{
+		job.operation = DO_Closing;
+	}
+	else if (words[0] == TEXT("median"))
+	{
+		job.operation = DO_Median;
+	}
+	else if (words[0] == TEXT("diamondsquare"))
+	{
+		job.operation = DO_DiamondSquare;
+	}
+	else
+	{
+		return false;
+	}
+	if (words[1] == TEXT("serial"))
+	{
+		job.implementation = DI_Serial;
+	}
+	else if (words[1] == TEXT("openmp"))
+	{
+		job.implementation = DI_OpenMP;
+	}
+	else if (words[1] == TEXT("cuda"))
+	{
+		job.implementation = DI_Cuda;
+	}
+	else
+	{
+		return false;
+	}
+	job.threadNumber = FCString::Atoi(*words[2]);
+	job.threadNumber = job.threadNumber > 0 ? job.threadNumber : 1;
+	job.size = FCString::Atoi(*words[3]);
+	job.seed = 0;
+	if (job.operation == DO_DiamondSquare)
+	{
+		job.seed = (uint32)FCString::Atoi(*words[4]);
+	}
+	else
+	{
+		job.input = words[4];
+	}
+	job.output = words[5];
+	return job.size > 0;
+}
+
+/*	PRIVATE
+*	It executes a job: it reads the input, takes the result from the
+*	cache or computes it and writes the output.
+*	It returns false if the job failed
+*		job: the job
+*		error: reason of the failure
+*/
+bool ProcessingDaemon::ExecuteJob(const DaemonJob& job, FString& error)
+{
+	FImage* image = NULL;
+	uint8* pixels = NULL;
+	int width = job.size, height = job.size;
+	bool isCached, isWritten;
+	uint64 key = ResultCache::CombineHash(ResultCache::CombineHash(
+		ResultCache::CombineHash(0, job.operation), job.implementation),
+		job.size);
+	if (job.operation == DO_DiamondSquare)
+	{
+		// Only terrains with a given seed can be computed again
+		key = job.seed != 0 ? ResultCache::CombineHash(key, job.seed) : 0;
+	}
+	else
+	{
+		image = ProcessingDaemon::ReadImage(job.input);
+		if (!image)
+		{
+			error = TEXT("input");
+			return false;
+		}
+		width = image->SizeX;
+		height = image->SizeY;
+		key = ResultCache::CombineHash(key, ResultCache::HashBytes(
+			image->RawData.GetData(), image->RawData.Num(), 0));
+		key = ResultCache::CombineHash(ResultCache::CombineHash(key, width),
+			height);
+	}
+	pixels = key != 0 ? this->FindResult(key, width, height) : NULL;
+	isCached = pixels != NULL;
+	if (!pixels)
+	{
+		pixels = image ? this->ExecuteMorphology(job, image) :
+			this->ExecuteDiamondSquare(job);
+	}
+	delete image;
+	if (!pixels)
+	{
+		error = TEXT("execution");
+		return false;
+	}
+	if (!isCached && key != 0)
+	{
+		this->AddResult(key, pixels, width, height);
+	}
+	isWritten = ProcessingDaemon::WriteImage(job.output, pixels, width, height);
+	free(pixels);
+	if (!isWritten)
+	{
+		error = TEXT("output");
+	}
+	else if (isCached)
+	{
+		FScopeLock lock(&this->queueLock);
+		this->statistics.cachedJobs++;
+	}
+	return isWritten;
+}
+
+/*	PRIVATE
+*	It executes a morphology job and returns the BGRA output
+*		job: the job
+*		image: input image
+*/
+uint8* ProcessingDaemon::ExecuteMorphology(const DaemonJob& job,
+	FImage* image) const
+{
+	MathematicalMorphology* implementation;
+	uint8* output;
+	switch (job.implementation)
+	{
+	case DI_OpenMP:
+		implementation = new OpenMPMMorphology(image, job.size,
+			job.threadNumber);
+		break;
+	case DI_Cuda:
+		implementation = new CudaMMorphology(image, job.size);
+		break;
+	default:
+		implementation = new SerialMMorphology(image, job.size);
+		break;
+	}
+	output = job.operation == DO_Median ?
+		implementation->ExecuteMedianFilter() :
+		implementation->ExecuteOpeningOrClosing(job.operation == DO_Opening);
+	delete implementation;
+	return output;
+}
+
+/*	PRIVATE
+*	It executes a diamond-square job and returns the matrix as a
+*	gray BGRA image
+*		job: the job
+*/
+uint8* ProcessingDaemon::ExecuteDiamondSquare(const DaemonJob& job) const
+{
+	DiamondSquareAlgorithm* implementation;
+	uint8 *matrix, *output;
+	int64 size = (int64)job.size * job.size, i;
+	switch (job.implementation)
+	{
+	case DI_OpenMP:
+		implementation = new OpenMPDiamondSquare(job.size, job.threadNumber);
+		break;
+	case DI_Cuda:
+		implementation = new CudaDiamondSquare(job.size);
+		break;
+	default:
+		implementation = new SerialDiamondSquare(job.size);
+		break;
+	}
+	if (job.seed != 0)
+	{
+		implementation->SetSeed(job.seed);
+	}
+	matrix = implementation->ExecuteDiamondSquare();
+	// The matrix is freed with the implementation
+	output = matrix ? (uint8*)malloc(sizeof(uint8)*size*CHANNELS) : NULL;
+	for (i = 0; output && i < size; i++)
+	{
+		output[i*CHANNELS] = matrix[i];
+		output[i*CHANNELS + 1] = matrix[i];
+		output[i*CHANNELS + 2] = matrix[i];
+		output[i*CHANNELS + 3] = ALPHA;
+	}
+	delete implementation;
+	return output;
+}
+
+/*	PRIVATE
+*	It returns a copy of a cached result, NULL if it is not cached
+*		key: key of the result
+*		width: width of the result
+*		height: height of the result
+*/
+uint8* ProcessingDaemon::FindResult(uint64 key, int& width, int& height)
+{
+	uint8* pixels = NULL;
+	FScopeLock lock(&this->cacheLock);
+	if (!this->results)
+	{
+		return NULL;
+	}
+	TSharedPtr<CachedResult> result = this->results->Find(key);
+	if (result.IsValid())
+	{
+		pixels = (uint8*)malloc(result->size);
+	}
+	if (pixels)
+	{
+		FMemory::Memcpy(pixels, result->data, result->size);
+		width = result->width;
+		height = result->height;
+	}
+	return pixels;
+}
+
+/*	PRIVATE
+*	It stores a copy of a result in the cache
+*		key: key of the result
+*		pixels: BGRA pixels
+*		width: width of the result
+*		height: height of the result
+*/
+void ProcessingDaemon::AddResult(uint64 key, const uint8* pixels,
+	int width, int height)
+{
+	int64 size = (int64)width * height * CHANNELS;
+	uint8* copy;
+	FScopeLock lock(&this->cacheLock);
+	if (!this->results)
+	{
+		return;
+	}
+	copy = (uint8*)malloc(size);
+	if (copy)
+	{
+		FMemory::Memcpy(copy, pixels, size);
+		this->results->Add(MakeShareable(new CachedResult(key, copy, size,
+			width, height)));
+	}
+}
+
+/*	PRIVATE
+*	It returns the reply to stats: queue depth, running, completed,
+*	failed, rejected and cached jobs, average queue time, average and
+*	maximum latency in milliseconds
+*/
+FString ProcessingDaemon::GetStatisticsLine()
+{
+	DaemonStatistics current = this->GetStatistics();
+	return FString::Printf(TEXT("stats %d %d %d %d %d %d %.3f %.3f %.3f"),
+		current.queueDepth, current.runningJobs, current.completedJobs,
+		current.failedJobs, current.rejectedJobs, current.cachedJobs,
+		current.averageQueueTime * 1000, current.averageLatency * 1000,
+		current.maxLatency * 1000);
+}
+
+/*	PRIVATE
+*	It reads an image from a PNG or QOI file or from shared memory,
+*	NULL if it cannot be read
+*		source: file or shm:name
+*/
+FImage* ProcessingDaemon::ReadImage(const FString& source)
+{
+	FImage* image = NULL;
+	if (!source.StartsWith(TEXT(DAEMON_SHARED_PREFIX)))
+	{
+		return UTextureUtilities::LoadImageFromFile(source);
+	}
+#if DAEMON_SUPPORTED
+	FTCHARToUTF8 name(*source.Mid(FCString::Strlen(TEXT(DAEMON_SHARED_PREFIX))));
+	const int32* header = NULL;
+	int64 available = 0;
+#if PLATFORM_WINDOWS
+	MEMORY_BASIC_INFORMATION region;
+	HANDLE file = OpenFileMappingA(FILE_MAP_READ, FALSE, name.Get());
+	if (!file)
+	{
+		return NULL;
+	}
+	header = (const int32*)MapViewOfFile(file, FILE_MAP_READ, 0, 0, 0);
+	// The view covers the whole mapping, rounded up to the page size
+	if (header && VirtualQuery(header, &region, sizeof(region)) == sizeof(region))
+	{
+		available = region.RegionSize;
+	}
+#else
+	struct stat info;
+	int file = shm_open(name.Get(), O_RDONLY, 0);
+	if (file < 0)
+	{
+		return NULL;
+	}
+	if (fstat(file, &info) == 0 && info.st_size >= 2 * (int64)sizeof(int32))
+	{
+		void* data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+		if (data != MAP_FAILED)
+		{
+			header = (const int32*)data;
+			available = info.st_size;
+		}
+	}
+#endif
+	if (available >= 2 * (int64)sizeof(int32) && header[0] > 0 && header[1] > 0
+		&& 2 * (int64)sizeof(int32) + (int64)header[0] * header[1] * CHANNELS
+			<= available)
+	{
+		image = new FImage();
+		image->SizeX = header[0];
+		image->SizeY = header[1];
+		image->RawData.Append((const uint8*)(header + 2),
+			(int64)header[0] * header[1] * CHANNELS);
+		image->Format = ERawImageFormat::Type::BGRA8;
+		image->GammaSpace = EGammaSpace::sRGB;
+	}
+#if PLATFORM_WINDOWS
+	if (header)
+	{
+		UnmapViewOfFile(header);
+	}
+	CloseHandle(file);
+#else
+	if (header)
+	{
+		munmap((void*)header, available);
+	}
+	close(file);
+#endif
+#endif
+	return image;
+}
+
+/*	PRIVATE
+*	It writes an image to a PNG or QOI file, chosen by the extension,
+*	or to shared memory, that is created if it does not exist.
+*	It returns false if the image cannot be written
+*		target: file or shm:name
+*		pixels: BGRA pixels
+*		width: width of the image
+*		height: height of the image
+*/
+bool ProcessingDaemon::WriteImage(const FString& target, const uint8* pixels,
+	int width, int height)
+{
+	bool isWritten = false;
+	if (!target.StartsWith(TEXT(DAEMON_SHARED_PREFIX)))
+	{
+		return UTextureUtilities::IsQOIFile(target) ?
+			UTextureUtilities::SaveToQOIFile(pixels, width, height, target) :
+			UTextureUtilities::SaveToPNGFile(pixels, width, height, target);
+	}
+#if DAEMON_SUPPORTED
+	FTCHARToUTF8 name(*target.Mid(FCString::Strlen(TEXT(DAEMON_SHARED_PREFIX))));
+	int64 size = 2 * (int64)sizeof(int32) + (int64)width * height * CHANNELS;
+	int32* header = NULL;
+#if PLATFORM_WINDOWS
+	MEMORY_BASIC_INFORMATION region;
+	HANDLE file = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL,
+		PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, name.Get());
+	if (!file)
+	{
+		return false;
+	}
+	header = (int32*)MapViewOfFile(file, FILE_MAP_WRITE, 0, 0, 0);
+	// A mapping created by the client keeps its size, that can be too small
+	if (header && (VirtualQuery(header, &region, sizeof(region))
+		!= sizeof(region) || (int64)region.RegionSize < size))
+	{
+		UnmapViewOfFile(header);
+		header = NULL;
+	}
+#else
+	int file = shm_open(name.Get(), O_RDWR | O_CREAT, 0600);
+	if (file < 0)
+	{
+		return false;
+	}
+	if (ftruncate(file, size) == 0)
+	{
+		void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			file, 0);
+		header = data != MAP_FAILED ? (int32*)data : NULL;
+	}
+#endif
+	if (header)
+	{
+		header[0] = width;
+		header[1] = height;
+		FMemory::Memcpy(header + 2, pixels, size - 2 * sizeof(int32));
+		isWritten = true;
+	}
+#if PLATFORM_WINDOWS
+	if (header)
+	{
+		UnmapViewOfFile(header);
+	}
+	CloseHandle(file);
+#else
+	if (header)
+	{
+		munmap(header, size);
+	}
+	close(file);
+#endif
+#endif
+	return isWritten;
+}
+
+/*	PRIVATE
+*	It reads the bytes of the request line that a client has sent,
+*	without waiting for the others.
+*	It returns false if the client closed the socket or the line is
+*	too long
+*		client: the client, its line is ended with '\0' when complete
+*		isComplete: true if the whole line has been received
+*/
+bool ProcessingDaemon::ReadLine(DaemonClient& client, bool& isComplete)
+{
+#if DAEMON_SUPPORTED
+	int received, i;
+	isComplete = false;
+	received = (int)recv(client.socket, client.line + client.length,
+		DAEMON_LINE_LENGTH - 1 - client.length, 0);
+	if (received < 0)
+	{
+		return DAEMON_IS_WAITING();
+	}
+	if (received == 0)
+	{
+		return false;
+	}
+	for (i = client.length; i < client.length + received; i++)
+	{
+		if (client.line[i] == '\n')
+		{
+			isComplete = true;
+			break;
+		}
+	}
+	client.length = i;
+	if (!isComplete)
+	{
+		return client.length < DAEMON_LINE_LENGTH - 1;
+	}
+	if (client.length > 0 && client.line[client.length - 1] == '\r')
+	{
+		client.length--;
+	}
+	client.line[client.length] = '\0';
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*	PRIVATE
+*	It sends a reply line to a client. The sockets do not block, so
+*	when the buffer of the socket is full it waits until the client
+*	reads, for at most DAEMON_WRITE_TIMEOUT seconds. Clients that
+*	closed the socket or do not read are ignored
+*		client: socket of the client
+*		message: the reply, without the end of line
+*/
+void ProcessingDaemon::Reply(DaemonSocket client, const FString& message)
+{
+#if DAEMON_SUPPORTED
+	FTCHARToUTF8 text(*(message + TEXT("\n")));
+	const ANSICHAR* data = text.Get();
+	int remaining = text.Length(), sent;
+	double deadline = omp_get_wtime() + DAEMON_WRITE_TIMEOUT;
+	pollfd writable;
+	while (remaining > 0)
+	{
+		sent = (int)send(client, data, remaining, MSG_NOSIGNAL);
+		if (sent > 0)
+		{
+			data += sent;
+			remaining -= sent;
+			continue;
+		}
+		if (sent == 0 || !DAEMON_IS_WAITING() || omp_get_wtime() > deadline)
+		{
+			return;
+		}
+		writable.fd = client;
+		writable.events = POLLOUT;
+		writable.revents = 0;
+		poll(&writable, 1, DAEMON_WAIT_TIME);
+	}
+#endif
+}
+
+/*	PRIVATE
+*	It makes the calls on a socket return instead of waiting
+*		client: the socket
+*/
+void ProcessingDaemon::SetNonBlocking(DaemonSocket client)
+{
+#if PLATFORM_WINDOWS
+	u_long enable = 1;
+	ioctlsocket(client, FIONBIO, &enable);
+#elif PLATFORM_LINUX || PLATFORM_MAC
+	fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+#endif
+}
+
+/*	PRIVATE
+*	It closes the socket of a client
+*		client: socket of the client
+*/
+void ProcessingDaemon::CloseClient(DaemonSocket client)
+{
+#if PLATFORM_WINDOWS
+	closesocket(client);
+#elif PLATFORM_LINUX || PLATFORM_MAC
+	close(client);
+#endif
+}
@@ -0,0 +1,266 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "QOIImage.h"
+#include "TextureUtilities.h"
+
+// Magic bytes and end marker of the files
+static const uint8 QOIMagic[4] = { 'q', 'o', 'i', 'f' };
+static const uint8 QOIEnd[QOI_END_SIZE] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+/*
+*	It decodes a QOI file into an image, whose pixels are written
+*	once in its buffer. The first mip is computed in the same pass,
+*	after each pair of rows.
+*	It returns false if the data is not a valid QOI file
+*		data: content of the file
+*		size: size of the file in bytes
+*		image: image that receives size and pixels
+*		firstMip: half-size image, NULL if not used
+*/
+bool QOIImage::Decode(const uint8* data, int64 size, FImage* image,
+	TArray<uint8>* firstMip)
+{
+	uint8 index[QOI_INDEX_SIZE * 4];
+	uint8 pixel[4] = { 0, 0, 0, 255 };
+	uint8* output;
+	int64 position = QOI_HEADER_SIZE, chunksEnd = size - QOI_END_SIZE;
+	int64 pixelCount, rowEnd, i;
+	uint32 width, height;
+	int run = 0, row = 0;
+	if (!data || !image || size < QOI_HEADER_SIZE + QOI_END_SIZE
+		|| FMemory::Memcmp(data, QOIMagic, 4) != 0)
+	{
+		return false;
+	}
+	width = QOIImage::ReadBigEndian(data + 4);
+	height = QOIImage::ReadBigEndian(data + 8);
+	pixelCount = (int64)width * height;
+	if (width == 0 || height == 0 || pixelCount > QOI_MAX_PIXELS
+		|| (data[12] != 3 && data[12] != 4))
+	{
+		return false;
+	}
+	FMemory::Memzero(index, sizeof(index));
+	image->SizeX = (int32)width;
+	image->SizeY = (int32)height;
+	image->RawData.SetNumUninitialized((int32)(pixelCount * 4));
+	image->Format = ERawImageFormat::Type::BGRA8;
+	image->GammaSpace = EGammaSpace::sRGB;
+	output = image->RawData.GetData();
+	if (firstMip)
+	{
+		firstMip->SetNumUninitialized((width > 1 ? width / 2 : 1) *
+			(height > 1 ? height / 2 : 1) * 4);
+	}
+	rowEnd = width;
+	for (i = 0; i < pixelCount; i++)
+	{
+		if (run > 0)
+		{
+			run--;
+		}
+		else if (position < chunksEnd)
+		{
+			uint8 op = data[position++];
+			if (op == QOI_OP_RGB)
+			{
+				// The chunk must end before the end marker
+				if (position + 3 > chunksEnd)
+				{
+					return false;
+				}
+				pixel[0] = data[position];
+				pixel[1] = data[position + 1];
+				pixel[2] = data[position + 2];
+				position += 3;
+			}
+			else if (op == QOI_OP_RGBA)
+			{
+				if (position + 4 > chunksEnd)
+				{
+					return false;
+				}
+				FMemory::Memcpy(pixel, data + position, 4);
+				position += 4;
+			}
+			else if ((op & QOI_MASK) == QOI_OP_INDEX)
+			{
+				FMemory::Memcpy(pixel, index + op * 4, 4);
+			}
+			else if ((op & QOI_MASK) == QOI_OP_DIFF)
+			{
+				pixel[0] += ((op >> 4) & 0x03) - 2;
+				pixel[1] += ((op >> 2) & 0x03) - 2;
+				pixel[2] += (op & 0x03) - 2;
+			}
+			else if ((op & QOI_MASK) == QOI_OP_LUMA)
+			{
+				int greenDiff;
+				if (position + 1 > chunksEnd)
+				{
+					return false;
+				}
+				greenDiff = (op & 0x3F) - 32;
+				pixel[0] += greenDiff - 8 + ((data[position] >> 4) & 0x0F);
+				pixel[1] += greenDiff;
+				pixel[2] += greenDiff - 8 + (data[position] & 0x0F);
+				position++;
+			}
+			else
+			{
+				run = op & 0x3F;
+			}
+			FMemory::Memcpy(index + QOIImage::GetIndex(pixel) * 4, pixel, 4);
+		}
+		else
+		{
+			return false;
+		}
+		FMemory::Memcpy(output + i * 4, pixel, 4);
+		if (i + 1 == rowEnd)
+		{
+			if (firstMip && (row % 2 == 1 || height == 1))
+			{
+				UTextureUtilities::DownsampleRow(output, width, height,
+					row / 2, firstMip->GetData());
+			}
+			row++;
+			rowEnd += width;
+		}
+	}
+	return true;
+}
+
+/*
+*	It encodes an image in the QOI format.
+*	It returns false if the image is empty or too large
+*		pixels: image pixels, 4 bytes per pixel
+*		width: image width
+*		height: image height
+*		data: content of the file
+*/
+bool QOIImage::Encode(const uint8* pixels, int width, int height,
+	TArray<uint8>& data)
+{
+	uint8 index[QOI_INDEX_SIZE * 4];
+	uint8 previous[4] = { 0, 0, 0, 255 };
+	int64 pixelCount = (int64)width * height, position, i;
+	uint8* output;
+	int run = 0;
+	if (!pixels || width <= 0 || height <= 0 || pixelCount > QOI_MAX_PIXELS)
+	{
+		return false;
+	}
+	FMemory::Memzero(index, sizeof(index));
+	// Every pixel takes at most 5 bytes
+	data.SetNumUninitialized((int32)(QOI_HEADER_SIZE + pixelCount * 5
+		+ QOI_END_SIZE));
+	output = data.GetData();
+	FMemory::Memcpy(output, QOIMagic, 4);
+	QOIImage::WriteBigEndian(output + 4, (uint32)width);
+	QOIImage::WriteBigEndian(output + 8, (uint32)height);
+	output[12] = 4;
+	output[13] = 0;
+	position = QOI_HEADER_SIZE;
+	for (i = 0; i < pixelCount; i++)
+	{
+		const uint8* pixel = pixels + i * 4;
+		int hash;
+		if (FMemory::Memcmp(pixel, previous, 4) == 0)
+		{
+			run++;
+			if (run == QOI_MAX_RUN || i == pixelCount - 1)
+			{
+				output[position++] = (uint8)(QOI_OP_RUN | (run - 1));
+				run = 0;
+			}
+			continue;
+		}
+		if (run > 0)
+		{
+			output[position++] = (uint8)(QOI_OP_RUN | (run - 1));
+			run = 0;
+		}
+		hash = QOIImage::GetIndex(pixel);
+		if (FMemory::Memcmp(index + hash * 4, pixel, 4) == 0)
+		{
+			output[position++] = (uint8)(QOI_OP_INDEX | hash);
+		}
+		else
+		{
+			FMemory::Memcpy(index + hash * 4, pixel, 4);
+			if (pixel[3] == previous[3])
+			{
+				int8 redDiff = (int8)(pixel[0] - previous[0]);
+				int8 greenDiff = (int8)(pixel[1] - previous[1]);
+				int8 blueDiff = (int8)(pixel[2] - previous[2]);
+				int8 redGreen = redDiff - greenDiff;
+				int8 blueGreen = blueDiff - greenDiff;
+				if (redDiff >= -2 && redDiff <= 1 && greenDiff >= -2
+					&& greenDiff <= 1 && blueDiff >= -2 && blueDiff <= 1)
+				{
+					output[position++] = (uint8)(QOI_OP_DIFF | (redDiff + 2) << 4
+						| (greenDiff + 2) << 2 | (blueDiff + 2));
+				}
+				else if (greenDiff >= -32 && greenDiff <= 31 && redGreen >= -8
+					&& redGreen <= 7 && blueGreen >= -8 && blueGreen <= 7)
+				{
+					output[position++] = (uint8)(QOI_OP_LUMA | (greenDiff + 32));
+					output[position++] = (uint8)((redGreen + 8) << 4
+						| (blueGreen + 8));
+				}
+				else
+				{
+					output[position++] = QOI_OP_RGB;
+					FMemory::Memcpy(output + position, pixel, 3);
+					position += 3;
+				}
+			}
+			else
+			{
+				output[position++] = QOI_OP_RGBA;
+				FMemory::Memcpy(output + position, pixel, 4);
+				position += 4;
+			}
+		}
+		FMemory::Memcpy(previous, pixel, 4);
+	}
+	FMemory::Memcpy(output + position, QOIEnd, QOI_END_SIZE);
+	data.SetNum((int32)(position + QOI_END_SIZE), false);
+	return true;
+}
+
+/*	PRIVATE
+*	It returns the position of a colour in the table of the
+*	previous colours
+*		pixel: the colour
+*/
+int QOIImage::GetIndex(const uint8* pixel)
+{
+	return (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11)
+		% QOI_INDEX_SIZE;
+}
+
+/*	PRIVATE
+*	It reads a big-endian 32 bit integer
+*		data: first byte of the integer
+*/
+uint32 QOIImage::ReadBigEndian(const uint8* data)
+{
+	return (uint32)data[0] << 24 | (uint32)data[1] << 16
+		| (uint32)data[2] << 8 | (uint32)data[3];
+}
+
+/*	PRIVATE
+*	It writes a big-endian 32 bit integer
+*		data: first byte of the integer
+*		value: the integer
+*/
+void QOIImage::WriteBigEndian(uint8* data, uint32 value)
+{
+	data[0] = (uint8)(value >> 24);
+	data[1] = (uint8)(value >> 16);
+	data[2] = (uint8)(value >> 8);
+	data[3] = (uint8)value;
+}
@@ -0,0 +1,390 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "RankFilter.h"
+#include "MathematicalMorphology.h"
+
+/*
+*	RankFilter constructor.
+*	It stores the pixels of the element and the ones of its edges
+*		width: width of the channels
+*		height: height of the channels
+*		element: structuring element, its pixels are FOREGROUND
+*		elementWidth: width of the element
+*		elementHeight: height of the element
+*		threadNumber: the number of thread to use
+*/
+RankFilter::RankFilter(int width, int height, const uint8* element,
+	int elementWidth, int elementHeight, int threadNumber)
+{
+	int size = elementWidth * elementHeight, row, col;
+	this->width = width;
+	this->height = height;
+	this->threadNumber = threadNumber > 0 ? threadNumber : 1;
+	this->elementWidth = elementWidth;
+	this->elementHeight = elementHeight;
+	this->halfWidth = (elementWidth - 1) / 2;
+	this->halfHeight = (elementHeight - 1) / 2;
+	this->elementCount = 0;
+	this->edgeCount = 0;
+	this->fraction = 0;
+	this->isRectangle = element != NULL;
+	this->elementRows = (int*)malloc(sizeof(int)*(size > 0 ? size : 1));
+	this->elementCols = (int*)malloc(sizeof(int)*(size > 0 ? size : 1));
+	this->leavingRows = (int*)malloc(sizeof(int)*(size > 0 ? size : 1));
+	this->leavingCols = (int*)malloc(sizeof(int)*(size > 0 ? size : 1));
+	this->enteringRows = (int*)malloc(sizeof(int)*(size > 0 ? size : 1));
+	this->enteringCols = (int*)malloc(sizeof(int)*(size > 0 ? size : 1));
+	if (!element || !this->elementRows || !this->elementCols
+		|| !this->leavingRows || !this->leavingCols
+		|| !this->enteringRows || !this->enteringCols)
+	{
+		return;
+	}
+	for (row = 0; row < elementHeight; row++)
+	{
+		for (col = 0; col < elementWidth; col++)
+		{
+			if (element[row*elementWidth + col] != FOREGROUND)
+			{
+				this->isRectangle = false;
+				continue;
+			}
+			this->elementRows[this->elementCount] = row - this->halfHeight;
+			this->elementCols[this->elementCount] = col - this->halfWidth;
+			this->elementCount++;
+			// A row of the element has as many left edges as right edges
+			if (col == 0 || element[row*elementWidth + col - 1] != FOREGROUND)
+			{
+				this->leavingRows[this->edgeCount] = row - this->halfHeight;
+				this->leavingCols[this->edgeCount] = col - this->halfWidth;
+			}
+			if (col == elementWidth - 1
+				|| element[row*elementWidth + col + 1] != FOREGROUND)
+			{
+				this->enteringRows[this->edgeCount] = row - this->halfHeight;
+				this->enteringCols[this->edgeCount] = col - this->halfWidth;
+				this->edgeCount++;
+			}
+		}
+	}
+}
+
+/*
+*	RankFilter destructor.
+*	It frees the pixels of the element
+*/
+RankFilter::~RankFilter()
+{
+	free(this->elementRows);
+	free(this->elementCols);
+	free(this->leavingRows);
+	free(this->leavingCols);
+	free(this->enteringRows);
+	free(this->enteringCols);
+}
+
+/*
+*	It computes the rank filter of a channel.
+*	It returns false if the element is not available
+*		channel: channel of width x height pixels
+*		result: filtered channel of width x height pixels
+*		percentile: percentile of the window, from 0 to 100
+*/
+bool RankFilter::Execute(const uint8* channel, uint8* result,
+	float percentile)
+{
+	int bandCount = this->threadNumber < this->height ?
+		this->threadNumber : this->height;
+	if (this->elementCount == 0)
+	{
+		return false;
+	}
+	this->fraction = percentile < 0 ? 0 :
+		percentile > 100 ? 1 : percentile / 100;
+#pragma omp parallel num_threads(this->threadNumber)
+	{
+		uint16 *columns = NULL, *coarseColumns = NULL;
+		if (this->isRectangle)
+		{
+			columns = (uint16*)malloc(sizeof(uint16)*this->width*RANK_BINS);
+			coarseColumns = (uint16*)malloc(sizeof(uint16)*
+				this->width*RANK_COARSE_BINS);
+		}
+#pragma omp for schedule(static, 1)
+		for (int band = 0; band < bandCount; band++)
+		{
+			int firstRow = (int)((int64)band * this->height / bandCount);
+			int lastRow = (int)((int64)(band + 1) * this->height / bandCount);
+			// Without the column histograms the edges give the same result
+			if (columns && coarseColumns)
+			{
+				this->FilterRectangleBand(channel, result, firstRow, lastRow,
+					columns, coarseColumns);
+			}
+			else
+			{
+				this->FilterMaskBand(channel, result, firstRow, lastRow);
+			}
+		}
+		free(columns);
+		free(coarseColumns);
+	}
+	return true;
+}
+
+/*	PRIVATE
+*	It filters a band of rows with the rectangular element, keeping
+*	a histogram of the window rows for each column
+*		channel: input channel
+*		result: output channel
+*		firstRow: first row of the band
+*		lastRow: row after the last one of the band
+*		columns: histograms of the columns of the thread
+*		coarseColumns: coarse histograms of the columns of the thread
+*/
+void RankFilter::FilterRectangleBand(const uint8* channel, uint8* result,
+	int firstRow, int lastRow, uint16* columns, uint16* coarseColumns) const
+{
+	WindowHistogram window;
+	int row, col, bin, rank, value;
+	int top = firstRow - this->halfHeight;
+	int bottom = top + this->elementHeight - 1;
+	FMemory::Memset(columns, 0, sizeof(uint16)*this->width*RANK_BINS);
+	FMemory::Memset(coarseColumns, 0,
+		sizeof(uint16)*this->width*RANK_COARSE_BINS);
+	for (row = top > 0 ? top : 0; row <= bottom && row < this->height; row++)
+	{
+		for (col = 0; col < this->width; col++)
+		{
+			value = channel[row*this->width + col];
+			columns[col*RANK_BINS + value]++;
+			coarseColumns[col*RANK_COARSE_BINS + (value >> RANK_COARSE_SHIFT)]++;
+		}
+	}
+	for (row = firstRow; row < lastRow; row++)
+	{
+		int leaving = row - 1 - this->halfHeight;
+		int entering = row - this->halfHeight + this->elementHeight - 1;
+		int rowCount = (entering < this->height ? entering : this->height - 1)
+			- (leaving + 1 > 0 ? leaving + 1 : 0) + 1;
+		// The columns move down by one pixel
+		if (row > firstRow)
+		{
+			for (col = 0; leaving >= 0 && col < this->width; col++)
+			{
+				value = channel[leaving*this->width + col];
+				columns[col*RANK_BINS + value]--;
+				coarseColumns[col*RANK_COARSE_BINS
+					+ (value >> RANK_COARSE_SHIFT)]--;
+			}
+			for (col = 0; entering < this->height && col < this->width; col++)
+			{
+				value = channel[entering*this->width + col];
+				columns[col*RANK_BINS + value]++;
+				coarseColumns[col*RANK_COARSE_BINS
+					+ (value >> RANK_COARSE_SHIFT)]++;
+			}
+		}
+		FMemory::Memset(window.coarse, 0, sizeof(window.coarse));
+		for (bin = 0; bin < RANK_COARSE_BINS; bin++)
+		{
+			window.fineColumn[bin] = -this->elementWidth;
+		}
+		for (col = 0; col < this->elementWidth - this->halfWidth
+			&& col < this->width; col++)
+		{
+			for (bin = 0; bin < RANK_COARSE_BINS; bin++)
+			{
+				window.coarse[bin] += coarseColumns[col*RANK_COARSE_BINS + bin];
+			}
+		}
+		for (col = 0; col < this->width; col++)
+		{
+			int left = col - this->halfWidth;
+			int right = left + this->elementWidth - 1;
+			int colCount = (right < this->width ? right : this->width - 1)
+				- (left > 0 ? left : 0) + 1;
+			// Whole columns leave and enter the coarse bins
+			if (col > 0 && left - 1 >= 0)
+			{
+				const uint16* column = coarseColumns + (left - 1)*RANK_COARSE_BINS;
+				for (bin = 0; bin < RANK_COARSE_BINS; bin++)
+				{
+					window.coarse[bin] -= column[bin];
+				}
+			}
+			if (col > 0 && right < this->width)
+			{
+				const uint16* column = coarseColumns + right*RANK_COARSE_BINS;
+				for (bin = 0; bin < RANK_COARSE_BINS; bin++)
+				{
+					window.coarse[bin] += column[bin];
+				}
+			}
+			rank = this->GetRank(rowCount*colCount);
+			bin = RankFilter::FindBin(window.coarse, 0, rank);
+			this->UpdateFineBins(window, columns, bin, col);
+			result[row*this->width + col] = (uint8)RankFilter::FindBin(
+				window.fine, bin << RANK_COARSE_SHIFT, rank);
+		}
+	}
+}
+
+/*	PRIVATE
+*	It brings the fine bins of a coarse bin of the window to a
+*	column, moving them from the last column they were used in or
+*	adding the columns of the window if it is cheaper
+*		window: histogram of the window
+*		columns: histograms of the columns
+*		bin: the coarse bin
+*		col: column of the center of the window
+*/
+void RankFilter::UpdateFineBins(WindowHistogram& window,
+	const uint16* columns, int bin, int col) const
+{
+	int steps = col - window.fineColumn[bin];
+	int first = bin << RANK_COARSE_SHIFT, step, i, k;
+	int* fine = window.fine + first;
+	if (steps == 0)
+	{
+		return;
+	}
+	if (2 * steps >= this->elementWidth)
+	{
+		int left = col - this->halfWidth;
+		int right = left + this->elementWidth - 1;
+		FMemory::Memset(fine, 0, sizeof(int)*RANK_COARSE_BINS);
+		for (i = left > 0 ? left : 0; i <= right && i < this->width; i++)
+		{
+			const uint16* column = columns + i*RANK_BINS + first;
+			for (k = 0; k < RANK_COARSE_BINS; k++)
+			{
+				fine[k] += column[k];
+			}
+		}
+	}
+	else
+	{
+		for (step = window.fineColumn[bin] + 1; step <= col; step++)
+		{
+			int leaving = step - 1 - this->halfWidth;
+			int entering = leaving + this->elementWidth;
+			if (leaving >= 0)
+			{
+				const uint16* column = columns + leaving*RANK_BINS + first;
+				for (k = 0; k < RANK_COARSE_BINS; k++)
+				{
+					fine[k] -= column[k];
+				}
+			}
+			if (entering < this->width)
+			{
+				const uint16* column = columns + entering*RANK_BINS + first;
+				for (k = 0; k < RANK_COARSE_BINS; k++)
+				{
+					fine[k] += column[k];
+				}
+			}
+		}
+	}
+	window.fineColumn[bin] = col;
+}
+
+/*	PRIVATE
+*	It filters a band of rows with any element, moving the window
+*	histogram along each row by the pixels of the element edges
+*		channel: input channel
+*		result: output channel
+*		firstRow: first row of the band
+*		lastRow: row after the last one of the band
+*/
+void RankFilter::FilterMaskBand(const uint8* channel, uint8* result,
+	int firstRow, int lastRow) const
+{
+	WindowHistogram window;
+	int row, col, i, rank, bin, count, pixelRow, pixelCol, value;
+	for (row = firstRow; row < lastRow; row++)
+	{
+		FMemory::Memset(window.coarse, 0, sizeof(window.coarse));
+		FMemory::Memset(window.fine, 0, sizeof(window.fine));
+		count = 0;
+		// The first window is built from all the pixels
+		for (i = 0; i < this->elementCount; i++)
+		{
+			pixelRow = row + this->elementRows[i];
+			pixelCol = this->elementCols[i];
+			if (pixelRow >= 0 && pixelRow < this->height
+				&& pixelCol >= 0 && pixelCol < this->width)
+			{
+				value = channel[pixelRow*this->width + pixelCol];
+				window.fine[value]++;
+				window.coarse[value >> RANK_COARSE_SHIFT]++;
+				count++;
+			}
+		}
+		for (col = 0; col < this->width; col++)
+		{
+			for (i = 0; col > 0 && i < this->edgeCount; i++)
+			{
+				pixelRow = row + this->leavingRows[i];
+				pixelCol = col - 1 + this->leavingCols[i];
+				if (pixelRow >= 0 && pixelRow < this->height
+					&& pixelCol >= 0 && pixelCol < this->width)
+				{
+					value = channel[pixelRow*this->width + pixelCol];
+					window.fine[value]--;
+					window.coarse[value >> RANK_COARSE_SHIFT]--;
+					count--;
+				}
+				pixelRow = row + this->enteringRows[i];
+				pixelCol = col + this->enteringCols[i];
+				if (pixelRow >= 0 && pixelRow < this->height
+					&& pixelCol >= 0 && pixelCol < this->width)
+				{
+					value = channel[pixelRow*this->width + pixelCol];
+					window.fine[value]++;
+					window.coarse[value >> RANK_COARSE_SHIFT]++;
+					count++;
+				}
+			}
+			// An element without its center can leave the window empty
+			if (count == 0)
+			{
+				result[row*this->width + col] = channel[row*this->width + col];
+				continue;
+			}
+			rank = this->GetRank(count);
+			bin = RankFilter::FindBin(window.coarse, 0, rank);
+			result[row*this->width + col] = (uint8)RankFilter::FindBin(
+				window.fine, bin << RANK_COARSE_SHIFT, rank);
+		}
+	}
+}
+
+/*	PRIVATE
+*	It returns the rank of the percentile in a window,
+*	0 for the lowest value
+*		count: number of pixels of the window
+*/
+int RankFilter::GetRank(int count) const
+{
+	return (int)(this->fraction*(count - 1) + 0.5f);
+}
+
+/*	PRIVATE
+*	It returns the bin that contains a rank, from a first bin, and
+*	removes from the rank the values of the bins before it
+*		bins: the bins
+*		first: first bin
+*		rank: the rank
+*/
+int RankFilter::FindBin(const int* bins, int first, int& rank)
+{
+	while (rank >= bins[first])
+	{
+		rank -= bins[first];
+		first++;
+	}
+	return first;
+}
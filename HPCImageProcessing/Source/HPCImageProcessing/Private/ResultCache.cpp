@@ -0,0 +1,282 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ResultCache.h"
+
+// Multipliers of the hash function
+#define HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+
+/*
+*	CachedResult constructor.
+*	The result takes the ownership of the data
+*		resultKey: hash of the input and of the parameters
+*		resultData: buffer allocated with malloc
+*		resultSize: size of the buffer in bytes
+*		resultWidth: width of the image
+*		resultHeight: height of the image
+*/
+CachedResult::CachedResult(uint64 resultKey, uint8* resultData,
+	int64 resultSize, int resultWidth, int resultHeight)
+{
+	this->key = resultKey;
+	this->data = resultData;
+	this->size = resultSize;
+	this->width = resultWidth;
+	this->height = resultHeight;
+}
+
+/*
+*	CachedResult destructor.
+*	It frees the data
+*/
+CachedResult::~CachedResult()
+{
+	free(this->data);
+}
+
+/*
+*	ResultCache constructor.
+*		memoryBudget: bytes of results kept in memory
+*		spillDirectory: directory where the removed results are
+*			written, empty to discard them
+*/
+ResultCache::ResultCache(int64 memoryBudget, FString spillDirectory)
+{
+	this->memoryBudget = memoryBudget;
+	this->usedMemory = 0;
+	this->spillDirectory = spillDirectory;
+	this->hits = 0;
+	this->misses = 0;
+	this->spillHits = 0;
+}
+
+/*
+*	ResultCache destructor.
+*	It deletes the results written to the spill directory
+*/
+ResultCache::~ResultCache()
+{
+	this->Empty();
+}
+
+/*
+*	It returns a result and marks it as the most recently used,
+*	NULL if it is neither in memory nor in the spill directory
+*		key: hash of the input and of the parameters
+*/
+TSharedPtr<CachedResult> ResultCache::Find(uint64 key)
+{
+	CacheEntry* entry = this->cache.Find(key);
+	TSharedPtr<CachedResult> result;
+	if (entry)
+	{
+		this->usage.RemoveNode(entry->node);
+		this->usage.AddHead(key);
+		entry->node = this->usage.GetHead();
+		this->hits++;
+		return entry->result;
+	}
+	result = this->ReadSpilled(key);
+	if (result.IsValid())
+	{
+		this->hits++;
+		this->spillHits++;
+		this->Add(result);
+		return result;
+	}
+	this->misses++;
+	return NULL;
+}
+
+/*
+*	It returns true if a result is in memory or in the spill directory
+*		key: hash of the input and of the parameters
+*/
+bool ResultCache::Contains(uint64 key) const
+{
+	return this->cache.Contains(key) || this->spilled.Contains(key);
+}
+
+/*
+*	It adds a result as the most recently used one, removing the least
+*	recently used ones if the memory budget is exceeded. Results larger
+*	than the budget are not added
+*		result: the result to add
+*/
+void ResultCache::Add(const TSharedPtr<CachedResult>& result)
+{
+	CacheEntry entry;
+	if (!result.IsValid() || !result->data
+		|| result->GetMemory() > this->memoryBudget
+		|| this->cache.Contains(result->key))
+	{
+		return;
+	}
+	this->usage.AddHead(result->key);
+	entry.result = result;
+	entry.node = this->usage.GetHead();
+	this->cache.Add(result->key, entry);
+	this->usedMemory += result->GetMemory();
+	while (this->usedMemory > this->memoryBudget)
+	{
+		this->Evict();
+	}
+}
+
+/*
+*	It removes all the results from memory and from the spill directory
+*/
+void ResultCache::Empty()
+{
+	TArray<uint64> keys;
+	this->spilled.GetKeys(keys);
+	for (int i = 0; i < keys.Num(); i++)
+	{
+		IFileManager::Get().Delete(*this->GetSpillFile(keys[i]));
+	}
+	this->spilled.Empty();
+	this->cache.Empty();
+	this->usage.Empty();
+	this->usedMemory = 0;
+}
+
+/*
+*	It computes a 64 bit hash of a buffer. Four independent lanes of
+*	8 bytes are mixed at a time, so the speed is close to the one of
+*	a copy of the buffer
+*		data: the buffer
+*		size: size of the buffer in bytes
+*		seed: initial value of the hash
+*/
+uint64 ResultCache::HashBytes(const uint8* data, int64 size, uint64 seed)
+{
+	uint64 lanes[4] = { seed + HASH_PRIME1 + HASH_PRIME2,
+		seed + HASH_PRIME2, seed, seed - HASH_PRIME1 };
+	uint64 hash = 0, word;
+	int64 i = 0;
+	int k;
+	for (; i + 32 <= size; i += 32)
+	{
+		for (k = 0; k < 4; k++)
+		{
+			FMemory::Memcpy(&word, data + i + k * 8, 8);
+			lanes[k] += word * HASH_PRIME2;
+			lanes[k] = (lanes[k] << 31) | (lanes[k] >> 33);
+			lanes[k] *= HASH_PRIME1;
+		}
+	}
+	for (k = 0; k < 4; k++)
+	{
+		hash = ResultCache::CombineHash(hash, lanes[k]);
+	}
+	for (; i < size; i++)
+	{
+		hash = ResultCache::CombineHash(hash, data[i]);
+	}
+	return ResultCache::CombineHash(hash, (uint64)size);
+}
+
+/*
+*	It combines a hash with a value, used to add the parameters
+*	of an operation to the hash of its input
+*		hash: the hash
+*		value: the value to add
+*/
+uint64 ResultCache::CombineHash(uint64 hash, uint64 value)
+{
+	uint64 x = hash ^ (value * HASH_PRIME1);
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+/*	PRIVATE
+*	It removes the least recently used result from memory and writes
+*	it to the spill directory if it is set. The file contains the
+*	image followed by its first mip
+*/
+void ResultCache::Evict()
+{
+	TDoubleLinkedList<uint64>::TDoubleLinkedListNode* last =
+		this->usage.GetTail();
+	uint64 key = last->GetValue();
+	CacheEntry* entry = this->cache.Find(key);
+	CachedResult* result = entry->result.Get();
+	SpilledEntry spilledEntry;
+	FArchive* writer = NULL;
+	bool isWritten = false;
+	if (!this->spillDirectory.IsEmpty())
+	{
+		writer = IFileManager::Get().CreateFileWriter(
+			*this->GetSpillFile(key));
+	}
+	if (writer)
+	{
+		writer->Serialize(result->data, result->size);
+		writer->Serialize(result->firstMip.GetData(), result->firstMip.Num());
+		isWritten = writer->Close();
+		delete writer;
+	}
+	if (isWritten)
+	{
+		spilledEntry.size = result->size;
+		spilledEntry.mipSize = result->firstMip.Num();
+		spilledEntry.width = result->width;
+		spilledEntry.height = result->height;
+		this->spilled.Add(key, spilledEntry);
+	}
+	this->usedMemory -= result->GetMemory();
+	this->cache.Remove(key);
+	this->usage.RemoveNode(last);
+}
+
+/*	PRIVATE
+*	It reads a result from the spill directory and deletes the file,
+*	NULL if the result was not written or cannot be read
+*		key: hash of the input and of the parameters
+*/
+TSharedPtr<CachedResult> ResultCache::ReadSpilled(uint64 key)
+{
+	SpilledEntry* entry = this->spilled.Find(key);
+	FString file;
+	FArchive* reader;
+	uint8* data;
+	TSharedPtr<CachedResult> result;
+	if (!entry)
+	{
+		return NULL;
+	}
+	file = this->GetSpillFile(key);
+	data = (uint8*)malloc(sizeof(uint8)*entry->size);
+	reader = IFileManager::Get().CreateFileReader(*file);
+	if (data && reader
+		&& reader->TotalSize() == entry->size + entry->mipSize)
+	{
+		result = MakeShareable(new CachedResult(key, data, entry->size,
+			entry->width, entry->height));
+		data = NULL;
+		result->firstMip.SetNumUninitialized((int32)entry->mipSize);
+		reader->Serialize(result->data, entry->size);
+		reader->Serialize(result->firstMip.GetData(), entry->mipSize);
+		if (reader->IsError())
+		{
+			result.Reset();
+		}
+	}
+	free(data);
+	delete reader;
+	IFileManager::Get().Delete(*file);
+	this->spilled.Remove(key);
+	return result;
+}
+
+/*	PRIVATE
+*	It returns the file of a result in the spill directory
+*		key: hash of the input and of the parameters
+*/
+FString ResultCache::GetSpillFile(uint64 key) const
+{
+	return this->spillDirectory / FString::Printf(TEXT("%016llx.cache"),
+		key);
+}
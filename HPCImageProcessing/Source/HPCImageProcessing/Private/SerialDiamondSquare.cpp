@@ -3,6 +3,22 @@
 
 #include "SerialDiamondSquare.h"
 
+/*
+*	SerialDiamondSquare constructor.
+*	It allocates space for the image matrix
+*	and sets the tile size used by the blocked traversal.
+*		size: the length of the matrix row/column
+*		tileSize: number of rows of a tile; when the step
+*			of the algorithm drops to this value the remaining
+*			levels are computed tile by tile. It has to be a
+*			power of two, 0 disables the blocked traversal
+*/
+SerialDiamondSquare::SerialDiamondSquare(int size, int tileSize)
+	: DiamondSquareAlgorithm(size)
+{
+	this->tileSize = tileSize;
+}
+
 /*
 *	It executes the diamond-square algorithm
 */
@@ -13,12 +29,12 @@ uint8* SerialDiamondSquare::ExecuteDiamondSquare()
 	{
 		return NULL;
 	}
-	srand((unsigned)time(0));
 	// It inizializes matrix angles
-	this->image[0 * this->size + 0] = rand() % MAX;
-	this->image[0 * this->size + last] = rand() % MAX;
-	this->image[last * this->size + 0] = rand() % MAX;
-	this->image[last * this->size + last] = rand() % MAX;
+	this->image[0 * this->size + 0] = this->RandomHash(0, 0) % MAX;
+	this->image[0 * this->size + last] = this->RandomHash(0, last) % MAX;
+	this->image[last * this->size + 0] = this->RandomHash(last, 0) % MAX;
+	this->image[last * this->size + last] =
+		this->RandomHash(last, last) % MAX;
 
 	this->DiamondSquare(last, MAX);
 	return this->image;
@@ -32,41 +48,140 @@ uint8* SerialDiamondSquare::ExecuteDiamondSquare()
 *		maxValue: random seed to use
 */
 void SerialDiamondSquare::DiamondSquare(int matrixSize, int maxValue)
+{
+	int half = matrixSize / 2;
+	bool isPowerOfTwo = this->tileSize > 1 &&
+		(this->tileSize & (this->tileSize - 1)) == 0;
+
+	if (matrixSize > 1)
+	{
+		if (isPowerOfTwo && matrixSize <= this->tileSize
+			&& this->tileSize <= this->size - 1)
+		{
+			this->BlockedDiamondSquare(matrixSize, maxValue);
+			return;
+		}
+		this->DiamondRows(matrixSize, maxValue, 0, this->size);
+		this->SquareRows(matrixSize, maxValue, 0, this->size);
+		this->EmitPreview(half);
+		this->DiamondSquare(half, maxValue / 2);
+	}
+}
+
+/*	PRIVATE
+*	It executes the diamond step of a level on the rows
+*	in [firstRow, endRow). The fine levels are computed a row
+*	at a time by DiamondRow
+*		matrixSize: size of the squares of the level
+*		maxValue: random seed to use
+*		firstRow: first row of the range, multiple of matrixSize
+*		endRow: row after the last one of the range
+*/
+void SerialDiamondSquare::DiamondRows(int matrixSize, int maxValue,
+	int firstRow, int endRow)
 {
 	int i, j;
-	int startIndex, endSquare;
 	int last = this->size - 1;
 	int half = matrixSize / 2;
+	for (i = firstRow; i < endRow && i < last; i += matrixSize)
+	{
+		if (matrixSize <= FINE_LEVEL_SIZE)
+		{
+			this->DiamondRow(i + half, half, maxValue);
+			continue;
+		}
+		for (j = 0; j < last; j += matrixSize)
+		{
+			this->DiamondStep(i, j, half, maxValue);
+		}
+	}
+}
 
-	if (matrixSize > 1)
+/*	PRIVATE
+*	It executes the square step of a level on the rows
+*	in [firstRow, endRow). The fine levels are computed a row
+*	at a time by SquareRow
+*		matrixSize: size of the squares of the level
+*		maxValue: random seed to use
+*		firstRow: first row of the range, multiple of matrixSize
+*		endRow: row after the last one of the range
+*/
+void SerialDiamondSquare::SquareRows(int matrixSize, int maxValue,
+	int firstRow, int endRow)
+{
+	int i, j;
+	int startIndex, endSquare;
+	int last = this->size - 1;
+	int half = matrixSize / 2;
+	for (i = firstRow; i < endRow; i += half)
 	{
-		//Diamond step
-		for (i = 0; i < last; i += matrixSize)
+		if (matrixSize <= FINE_LEVEL_SIZE)
 		{
-			for (j = 0; j < last; j += matrixSize)
-			{
-				this->DiamondStep(i, j, half, maxValue);
-			}
+			this->SquareRow(i, half, maxValue);
+			continue;
 		}
-		//Square step
-		for (i = 0; i < this->size; i += half)
+		if (i%matrixSize == 0)
 		{
-			if (i%matrixSize == 0)
-			{
-				startIndex = half;
-				endSquare = last;
-			}
-			else
+			startIndex = half;
+			endSquare = last;
+		}
+		else
+		{
+			startIndex = 0;
+			endSquare = this->size;
+		}
+		for (j = startIndex; j < endSquare; j += matrixSize)
+		{
+			this->SquareStep(i, j, half, maxValue);
+		}
+	}
+}
+
+/*	PRIVATE
+*	It computes all the levels from matrixSize down to 2 band by band.
+*	The matrix is split in bands of tileSize rows and the levels are
+*	pipelined as a wavefront: at each step the band b is computed at
+*	level k and the band b - 1 at level k + 1. A band at level k only
+*	needs the diamond cells of the band above at the same level (the
+*	halo row of its square step) and the cells of the first row of the
+*	band below at the previous level, so the result is the same of the
+*	level-ordered traversal while the working set is a few bands.
+*		matrixSize: size of the squares of the first level to compute,
+*			it has to be a divisor of tileSize
+*		maxValue: random seed of the first level to compute
+*/
+void SerialDiamondSquare::BlockedDiamondSquare(int matrixSize, int maxValue)
+{
+	int last = this->size - 1;
+	int bandCount = last / this->tileSize;
+	int levelCount = 0;
+	int step, level, band, firstRow, endRow;
+	for (step = matrixSize; step > 1; step /= 2)
+	{
+		levelCount++;
+	}
+	for (step = 0; step < bandCount + levelCount - 1; step++)
+	{
+		for (level = 0; level < levelCount; level++)
+		{
+			band = step - level;
+			if (band < 0 || band >= bandCount)
 			{
-				startIndex = 0;
-				endSquare = this->size;
+				continue;
 			}
-			for (j = startIndex; j < endSquare; j += matrixSize)
+			firstRow = band * this->tileSize;
+			endRow = band == bandCount - 1 ?
+				this->size : firstRow + this->tileSize;
+			this->DiamondRows(matrixSize >> level, maxValue >> level,
+				firstRow, endRow);
+			this->SquareRows(matrixSize >> level, maxValue >> level,
+				firstRow, endRow);
+			if (band == bandCount - 1)
 			{
-				this->SquareStep(i, j, half, maxValue);
+				// The level has been completed by all the bands
+				this->EmitPreview((matrixSize >> level) / 2);
 			}
 		}
-		this->DiamondSquare(half, maxValue / 2);
 	}
 }
 
@@ -84,9 +199,7 @@ void SerialDiamondSquare::DiamondStep(int row, int column,
 {
 	int target_r = row + adding;
 	int target_c = column + adding;
-	int max = maxValue / 2 > 1 ? maxValue / 2 : 1;
-	int min = -max;
-	int randomValue = min + rand() % (max - min);
+	int randomValue = this->RandomValue(target_r, target_c, maxValue);
 	int value = this->image[row*this->size + column] +
 		this->image[row*this->size + target_c + adding] +
 		this->image[(target_r + adding) * this->size + column] +
@@ -110,9 +223,7 @@ void SerialDiamondSquare::SquareStep(int row, int column,
 {
 	int value = 0;
 	int div = 0;
-	int max = maxValue / 2 > 1 ? maxValue / 2 : 1;
-	int min = -max;
-	int randomValue = min + rand() % (max - min);
+	int randomValue = this->RandomValue(row, column, maxValue);
 	if (row != 0)
 	{
 		value += this->image[(row - adding) * this->size + column];
@@ -11,23 +11,38 @@ uint8* SerialMMorphology::ExecuteOpeningOrClosing(bool isOpening)
 {
 	int32 size, width, height;
 	uint8 *redChannel, *greenChannel, *blueChannel;
-	uint8 *outRed, *outGreen, *outBlue;
+	uint8 *outRed, *outGreen, *outBlue, *output;
 	if (!this->input || !this->structElem.element)
 	{
 		return NULL;
 	}
-	width = this->input->SizeX + structElem.width-1;
+	switch (this->SelectKernel())
+	{
+	case MK_Auto:
+		return this->ExecuteTunedOpeningOrClosing(isOpening);
+	case MK_Pipeline:
+		return this->ExecutePipelineOpeningOrClosing(isOpening);
+	default:
+		break;
+	}
+	width = this->pitch;
 	height = this->input->SizeY + structElem.height-1;
 	size = width * height;
-	redChannel = (uint8*)malloc(sizeof(uint8)*size);
-	greenChannel = (uint8*)malloc(sizeof(uint8)*size);
-	blueChannel = (uint8*)malloc(sizeof(uint8)*size);
-	outRed = (uint8*)malloc(sizeof(uint8)*size);
-	outGreen = (uint8*)malloc(sizeof(uint8)*size);
-	outBlue = (uint8*)malloc(sizeof(uint8)*size);
+	redChannel = (uint8*)ImagePlane::Allocate(sizeof(uint8)*size);
+	greenChannel = (uint8*)ImagePlane::Allocate(sizeof(uint8)*size);
+	blueChannel = (uint8*)ImagePlane::Allocate(sizeof(uint8)*size);
+	outRed = (uint8*)ImagePlane::Allocate(sizeof(uint8)*size);
+	outGreen = (uint8*)ImagePlane::Allocate(sizeof(uint8)*size);
+	outBlue = (uint8*)ImagePlane::Allocate(sizeof(uint8)*size);
 	if (!redChannel || !greenChannel || !blueChannel
 		|| !outRed || !outGreen || !outBlue)
 	{
+		ImagePlane::Free(redChannel);
+		ImagePlane::Free(greenChannel);
+		ImagePlane::Free(blueChannel);
+		ImagePlane::Free(outRed);
+		ImagePlane::Free(outGreen);
+		ImagePlane::Free(outBlue);
 		return NULL;
 	}
 	if (isOpening)
@@ -60,10 +75,14 @@ uint8* SerialMMorphology::ExecuteOpeningOrClosing(bool isOpening)
 		this->ExecuteDilation(blueChannel, outBlue);
 		this->ExecuteErosion(outBlue, blueChannel);
 	}
-	free(outRed);
-	free(outGreen);
-	free(outBlue);
-	return this->ComposeImage(redChannel, greenChannel, blueChannel);
+	ImagePlane::Free(outRed);
+	ImagePlane::Free(outGreen);
+	ImagePlane::Free(outBlue);
+	output = this->ComposeImage(redChannel, greenChannel, blueChannel);
+	ImagePlane::Free(redChannel);
+	ImagePlane::Free(greenChannel);
+	ImagePlane::Free(blueChannel);
+	return output;
 }
 
 /*
@@ -90,19 +109,19 @@ void SerialMMorphology::SplitChannels(uint8* redChannel,
 			if (i < firstRow || i >= lastRow
 				|| j < firstCol || j >= lastCol)
 			{
-				redChannel[i*width + j] = ghost;
-				greenChannel[i*width + j] = ghost;
-				blueChannel[i*width + j] = ghost;
+				redChannel[i*this->pitch + j] = ghost;
+				greenChannel[i*this->pitch + j] = ghost;
+				blueChannel[i*this->pitch + j] = ghost;
 			}
 			else
 			{
-				redChannel[i*width + j] =
+				redChannel[i*this->pitch + j] =
 					colors[(i - firstRow)*this->input->SizeX
 					+ j - firstCol].R;
-				greenChannel[i*width + j] =
+				greenChannel[i*this->pitch + j] =
 					colors[(i - firstRow)*this->input->SizeX
 					+ j - firstCol].G;
-				blueChannel[i*width + j] =
+				blueChannel[i*this->pitch + j] =
 					colors[(i - firstRow)*this->input->SizeX
 					+ j - firstCol].B;
 			}
@@ -131,16 +150,17 @@ void SerialMMorphology::FillGhostCells(uint8* red, uint8* green,
 			if (i < halfHeight || i >= height - halfHeight
 				|| j < halfWidth || j >= width - halfWidth)
 			{
-				red[i*width + j] = value;
-				green[i*width + j] = value;
-				blue[i*width + j] = value;
+				red[i*this->pitch + j] = value;
+				green[i*this->pitch + j] = value;
+				blue[i*this->pitch + j] = value;
 			}
 		}
 	}
 }
 
 /*
-*	It composes the image using channels
+*	It composes the image using channels. If the first mip
+*	is enabled it is computed in the same pass
 *		redChannel: red channel
 *		greenChannel: green channel
 *		blueChannel: blue channel
@@ -156,7 +176,7 @@ uint8* SerialMMorphology::ComposeImage(uint8* redChannel,
 	int firstCol = (this->structElem.width - 1) / 2;
 	int lastRow = this->input->SizeY + firstRow;
 	int lastCol = this->input->SizeX + firstCol;
-	int width = this->input->SizeX + this->structElem.width-1;
+	int width = this->pitch;
 	int j = 0;
 	if(!output)
 	{
@@ -179,6 +199,12 @@ uint8* SerialMMorphology::ComposeImage(uint8* redChannel,
 			output[j] = ALPHA;
 			j++;
 		}
+		// The mip row is computed while the two rows are in cache
+		if (this->firstMip && ((i - firstRow) % 2 == 1
+			|| this->input->SizeY == 1))
+		{
+			this->DownsampleRows(output, (i - firstRow) / 2);
+		}
 	}
 	return output;
 }
@@ -191,11 +217,29 @@ uint8* SerialMMorphology::ComposeImage(uint8* redChannel,
 void SerialMMorphology::ExecuteErosion(
 	uint8* in, uint8* out)
 {
-	int width = this->input->SizeX + this->structElem.width-1;
+	int width = this->pitch;
 	int firstRow = (this->structElem.height - 1) / 2;
 	int firstCol = (this->structElem.width - 1) / 2;
 	int rowSize = this->input->SizeY + firstRow;
 	int colSize = this->input->SizeX + firstCol;
+	if (this->paraboloidCurvature > 0)
+	{
+		this->ExecuteParaboloid(in, out, true);
+		return;
+	}
+	if (this->isNonFlat)
+	{
+		for (int row = firstRow; row < rowSize; row++)
+		{
+			this->NonFlatErosionRow(in, out, row);
+		}
+		return;
+	}
+	if (this->isSeparable)
+	{
+		this->ExecuteSeparable(in, out, true);
+		return;
+	}
 	for (int row = firstRow; row < rowSize; row++)
 	{
 		for (int col = firstCol; col < colSize; col++)
@@ -223,11 +267,29 @@ void SerialMMorphology::ExecuteErosion(
 void SerialMMorphology::ExecuteDilation(
 	uint8* in, uint8* out)
 {
-	int width = this->input->SizeX + this->structElem.width-1;
+	int width = this->pitch;
 	int firstRow = (this->structElem.height - 1) / 2;
 	int firstCol = (this->structElem.width - 1) / 2;
 	int rowSize = this->input->SizeY + this->structElem.height / 2;
 	int colSize = this->input->SizeX + this->structElem.width / 2;
+	if (this->paraboloidCurvature > 0)
+	{
+		this->ExecuteParaboloid(in, out, false);
+		return;
+	}
+	if (this->isNonFlat)
+	{
+		for (int row = firstRow; row < rowSize; row++)
+		{
+			this->NonFlatDilationRow(in, out, row);
+		}
+		return;
+	}
+	if (this->isSeparable)
+	{
+		this->ExecuteSeparable(in, out, false);
+		return;
+	}
 	for (int row = firstRow; row < rowSize; row++)
 	{
 		for (int col = firstCol; col < colSize; col++)
@@ -245,4 +307,32 @@ void SerialMMorphology::ExecuteDilation(
 			out[row*width + col] = maxValue;
 		}
 	}
-}
\ No newline at end of file
+}
+
+/*	PRIVATE
+*	It executes erosion or dilation with the paraboloid element
+*	as a column pass followed by a row pass
+*		in: input channel
+*		out: output channel
+*		isErosion: true for erosion, false for dilation
+*/
+void SerialMMorphology::ExecuteParaboloid(uint8* in, uint8* out,
+	bool isErosion)
+{
+	int length = this->GetEnvelopeLength();
+	float* scratch = (float*)malloc(sizeof(float)*(3 * length + 1));
+	int* vertices = (int*)malloc(sizeof(int)*length);
+	if (scratch && vertices)
+	{
+		for (int col = 0; col < this->input->SizeX; col++)
+		{
+			this->ParaboloidColumn(in, col, isErosion, scratch, vertices);
+		}
+		for (int row = 0; row < this->input->SizeY; row++)
+		{
+			this->ParaboloidRow(out, row, isErosion, scratch, vertices);
+		}
+	}
+	free(scratch);
+	free(vertices);
+}
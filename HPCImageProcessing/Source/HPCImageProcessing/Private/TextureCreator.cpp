@@ -14,6 +14,50 @@ int UTextureCreator::sizeX = 0;
 //Height of the image
 int UTextureCreator::sizeY = 0;
 FImage* UTextureCreator::image = NULL;
+//Largest preview sent by a progressive execution
+int const UTextureCreator::maxPreviewSize = 1025;
+//Matrices sent by the progressive execution to the game thread
+TQueue<ProgressiveMatrix, EQueueMode::Mpsc> UTextureCreator::progressiveQueue;
+std::atomic<bool> UTextureCreator::isProgressiveRunning(false);
+//Pixels of the previews, reused by all the previews of the execution
+uint8* UTextureCreator::previewData = NULL;
+//True if the textures have to be created with all the mips
+bool UTextureCreator::generateMips = false;
+//Mips of the next texture, from the second one
+TArray<TArray<uint8>> UTextureCreator::mipChain;
+//First mip of the last texture, added to the result cache with the image
+TArray<uint8> UTextureCreator::textureFirstMip;
+//True if the gray values of the structuring element are weights
+bool UTextureCreator::nonFlatElement = false;
+//Radius of the paraboloid element, 0 to use the loaded element
+float UTextureCreator::paraboloidRadius = 0;
+//True to compute rectangular elements with separable passes
+bool UTextureCreator::separableElement = false;
+//Kernel of opening and closing, Fastest to use the autotuner
+KernelType UTextureCreator::morphologyKernel = KernelType::KT_Offsets;
+//Red, green and blue trees, NULL if not built
+ComponentTree* UTextureCreator::componentTrees[3] = { NULL, NULL, NULL };
+//Opening or closing kept between the edits of the image
+IncrementalMMorphology* UTextureCreator::incrementalMorphology = NULL;
+//Texture patched by the incremental updates
+UTexture2D* UTextureCreator::incrementalTexture = NULL;
+//Rectangles of the image written since the last update
+TArray<FIntRect> UTextureCreator::changedRegions;
+//Results of the previous operations, NULL if the cache is disabled
+ResultCache* UTextureCreator::resultCache = NULL;
+//Textures created from the cached results, until they are collected
+TMap<uint64, TWeakObjectPtr<UTexture2D>> UTextureCreator::cachedTextures;
+//Cached result used as image data, kept while it is shown
+TSharedPtr<CachedResult> UTextureCreator::shownResult;
+//Hash of the pixels of the loaded image
+uint64 UTextureCreator::imageHash = 0;
+bool UTextureCreator::isImageHashValid = false;
+//Seed of the procedural textures, 0 for a new seed each time
+int UTextureCreator::terrainSeed = 0;
+//Rows of a tile of the serial diamond-square, 0 to disable the tiles
+int UTextureCreator::terrainTileSize = DEFAULT_TILE_SIZE;
+//Server of the jobs of other processes, NULL if not started
+ProcessingDaemon* UTextureCreator::daemon = NULL;
 
 /* 
 *	It creates the procedural texture using the selected algorithm
@@ -27,74 +71,1261 @@ UTexture2D* UTextureCreator::CreateProceduralTexture
 (ImplementationType implementationType, int matrixSize, int threadNumber, float &executionTime)
 {
 	uint8* matrix = NULL;
-	DiamondSquareAlgorithm *implementation = NULL;
+	DiamondSquareAlgorithm *implementation;
 	UTexture2D* texture = NULL;
 	clock_t start, end;
-	int textureSize = sizeof(uint8)*matrixSize*matrixSize * 4;
-	switch (implementationType)
+	// Only terrains with a given seed can be computed again
+	uint64 key = 0;
+	if (UTextureCreator::resultCache && UTextureCreator::terrainSeed != 0)
+	{
+		key = ResultCache::CombineHash(ResultCache::CombineHash(
+			ResultCache::CombineHash(ResultCache::CombineHash(0,
+			implementationType), matrixSize), (uint32)UTextureCreator::terrainSeed),
+			UTextureCreator::generateMips);
+		start = clock();
+		texture = UTextureCreator::FindCachedTexture(key);
+		end = clock();
+		if (texture)
+		{
+			executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+			return texture;
+		}
+	}
+	implementation = UTextureCreator::CreateDiamondSquare(
+		implementationType, matrixSize, threadNumber);
+	if (UTextureCreator::terrainSeed != 0)
+	{
+		implementation->SetSeed((uint32)UTextureCreator::terrainSeed);
+	}
+	start = clock();
+	matrix = implementation->ExecuteDiamondSquare();
+	end = clock();
+	executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+	if (matrix)
+	{
+		UTextureCreator::sizeX = matrixSize;
+		UTextureCreator::sizeY = matrixSize;
+		texture = UTextureCreator::CreateChannels(matrix);
+		if (key != 0)
+		{
+			UTextureCreator::CacheTexture(key, texture);
+		}
+	}
+	delete implementation;
+	UTextureCreator::CreateImageInfo();
+	return texture;
+}
+
+/*
+*	It starts the diamond-square algorithm in a background thread.
+*	Every levelInterval levels a downsampled view of the matrix is sent
+*	to the game thread, that gets it with GetProgressiveTexture.
+*	It returns false if a progressive execution is already running
+*		implementationType: the algorithm we want to use
+*		size: the length of the matrix row/column
+*		threadNumber: the number of thread we want to use in a OpenMP
+*			implementation
+*		levelInterval: number of levels between two views
+*/
+bool UTextureCreator::StartProgressiveTexture(
+	ImplementationType implementationType, int matrixSize,
+	int threadNumber, int levelInterval)
+{
+	if (UTextureCreator::isProgressiveRunning.exchange(true))
+	{
+		return false;
+	}
+	Async<void>(EAsyncExecution::Thread, [=]()
+	{
+		ProgressiveMatrix result;
+		clock_t start, end;
+		DiamondSquareAlgorithm *implementation = UTextureCreator::
+			CreateDiamondSquare(implementationType, matrixSize, threadNumber);
+		implementation->SetPreviewCallback([](const uint8* preview,
+			int previewSize, int step)
+		{
+			ProgressiveMatrix view;
+			view.size = previewSize;
+			view.isFinal = false;
+			view.executionTime = 0;
+			view.matrix = (uint8*)malloc(sizeof(uint8)*previewSize*previewSize);
+			if (view.matrix)
+			{
+				FMemory::Memcpy(view.matrix, preview, previewSize*previewSize);
+				UTextureCreator::progressiveQueue.Enqueue(view);
+			}
+		}, levelInterval, UTextureCreator::maxPreviewSize);
+		start = clock();
+		result.matrix = implementation->ExecuteDiamondSquare();
+		end = clock();
+		result.executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+		result.size = matrixSize;
+		result.isFinal = true;
+		if (result.matrix)
+		{
+			// The matrix is freed with the implementation
+			uint8* matrix = (uint8*)malloc(sizeof(uint8)*matrixSize*matrixSize);
+			if (matrix)
+			{
+				FMemory::Memcpy(matrix, result.matrix, matrixSize*matrixSize);
+			}
+			result.matrix = matrix;
+		}
+		delete implementation;
+		UTextureCreator::progressiveQueue.Enqueue(result);
+	});
+	return true;
+}
+
+/*
+*	It returns the texture of the last matrix sent by the progressive
+*	execution, NULL if no matrix has been sent since the last call.
+*	It has to be called by the game thread, for example on tick
+*		isFinished: true if the texture is the final result
+*		executionTime: time the algorithm takes to produce the
+*			final matrix
+*/
+UTexture2D* UTextureCreator::GetProgressiveTexture(bool &isFinished,
+	float &executionTime)
+{
+	ProgressiveMatrix view, last;
+	UTexture2D* texture = NULL;
+	bool found = false;
+	isFinished = false;
+	// Only the most recent matrix is shown
+	while (UTextureCreator::progressiveQueue.Dequeue(view))
+	{
+		if (found)
+		{
+			free(last.matrix);
+		}
+		last = view;
+		found = true;
+	}
+	if (!found)
+	{
+		return NULL;
+	}
+	if (last.matrix && last.isFinal)
+	{
+		UTextureCreator::sizeX = last.size;
+		UTextureCreator::sizeY = last.size;
+		texture = UTextureCreator::CreateChannels(last.matrix);
+	}
+	else if (last.matrix)
+	{
+		texture = UTextureCreator::CreatePreviewTexture(last.matrix,
+			last.size);
+	}
+	free(last.matrix);
+	if (last.isFinal)
+	{
+		isFinished = true;
+		executionTime = last.executionTime;
+		UTextureCreator::CreateImageInfo();
+		UTextureCreator::isProgressiveRunning = false;
+		free(UTextureCreator::previewData);
+		UTextureCreator::previewData = NULL;
+	}
+	return texture;
+}
+
+/*	PRIVATE
+*	It creates the texture of a preview in previewData. The fields
+*	of the image are restored, so the previews do not replace it
+*		matrix: matrix of the preview
+*		size: the length of the matrix row/column
+*/
+UTexture2D* UTextureCreator::CreatePreviewTexture(const uint8* matrix,
+	int size)
+{
+	UTexture2D* texture;
+	uint8* data = UTextureCreator::imageData;
+	int32 dataSize = UTextureCreator::imageSize;
+	int width = UTextureCreator::sizeX;
+	int height = UTextureCreator::sizeY;
+	// The previews are never larger than maxPreviewSize
+	if (!UTextureCreator::previewData)
+	{
+		UTextureCreator::previewData = (uint8*)malloc(sizeof(uint8)*
+			UTextureCreator::maxPreviewSize*UTextureCreator::maxPreviewSize
+			*CHANNELS);
+	}
+	if (!UTextureCreator::previewData || size > UTextureCreator::maxPreviewSize)
+	{
+		return NULL;
+	}
+	UTextureCreator::imageData = UTextureCreator::previewData;
+	UTextureCreator::imageSize = size * size * CHANNELS;
+	UTextureCreator::sizeX = size;
+	UTextureCreator::sizeY = size;
+	texture = UTextureCreator::WriteChannels(matrix);
+	UTextureCreator::imageData = data;
+	UTextureCreator::imageSize = dataSize;
+	UTextureCreator::sizeX = width;
+	UTextureCreator::sizeY = height;
+	return texture;
+}
+
+/*
+*	It computes a heightmap with the serial diamond-square
+*	algorithm and returns an 8-bit copy used as preview
+*		generator: the generator of the heightmap
+*		scale: value that maps a sample to [0, 256)
+*		executionTime: time the algorithm takes to produce the matrix
+*		heightmap: computed heightmap
+*/
+template <typename SampleType>
+static uint8* GenerateHeightmap(THeightmapDiamondSquare<SampleType>& generator,
+	float scale, float &executionTime, SampleType* &heightmap)
+{
+	clock_t start, end;
+	int64 matrixSize = (int64)generator.GetSize() * generator.GetSize();
+	uint8* preview = NULL;
+	start = clock();
+	heightmap = generator.ExecuteDiamondSquare();
+	end = clock();
+	executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+	if (heightmap)
+	{
+		preview = (uint8*)malloc(sizeof(uint8)*matrixSize);
+	}
+	if (preview)
+	{
+		for (int64 i = 0; i < matrixSize; i++)
+		{
+			preview[i] = (uint8)(heightmap[i] * scale);
+		}
+	}
+	return preview;
+}
+
+/*
+*	It creates a 16-bit or float heightmap, saves it in the output
+*	folder (R16 PNG or raw floats) and returns its 8-bit preview texture
+*		format: sample type of the heightmap
+*		size: the length of the matrix row/column
+*		executionTime: time the algorithm takes to produce the matrix
+*		memoryFootprint: megabytes used by the heightmap matrix
+*		isSaved: false if the heightmap could not be written to the file
+*/
+UTexture2D* UTextureCreator::CreateHeightmap(HeightmapFormat format,
+	int matrixSize, float &executionTime, float &memoryFootprint,
+	bool &isSaved)
+{
+	uint8* preview = NULL;
+	UTexture2D* texture = NULL;
+	if (format == HeightmapFormat::HF_R16)
+	{
+		uint16* heightmap = NULL;
+		THeightmapDiamondSquare<uint16> generator(matrixSize);
+		memoryFootprint = generator.GetMemoryFootprint(matrixSize)
+			/ (1024.0f * 1024.0f);
+		preview = GenerateHeightmap(generator, 1.0f / 256.0f,
+			executionTime, heightmap);
+		isSaved = UTextureUtilities::SaveToR16PNG(heightmap, matrixSize,
+			matrixSize, "DiamondSquare16");
+	}
+	else
+	{
+		float* heightmap = NULL;
+		THeightmapDiamondSquare<float> generator(matrixSize);
+		memoryFootprint = generator.GetMemoryFootprint(matrixSize)
+			/ (1024.0f * 1024.0f);
+		preview = GenerateHeightmap(generator, 255.0f,
+			executionTime, heightmap);
+		isSaved = UTextureUtilities::SaveToRawFloat(heightmap, matrixSize,
+			matrixSize, "DiamondSquareFloat");
+	}
+	if (preview)
+	{
+		UTextureCreator::sizeX = matrixSize;
+		UTextureCreator::sizeY = matrixSize;
+		texture = UTextureCreator::CreateChannels(preview);
+		free(preview);
+	}
+	UTextureCreator::CreateImageInfo();
+	return texture;
+}
+
+/*
+*	It sets if the textures have to be created with the complete mip
+*	chain. Mips are computed while the image is produced: diamond-square
+*	textures take the cells computed by the coarse levels and
+*	mathematical morphology textures box-filter the output while
+*	composing it
+*		generate: true if the mips have to be created
+*/
+void UTextureCreator::SetGenerateMips(bool generate)
+{
+	UTextureCreator::generateMips = generate;
+}
+
+/*
+*	It enables huge pages for the planes of the morphology operations
+*	of at least 2 MB, on the platforms that support them
+*		enable: true to enable huge pages
+*/
+void UTextureCreator::SetHugePages(bool enable)
+{
+	ImagePlane::SetHugePages(enable);
+}
+
+/*
+*	It enables the cache of the results of ExecuteMMOperation and of
+*	CreateProceduralTexture with a terrain seed: an operation executed
+*	again on the same pixels with the same parameters returns the
+*	texture it created, or a new texture of the cached result
+*		memoryBudget: megabytes of results kept in memory,
+*			0 to disable the cache
+*		spillToDisk: true to write the results removed from memory
+*			in the saved directory of the project
+*/
+void UTextureCreator::SetResultCache(int memoryBudget, bool spillToDisk)
+{
+	delete UTextureCreator::resultCache;
+	UTextureCreator::resultCache = NULL;
+	UTextureCreator::cachedTextures.Empty();
+	if (memoryBudget > 0)
+	{
+		UTextureCreator::resultCache = new ResultCache(
+			(int64)memoryBudget * 1024 * 1024, spillToDisk ?
+			FPaths::ProjectSavedDir() / TEXT("ResultCache") : FString());
+	}
+}
+
+/*
+*	It returns the counters of the result cache
+*		hits: results found in memory or on disk
+*		misses: results that were not found
+*		spillHits: results read from disk
+*		usedMemory: megabytes of results in memory
+*/
+void UTextureCreator::GetResultCacheStatistics(int &hits, int &misses,
+	int &spillHits, float &usedMemory)
+{
+	ResultCache* cache = UTextureCreator::resultCache;
+	hits = cache ? cache->GetHits() : 0;
+	misses = cache ? cache->GetMisses() : 0;
+	spillHits = cache ? cache->GetSpillHits() : 0;
+	usedMemory = cache ? cache->GetUsedMemory() / (1024.0f * 1024.0f) : 0;
+}
+
+/*
+*	It starts the daemon that executes the jobs sent by other
+*	processes on a Unix domain socket. A running daemon is stopped.
+*	It returns false if the socket cannot be created
+*		socketPath: file of the socket
+*		workerCount: number of jobs executed at the same time
+*		queueCapacity: number of jobs that can wait, the next ones
+*			are refused
+*		memoryBudget: megabytes of results kept by the daemon
+*/
+bool UTextureCreator::StartDaemon(FString socketPath, int workerCount,
+	int queueCapacity, int memoryBudget)
+{
+	UTextureCreator::StopDaemon();
+	UTextureCreator::daemon = new ProcessingDaemon(socketPath, workerCount,
+		queueCapacity, (int64)memoryBudget * 1024 * 1024);
+	if (!UTextureCreator::daemon->Start())
+	{
+		UTextureCreator::StopDaemon();
+		return false;
+	}
+	return true;
+}
+
+/*
+*	It stops the daemon, waiting for the running jobs
+*/
+void UTextureCreator::StopDaemon()
+{
+	delete UTextureCreator::daemon;
+	UTextureCreator::daemon = NULL;
+}
+
+/*
+*	It returns the counters of the daemon
+*		queueDepth: jobs waiting for a worker
+*		runningJobs: jobs being executed
+*		completedJobs: jobs completed
+*		rejectedJobs: jobs refused because the queue was full
+*		averageLatency: average milliseconds from request to reply
+*		maxLatency: maximum milliseconds from request to reply
+*/
+void UTextureCreator::GetDaemonStatistics(int &queueDepth, int &runningJobs,
+	int &completedJobs, int &rejectedJobs, float &averageLatency,
+	float &maxLatency)
+{
+	DaemonStatistics statistics = DaemonStatistics();
+	if (UTextureCreator::daemon)
+	{
+		statistics = UTextureCreator::daemon->GetStatistics();
+	}
+	queueDepth = statistics.queueDepth;
+	runningJobs = statistics.runningJobs;
+	completedJobs = statistics.completedJobs;
+	rejectedJobs = statistics.rejectedJobs;
+	averageLatency = statistics.averageLatency * 1000;
+	maxLatency = statistics.maxLatency * 1000;
+}
+
+/*
+*	It sets the seed of the procedural textures, so the same
+*	texture can be created again
+*		seed: the seed to use, 0 for a new seed each time
+*/
+void UTextureCreator::SetTerrainSeed(int seed)
+{
+	UTextureCreator::terrainSeed = seed;
+}
+
+/*
+*	It sets the rows of a tile of the serial diamond-square: the
+*	fine levels are computed tile by tile while the rows are in
+*	cache. The texture does not change
+*		tileSize: a power of two, 0 to compute the levels one at a time
+*/
+void UTextureCreator::SetTerrainTileSize(int tileSize)
+{
+	UTextureCreator::terrainTileSize = tileSize;
+}
+
+/*
+*	It sets if the structuring element is non-flat: the gray value
+*	of each pixel is added in dilation and subtracted in erosion
+*		nonFlat: true if the element is non-flat
+*/
+void UTextureCreator::SetNonFlatElement(bool nonFlat)
+{
+	UTextureCreator::nonFlatElement = nonFlat;
+}
+
+/*
+*	It sets the radius of the paraboloid structuring element used
+*	for rolling-ball background subtraction. Its cost does not depend
+*	on the radius. The CUDA version uses the loaded element
+*		radius: radius of the ball, 0 to use the loaded element
+*/
+void UTextureCreator::SetParaboloidRadius(float radius)
+{
+	UTextureCreator::paraboloidRadius = radius;
+}
+
+/*
+*	It sets if rectangular structuring elements are computed with
+*	separable passes on the rows and on the transposed image.
+*	The result does not change. The CUDA version ignores it
+*		separable: true to use the separable passes, false to use
+*		the kernel set by ForceMorphologyKernel
+*/
+void UTextureCreator::SetSeparableElement(bool separable)
+{
+	UTextureCreator::separableElement = separable;
+}
+
+/*
+*	It sets the kernel of opening and closing of the Serial and
+*	OpenMP versions, Offsets by default. Fastest uses the one measured
+*	by the autotuner; the kernels of a new case are measured before
+*	the timed execution
+*		kernel: the kernel
+*/
+void UTextureCreator::ForceMorphologyKernel(KernelType kernel)
+{
+	UTextureCreator::morphologyKernel = kernel;
+}
+
+/*
+*	It removes the kernels measured by the autotuner, so they are
+*	measured again by the next operations
+*/
+void UTextureCreator::ResetMorphologyProfile()
+{
+	MorphologyAutotuner::Empty();
+}
+
+/* 
+*	It loads the image from file and creates the texture to show
+*/
+UTexture2D* UTextureCreator::LoadImage()
+{
+	TArray<FString> files = UTextureUtilities::OpenFileDialog();
+	TArray<uint8> firstMip;
+	if (files.IsValidIndex(0))
+	{
+		// The first mip is computed while the image is decoded
+		UTextureCreator::image = UTextureUtilities::LoadImageFromFile(files[0],
+			UTextureCreator::generateMips ? &firstMip : NULL);
+		if (!UTextureCreator::image)
+		{
+			return NULL;
+		}
+		UTextureCreator::sizeX = image->SizeX;
+		UTextureCreator::sizeY = image->SizeY;
+		UTextureCreator::imageData = image->RawData.GetData();
+		UTextureCreator::imageSize = image->RawData.Num();
+		UTextureCreator::FreeComponentTrees();
+		UTextureCreator::FreeIncrementalMMorphology();
+		UTextureCreator::isImageHashValid = false;
+		UTextureCreator::mipChain.Empty();
+		if (UTextureCreator::generateMips)
+		{
+			UTextureCreator::AllocateMipChain();
+			if (UTextureCreator::mipChain.Num() > 0)
+			{
+				UTextureCreator::mipChain[0] = MoveTemp(firstMip);
+			}
+			UTextureCreator::FillMipChain(2);
+		}
+		return UTextureCreator::CreateTexture();
+	}
+	return NULL;
+}
+
+/*
+*	It creates the texture as result of mathematical morphology 
+*	operations using the selected algorithm version
+*		implementationType: the algorithm we want to use
+*		threadNumber: the number of thread we want to use in a OpenMP
+*			implementation
+*		executionTime: time the algorithm takes to produce the matrix
+*		isOpening: true if we want to execute an opening
+*		structElemSize: size of the structuring element
+*/
+UTexture2D* UTextureCreator::ExecuteMMOperation(
+	ImplementationType implementationType, int threadNumber,
+	float &executionTime, bool isOpening, int structElemSize)
+{
+	uint8* output = NULL;
+	UTexture2D* texture;
+	clock_t start, end;
+	MathematicalMorphology* implementation;
+	uint64 key = 0;
+	uint32 radiusBits;
+	if (UTextureCreator::resultCache && UTextureCreator::image)
+	{
+		start = clock();
+		key = UTextureCreator::GetImageHash();
+		key = ResultCache::CombineHash(key, implementationType);
+		key = ResultCache::CombineHash(key, isOpening);
+		key = ResultCache::CombineHash(key, structElemSize);
+		key = ResultCache::CombineHash(key, UTextureCreator::nonFlatElement);
+		// The bits of the radius are copied, as the cast would break aliasing
+		FMemory::Memcpy(&radiusBits, &UTextureCreator::paraboloidRadius,
+			sizeof(radiusBits));
+		key = ResultCache::CombineHash(key, radiusBits);
+		key = ResultCache::CombineHash(key, UTextureCreator::generateMips);
+		texture = UTextureCreator::FindCachedTexture(key);
+		end = clock();
+		if (texture)
+		{
+			executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+			return texture;
+		}
+	}
+	implementation = UTextureCreator::CreateMMorphology(implementationType,
+		threadNumber, structElemSize);
+	if (!implementation)
+	{
+		return NULL;
+	}
+	implementation->SetNonFlat(UTextureCreator::nonFlatElement);
+	implementation->SetParaboloidElement(UTextureCreator::paraboloidRadius);
+	// The CUDA version has a single kernel
+	if (implementationType != ImplementationType::IT_Cuda)
+	{
+		implementation->SetKernel(UTextureCreator::separableElement ?
+			MK_Separable : (MorphologyKernel)UTextureCreator::morphologyKernel);
+		// Only the selected kernel is timed
+		implementation->TuneKernel(isOpening);
+	}
+	start = clock();
+	output = implementation->ExecuteOpeningOrClosing(isOpening);
+	end = clock();
+	executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+	texture = UTextureCreator::CreateMMTexture(implementation, output);
+	if (key != 0)
+	{
+		UTextureCreator::CacheTexture(key, texture);
+	}
+	return texture;
+}
+
+/*
+*	It creates the texture as result of path opening or closing,
+*	that keeps thin curvilinear structures in every direction.
+*	The CUDA version executes the serial one
+*		implementationType: the algorithm we want to use
+*		threadNumber: the number of thread we want to use in a OpenMP
+*			implementation
+*		executionTime: time the algorithm takes to produce the matrix
+*		isOpening: true if we want to execute an opening
+*		pathLength: minimum length of the paths in pixels
+*/
+UTexture2D* UTextureCreator::ExecutePathOperation(
+	ImplementationType implementationType, int threadNumber,
+	float &executionTime, bool isOpening, int pathLength)
+{
+	uint8* output = NULL;
+	clock_t start, end;
+	// The structuring element is not used by path operations
+	MathematicalMorphology* implementation =
+		UTextureCreator::CreateMMorphology(implementationType,
+			threadNumber, 0);
+	if (!implementation)
+	{
+		return NULL;
+	}
+	start = clock();
+	output = implementation->ExecutePathOpeningOrClosing(isOpening,
+		pathLength);
+	end = clock();
+	executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+	return UTextureCreator::CreateMMTexture(implementation, output);
+}
+
+/*
+*	It creates the texture as result of binary opening or closing
+*	by a disk, computed with the distance transform of each channel,
+*	or the distance map itself. The CUDA version executes the serial one
+*		implementationType: the algorithm we want to use
+*		threadNumber: the number of thread we want to use in a OpenMP
+*			implementation
+*		executionTime: time the algorithm takes to produce the matrix
+*		isOpening: true if we want to execute an opening
+*		radius: radius of the disk in pixels
+*		isDistanceMap: true to create the distance map
+*/
+UTexture2D* UTextureCreator::ExecuteDiskOperation(
+	ImplementationType implementationType, int threadNumber,
+	float &executionTime, bool isOpening, float radius, bool isDistanceMap)
+{
+	uint8* output = NULL;
+	clock_t start, end;
+	// The structuring element is not used by disk operations
+	MathematicalMorphology* implementation =
+		UTextureCreator::CreateMMorphology(implementationType,
+			threadNumber, 0);
+	if (!implementation)
+	{
+		return NULL;
+	}
+	start = clock();
+	output = isDistanceMap ? implementation->ExecuteDistanceMap() :
+		implementation->ExecuteDiskOpeningOrClosing(isOpening, radius);
+	end = clock();
+	executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+	return UTextureCreator::CreateMMTexture(implementation, output);
+}
+
+/*
+*	It creates the texture as result of vector opening or closing:
+*	colours are ordered as a whole instead of channel by channel, so
+*	no false colour is created at the edges. The CUDA version executes
+*	the serial one
+*		implementationType: the algorithm we want to use
+*		threadNumber: the number of thread we want to use in a OpenMP
+*			implementation
+*		executionTime: time the algorithm takes to produce the matrix
+*		isOpening: true if we want to execute an opening
+*		structElemSize: the size of the structuring element
+*/
+UTexture2D* UTextureCreator::ExecuteVectorMMOperation(
+	ImplementationType implementationType, int threadNumber,
+	float &executionTime, bool isOpening, int structElemSize)
+{
+	uint8* output = NULL;
+	clock_t start, end;
+	MathematicalMorphology* implementation =
+		UTextureCreator::CreateMMorphology(implementationType,
+			threadNumber, structElemSize);
+	if (!implementation)
+	{
+		return NULL;
+	}
+	start = clock();
+	output = implementation->ExecuteVectorOpeningOrClosing(isOpening);
+	end = clock();
+	executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+	return UTextureCreator::CreateMMTexture(implementation, output);
+}
+
+/*
+*	It creates the texture as result of a rank filter: each pixel
+*	takes the value at a percentile of the window of the element,
+*	50 for the median. The CUDA version executes the serial one
+*		implementationType: the algorithm we want to use
+*		threadNumber: the number of thread we want to use in a OpenMP
+*			implementation
+*		executionTime: time the algorithm takes to produce the matrix
+*		percentile: percentile of the window, from 0 to 100
+*		structElemSize: the size of the structuring element
+*/
+UTexture2D* UTextureCreator::ExecuteRankFilterOperation(
+	ImplementationType implementationType, int threadNumber,
+	float &executionTime, float percentile, int structElemSize)
+{
+	uint8* output = NULL;
+	clock_t start, end;
+	MathematicalMorphology* implementation =
+		UTextureCreator::CreateMMorphology(implementationType,
+			threadNumber, structElemSize);
+	if (!implementation)
+	{
+		return NULL;
+	}
+	start = clock();
+	output = implementation->ExecuteRankFilter(percentile);
+	end = clock();
+	executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+	return UTextureCreator::CreateMMTexture(implementation, output);
+}
+
+/*
+*	It creates the texture as result of area opening or closing:
+*	bright (opening) or dark (closing) components smaller than minArea
+*	pixels are removed. The component trees of the loaded image are
+*	built once and kept, so a new area only needs a linear pass.
+*	The CUDA version builds the trees serially
+*		implementationType: the algorithm we want to use
+*		threadNumber: the number of thread we want to use in a OpenMP
+*			implementation
+*		executionTime: time the algorithm takes to produce the matrix
+*		isOpening: true if we want to execute an opening
+*		minArea: minimum area of the components to keep
+*/
+UTexture2D* UTextureCreator::ExecuteAreaOperation(
+	ImplementationType implementationType, int threadNumber,
+	float &executionTime, bool isOpening, int minArea)
+{
+	UTexture2D* texture = NULL;
+	uint8 *planes, *output;
+	int size, row, i;
+	clock_t start, end;
+	if (!UTextureCreator::image)
+	{
+		return NULL;
+	}
+	UTextureCreator::sizeX = UTextureCreator::image->SizeX;
+	UTextureCreator::sizeY = UTextureCreator::image->SizeY;
+	size = UTextureCreator::sizeX * UTextureCreator::sizeY;
+	planes = (uint8*)malloc(sizeof(uint8) * 3 * size);
+	output = (uint8*)malloc(sizeof(uint8) * size * CHANNELS);
+	start = clock();
+	if (planes && output && UTextureCreator::BuildComponentTrees(
+		implementationType == ImplementationType::IT_OpenMP ?
+		threadNumber : 1, isOpening))
+	{
+		for (i = 0; i < 3; i++)
+		{
+			UTextureCreator::componentTrees[i]->AreaFilter(minArea,
+				planes + i * size);
+		}
+		UTextureCreator::mipChain.Empty();
+		if (UTextureCreator::generateMips)
+		{
+			UTextureCreator::AllocateMipChain();
+		}
+		for (row = 0; row < UTextureCreator::sizeY; row++)
+		{
+			for (i = row * sizeX; i < (row + 1) * sizeX; i++)
+			{
+				output[i*CHANNELS] = planes[2 * size + i];
+				output[i*CHANNELS + 1] = planes[size + i];
+				output[i*CHANNELS + 2] = planes[i];
+				output[i*CHANNELS + 3] = ALPHA;
+			}
+			UTextureCreator::DownsampleWrittenRow(output, row);
+		}
+		end = clock();
+		executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+		UTextureCreator::imageData = output;
+		UTextureCreator::imageSize = size * CHANNELS;
+		UTextureCreator::FillMipChain(2);
+		texture = UTextureCreator::CreateTexture();
+		UTextureCreator::CreateImageInfo();
+	}
+	else
 	{
-	case ImplementationType::IT_Serial:
-		implementation = new SerialDiamondSquare(matrixSize);
-		break;
-	case ImplementationType::IT_OpenMP:
-		implementation = new OpenMPDiamondSquare(matrixSize, threadNumber);
-		break;
-	case ImplementationType::IT_Cuda:
-		implementation = new CudaDiamondSquare(matrixSize);
-		break;
-	default:
-		break;
+		free(output);
+	}
+	free(planes);
+	return texture;
+}
+
+/*
+*	It creates the texture as result of the marker-controlled
+*	watershed of the loaded image, which is used as gradient (the
+*	highest of its channels), for example the difference between a
+*	dilation and an erosion. Markers are the pixels of the gradient
+*	up to markerLevel, such as the dark zones left by a closing.
+*	Each region gets a color from its label and the boundaries between
+*	regions are white. The CUDA version executes the serial one
+*		implementationType: the algorithm we want to use
+*		threadNumber: the number of thread we want to use in a OpenMP
+*			implementation
+*		executionTime: time the algorithm takes to produce the matrix
+*		megapixelsPerSecond: millions of pixels computed per second
+*		markerLevel: highest gradient value of the markers
+*/
+UTexture2D* UTextureCreator::ExecuteWatershedOperation(
+	ImplementationType implementationType, int threadNumber,
+	float &executionTime, float &megapixelsPerSecond, int markerLevel)
+{
+	UTexture2D* texture = NULL;
+	uint8 *gradient, *markers, *output;
+	FColor* colors;
+	int size, row, i;
+	if (!UTextureCreator::image)
+	{
+		return NULL;
+	}
+	UTextureCreator::sizeX = UTextureCreator::image->SizeX;
+	UTextureCreator::sizeY = UTextureCreator::image->SizeY;
+	size = UTextureCreator::sizeX * UTextureCreator::sizeY;
+	colors = UTextureCreator::image->AsBGRA8();
+	gradient = (uint8*)malloc(sizeof(uint8)*size);
+	markers = (uint8*)malloc(sizeof(uint8)*size);
+	output = (uint8*)malloc(sizeof(uint8) * size * CHANNELS);
+	Watershed watershed(UTextureCreator::sizeX, UTextureCreator::sizeY);
+	if (gradient && markers && output)
+	{
+		for (i = 0; i < size; i++)
+		{
+			uint8 value = colors[i].R > colors[i].G ? colors[i].R : colors[i].G;
+			gradient[i] = value > colors[i].B ? value : colors[i].B;
+			markers[i] = gradient[i] <= markerLevel ? FOREGROUND : BLACK;
+		}
+	}
+	if (gradient && markers && output && watershed.Compute(gradient, markers,
+		implementationType == ImplementationType::IT_OpenMP ?
+		threadNumber : 1))
+	{
+		executionTime = watershed.GetExecutionTime();
+		megapixelsPerSecond = watershed.GetMegapixelsPerSecond();
+		UTextureCreator::mipChain.Empty();
+		if (UTextureCreator::generateMips)
+		{
+			UTextureCreator::AllocateMipChain();
+		}
+		for (row = 0; row < UTextureCreator::sizeY; row++)
+		{
+			for (i = row * sizeX; i < (row + 1) * sizeX; i++)
+			{
+				// Pixels without a marker stay black
+				uint32 color = watershed.GetLabel(i) * 2654435761u;
+				bool isBoundary = watershed.IsBoundary(i);
+				output[i*CHANNELS] = isBoundary ? WHITE : (color >> 8) & 0xFF;
+				output[i*CHANNELS + 1] = isBoundary ? WHITE : (color >> 16) & 0xFF;
+				output[i*CHANNELS + 2] = isBoundary ? WHITE : (color >> 24) & 0xFF;
+				output[i*CHANNELS + 3] = ALPHA;
+			}
+			UTextureCreator::DownsampleWrittenRow(output, row);
+		}
+		UTextureCreator::imageData = output;
+		UTextureCreator::imageSize = size * CHANNELS;
+		UTextureCreator::FillMipChain(2);
+		texture = UTextureCreator::CreateTexture();
+		UTextureCreator::CreateImageInfo();
+	}
+	else
+	{
+		free(output);
+	}
+	free(gradient);
+	free(markers);
+	return texture;
+}
+
+/*
+*	It creates the texture as result of a chain of operations, each
+*	one applied to the result of the previous one. The chain is
+*	executed as a pipeline, so the image is split and composed once
+*		threadNumber: the number of thread to use
+*		executionTime: time the algorithm takes to produce the matrix
+*		operations: operations as name and size of the structuring
+*			element, for example "close 5", "open 11", "gradient 3".
+*			Names are erode, dilate, open, close and gradient
+*/
+UTexture2D* UTextureCreator::ExecuteMMPipeline(int threadNumber,
+	float &executionTime, const TArray<FString>& operations)
+{
+	const FString names[] = { TEXT("erode"), TEXT("dilate"), TEXT("open"),
+		TEXT("close"), TEXT("gradient") };
+	const PipelineOperation types[] = { PO_Erosion, PO_Dilation, PO_Opening,
+		PO_Closing, PO_Gradient };
+	UTexture2D* texture = NULL;
+	uint8* output = NULL;
+	clock_t start, end;
+	int node, i, k;
+	if (!UTextureCreator::image)
+	{
+		return NULL;
+	}
+	UTextureCreator::sizeX = UTextureCreator::image->SizeX;
+	UTextureCreator::sizeY = UTextureCreator::image->SizeY;
+	MorphologyPipeline pipeline(UTextureCreator::image, threadNumber);
+	node = pipeline.GetSource();
+	for (i = 0; i < operations.Num() && node >= 0; i++)
+	{
+		TArray<FString> words;
+		operations[i].ParseIntoArrayWS(words);
+		for (k = 0; k < 5 && words.Num() == 2; k++)
+		{
+			if (words[0].Equals(names[k], ESearchCase::IgnoreCase))
+			{
+				break;
+			}
+		}
+		node = k < 5 && words.Num() == 2 ? pipeline.AddOperation(types[k],
+			FCString::Atoi(*words[1]), node) : -1;
+	}
+	if (node < 0)
+	{
+		return NULL;
+	}
+	UTextureCreator::mipChain.Empty();
+	if (UTextureCreator::generateMips)
+	{
+		UTextureCreator::AllocateMipChain();
 	}
 	start = clock();
-	matrix = implementation->ExecuteDiamondSquare();
+	output = pipeline.Execute(node, UTextureCreator::mipChain.Num() > 0 ?
+		UTextureCreator::mipChain[0].GetData() : NULL);
 	end = clock();
 	executionTime = (double)(end - start) / CLOCKS_PER_SEC;
-	if (matrix)
+	if (output)
 	{
-		UTextureCreator::sizeX = matrixSize;
-		UTextureCreator::sizeY = matrixSize;
-		texture = UTextureCreator::CreateChannels(matrix);
+		UTextureCreator::imageData = output;
+		UTextureCreator::imageSize = sizeX * sizeY * CHANNELS;
+		UTextureCreator::FillMipChain(2);
+		texture = UTextureCreator::CreateTexture();
+		UTextureCreator::CreateImageInfo();
 	}
-	delete implementation;
-	UTextureCreator::CreateImageInfo();
 	return texture;
 }
 
-/* 
-*	It loads the image from file and creates the texture to show
+/*
+*	It executes opening or closing on the whole loaded image and
+*	keeps the buffers, so the following edits of the image are
+*	recomputed by UpdateIncrementalMMOperation only where they can
+*	change the result. The texture has no mips, because it is patched
+*	in place by the updates
+*		executionTime: time the algorithm takes to produce the matrix
+*		isOpening: true if we want to execute an opening
+*		structElemSize: size of the structuring element
 */
-UTexture2D* UTextureCreator::LoadImage()
+UTexture2D* UTextureCreator::StartIncrementalMMOperation(
+	float &executionTime, bool isOpening, int structElemSize)
 {
-	TArray<FString> files = UTextureUtilities::OpenFileDialog();
-	if (files.IsValidIndex(0))
+	uint8* output;
+	clock_t start, end;
+	if (!UTextureCreator::image)
 	{
-		UTextureCreator::image = UTextureUtilities::LoadImageFromFile(files[0]);
-		UTextureCreator::sizeX = image->SizeX;
-		UTextureCreator::sizeY = image->SizeY;
-		UTextureCreator::imageData = image->RawData.GetData();
-		UTextureCreator::imageSize = image->RawData.Num();
-		return UTextureCreator::CreateTexture();
+		return NULL;
 	}
-	return NULL;
+	UTextureCreator::FreeIncrementalMMorphology();
+	UTextureCreator::sizeX = UTextureCreator::image->SizeX;
+	UTextureCreator::sizeY = UTextureCreator::image->SizeY;
+	UTextureCreator::incrementalMorphology = new IncrementalMMorphology(
+		UTextureCreator::image, structElemSize);
+	UTextureCreator::incrementalMorphology->SetNonFlat(
+		UTextureCreator::nonFlatElement);
+	start = clock();
+	output = UTextureCreator::incrementalMorphology->
+		ExecuteOpeningOrClosing(isOpening);
+	end = clock();
+	executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+	if (!output)
+	{
+		UTextureCreator::FreeIncrementalMMorphology();
+		return NULL;
+	}
+	UTextureCreator::imageData = output;
+	UTextureCreator::imageSize = sizeX * sizeY * CHANNELS;
+	UTextureCreator::incrementalTexture = UTextureCreator::CreateTexture();
+	if (UTextureCreator::incrementalTexture)
+	{
+		// The texture is kept by this class between the updates
+		UTextureCreator::incrementalTexture->AddToRoot();
+	}
+	UTextureCreator::CreateImageInfo();
+	return UTextureCreator::incrementalTexture;
 }
 
 /*
-*	It creates the texture as result of mathematical morphology 
-*	operations using the selected algorithm version
+*	It writes a block of pixels in the loaded image and records
+*	the rectangle for the next incremental update.
+*	It returns false if the block is not inside the image
+*		origin: position of the first pixel of the block
+*		width: width of the block, the height is given by the pixels
+*		pixels: pixels of the block, row by row
+*/
+bool UTextureCreator::WriteImagePixels(FIntPoint origin, int width,
+	const TArray<FColor>& pixels)
+{
+	FColor* colors;
+	int height, row, col;
+	if (!UTextureCreator::image || width <= 0 || pixels.Num() % width != 0)
+	{
+		return false;
+	}
+	height = pixels.Num() / width;
+	if (origin.X < 0 || origin.Y < 0
+		|| origin.X + width > UTextureCreator::image->SizeX
+		|| origin.Y + height > UTextureCreator::image->SizeY)
+	{
+		return false;
+	}
+	colors = UTextureCreator::image->AsBGRA8();
+	for (row = 0; row < height; row++)
+	{
+		for (col = 0; col < width; col++)
+		{
+			colors[(origin.Y + row) * UTextureCreator::image->SizeX +
+				origin.X + col] = pixels[row * width + col];
+		}
+	}
+	UTextureCreator::changedRegions.Add(FIntRect(origin.X, origin.Y,
+		origin.X + width, origin.Y + height));
+	UTextureCreator::isImageHashValid = false;
+	// The component trees describe the previous pixels
+	UTextureCreator::FreeComponentTrees();
+	return true;
+}
+
+/*
+*	It recomputes the incremental opening or closing where the
+*	written pixels can change it and patches the texture in place.
+*	It returns false if StartIncrementalMMOperation was not called
+*		executionTime: time the algorithm takes to update the matrix
+*/
+bool UTextureCreator::UpdateIncrementalMMOperation(float &executionTime)
+{
+	TArray<FIntRect> updatedRegions;
+	const uint8* output;
+	clock_t start, end;
+	int i, row;
+	if (!UTextureCreator::incrementalMorphology
+		|| !UTextureCreator::incrementalTexture)
+	{
+		return false;
+	}
+	start = clock();
+	UTextureCreator::incrementalMorphology->UpdateRegions(
+		UTextureCreator::changedRegions, updatedRegions);
+	end = clock();
+	executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+	UTextureCreator::changedRegions.Empty();
+	output = UTextureCreator::incrementalMorphology->GetOutput();
+	for (i = 0; i < updatedRegions.Num(); i++)
+	{
+		const FIntRect& updated = updatedRegions[i];
+		int width = updated.Max.X - updated.Min.X;
+		int height = updated.Max.Y - updated.Min.Y;
+		// The render thread reads the patch later, so it gets a copy
+		uint8* patch = (uint8*)malloc(sizeof(uint8)*width*height*CHANNELS);
+		FUpdateTextureRegion2D* region = new FUpdateTextureRegion2D(
+			updated.Min.X, updated.Min.Y, 0, 0, width, height);
+		if (!patch)
+		{
+			delete region;
+			return false;
+		}
+		for (row = 0; row < height; row++)
+		{
+			FMemory::Memcpy(patch + row * width * CHANNELS,
+				output + ((updated.Min.Y + row) * sizeX + updated.Min.X) *
+				CHANNELS, width * CHANNELS);
+		}
+		UTextureCreator::incrementalTexture->UpdateTextureRegions(0, 1, region,
+			width * CHANNELS, CHANNELS, patch,
+			[](uint8* data, const FUpdateTextureRegion2D* regions)
+		{
+			free(data);
+			delete regions;
+		});
+	}
+	return true;
+}
+
+/*	PRIVATE
+*	It builds the max-trees or the min-trees of the loaded image
+*	if the ones in memory are not of the same type.
+*	It returns false if a tree could not be built
+*		threadNumber: the number of thread to use
+*		isMaxTree: true for max-trees, false for min-trees
+*/
+bool UTextureCreator::BuildComponentTrees(int threadNumber, bool isMaxTree)
+{
+	int size = UTextureCreator::sizeX * UTextureCreator::sizeY;
+	FColor* colors = UTextureCreator::image->AsBGRA8();
+	uint8* channel;
+	int i, c;
+	if (UTextureCreator::componentTrees[0] &&
+		UTextureCreator::componentTrees[0]->IsMaxTree() == isMaxTree)
+	{
+		return true;
+	}
+	UTextureCreator::FreeComponentTrees();
+	channel = (uint8*)malloc(sizeof(uint8)*size);
+	if (!channel)
+	{
+		return false;
+	}
+	for (c = 0; c < 3; c++)
+	{
+		for (i = 0; i < size; i++)
+		{
+			channel[i] = c == 0 ? colors[i].R : c == 1 ? colors[i].G : colors[i].B;
+		}
+		UTextureCreator::componentTrees[c] = new ComponentTree(channel,
+			UTextureCreator::sizeX, UTextureCreator::sizeY, isMaxTree);
+		if (!UTextureCreator::componentTrees[c]->Build(threadNumber))
+		{
+			free(channel);
+			UTextureCreator::FreeComponentTrees();
+			return false;
+		}
+	}
+	free(channel);
+	return true;
+}
+
+/*	PRIVATE
+*	It deletes the component trees of the loaded image
+*/
+void UTextureCreator::FreeComponentTrees()
+{
+	for (int c = 0; c < 3; c++)
+	{
+		delete UTextureCreator::componentTrees[c];
+		UTextureCreator::componentTrees[c] = NULL;
+	}
+}
+
+/*	PRIVATE
+*	It deletes the incremental opening or closing and
+*	releases its texture
+*/
+void UTextureCreator::FreeIncrementalMMorphology()
+{
+	delete UTextureCreator::incrementalMorphology;
+	UTextureCreator::incrementalMorphology = NULL;
+	if (UTextureCreator::incrementalTexture)
+	{
+		UTextureCreator::incrementalTexture->RemoveFromRoot();
+		UTextureCreator::incrementalTexture = NULL;
+	}
+	UTextureCreator::changedRegions.Empty();
+}
+
+/*	PRIVATE
+*	It returns the hash of the pixels of the loaded image,
+*	computed again only after the image changes
+*/
+uint64 UTextureCreator::GetImageHash()
+{
+	if (!UTextureCreator::isImageHashValid)
+	{
+		UTextureCreator::imageHash = ResultCache::HashBytes(
+			UTextureCreator::image->RawData.GetData(),
+			UTextureCreator::image->RawData.Num(),
+			((uint64)UTextureCreator::image->SizeX << 32) |
+			(uint32)UTextureCreator::image->SizeY);
+		UTextureCreator::isImageHashValid = true;
+	}
+	return UTextureCreator::imageHash;
+}
+
+/*	PRIVATE
+*	It returns the texture of a cached result, NULL if the result
+*	is not cached. The texture created the first time is returned if
+*	it still exists, otherwise a new one is created from the result
+*		key: hash of the input and of the parameters
+*/
+UTexture2D* UTextureCreator::FindCachedTexture(uint64 key)
+{
+	TSharedPtr<CachedResult> result = UTextureCreator::resultCache->Find(key);
+	TWeakObjectPtr<UTexture2D>* cachedTexture;
+	UTexture2D* texture;
+	if (!result.IsValid())
+	{
+		return NULL;
+	}
+	UTextureCreator::shownResult = result;
+	UTextureCreator::sizeX = result->width;
+	UTextureCreator::sizeY = result->height;
+	UTextureCreator::imageData = result->data;
+	UTextureCreator::imageSize = result->size;
+	cachedTexture = UTextureCreator::cachedTextures.Find(key);
+	if (cachedTexture && cachedTexture->IsValid())
+	{
+		texture = cachedTexture->Get();
+	}
+	else
+	{
+		// The key includes generateMips, so the result has its first mip
+		UTextureCreator::mipChain.Empty();
+		if (UTextureCreator::generateMips)
+		{
+			UTextureCreator::AllocateMipChain();
+			if (mipChain.Num() > 0 && result->firstMip.Num() == mipChain[0].Num())
+			{
+				FMemory::Memcpy(mipChain[0].GetData(),
+					result->firstMip.GetData(), mipChain[0].Num());
+			}
+			UTextureCreator::FillMipChain(2);
+		}
+		texture = UTextureCreator::CreateTexture();
+		UTextureCreator::cachedTextures.Add(key, texture);
+	}
+	UTextureCreator::CreateImageInfo();
+	return texture;
+}
+
+/*	PRIVATE
+*	It adds the image data of a new texture to the cache.
+*	The cache takes the ownership of the image data
+*		key: hash of the input and of the parameters
+*		texture: texture created from the image data
+*/
+void UTextureCreator::CacheTexture(uint64 key, UTexture2D* texture)
+{
+	if (!UTextureCreator::resultCache || !texture)
+	{
+		return;
+	}
+	UTextureCreator::shownResult = MakeShareable(new CachedResult(key,
+		UTextureCreator::imageData, UTextureCreator::imageSize,
+		UTextureCreator::sizeX, UTextureCreator::sizeY));
+	UTextureCreator::shownResult->firstMip =
+		MoveTemp(UTextureCreator::textureFirstMip);
+	UTextureCreator::resultCache->Add(UTextureCreator::shownResult);
+	UTextureCreator::cachedTextures.Add(key, texture);
+	// Textures of the removed results are not needed anymore
+	for (auto it = UTextureCreator::cachedTextures.CreateIterator(); it; ++it)
+	{
+		if (!UTextureCreator::resultCache->Contains(it.Key()))
+		{
+			it.RemoveCurrent();
+		}
+	}
+}
+
+/*	PRIVATE
+*	It creates the object that implements the selected
+*	mathematical morphology version on the loaded image
 *		implementationType: the algorithm we want to use
 *		threadNumber: the number of thread we want to use in a OpenMP
 *			implementation
-*		executionTime: time the algorithm takes to produce the matrix
-*		isOpening: true if we want to execute an opening
 *		structElemSize: size of the structuring element
 */
-UTexture2D* UTextureCreator::ExecuteMMOperation(
+MathematicalMorphology* UTextureCreator::CreateMMorphology(
 	ImplementationType implementationType, int threadNumber,
-	float &executionTime, bool isOpening, int structElemSize)
+	int structElemSize)
 {
-	UTexture2D* texture = NULL;
-	uint8* output = NULL;
-	clock_t start, end;
 	MathematicalMorphology* implementation = NULL;
 	switch (implementationType)
 	{
@@ -113,14 +1344,39 @@ UTexture2D* UTextureCreator::ExecuteMMOperation(
 	default:
 		break;
 	}
-	start = clock();
-	output = implementation->ExecuteOpeningOrClosing(isOpening);
-	end = clock();
-	executionTime = (double)(end - start) / CLOCKS_PER_SEC;
+	if (implementation)
+	{
+		implementation->SetGenerateMips(UTextureCreator::generateMips);
+	}
+	return implementation;
+}
+
+/*	PRIVATE
+*	It creates the texture from the output of a mathematical
+*	morphology operation and deletes the implementation
+*		implementation: object that executed the operation
+*		output: output image, NULL if the operation failed
+*/
+UTexture2D* UTextureCreator::CreateMMTexture(
+	MathematicalMorphology* implementation, uint8* output)
+{
+	UTexture2D* texture = NULL;
 	if (output)
 	{
 		UTextureCreator::imageData = output;
 		UTextureCreator::imageSize = sizeX * sizeY * CHANNELS;
+		UTextureCreator::mipChain.Empty();
+		// The first mip is NULL if it could not be allocated
+		if (UTextureCreator::generateMips && implementation->GetFirstMip())
+		{
+			UTextureCreator::AllocateMipChain();
+			if (mipChain.Num() > 0)
+			{
+				FMemory::Memcpy(mipChain[0].GetData(),
+					implementation->GetFirstMip(), mipChain[0].Num());
+			}
+			UTextureCreator::FillMipChain(2);
+		}
 		texture = UTextureCreator::CreateTexture();
 	}
 	delete implementation;
@@ -128,31 +1384,88 @@ UTexture2D* UTextureCreator::ExecuteMMOperation(
 	return texture;
 }
 
+/*	PRIVATE
+*	It creates the object that implements the selected algorithm
+*		implementationType: the algorithm we want to use
+*		size: the length of the matrix row/column
+*		threadNumber: the number of thread we want to use in a OpenMP
+*			implementation
+*/
+DiamondSquareAlgorithm* UTextureCreator::CreateDiamondSquare(
+	ImplementationType implementationType, int matrixSize, int threadNumber)
+{
+	switch (implementationType)
+	{
+	case ImplementationType::IT_OpenMP:
+		return new OpenMPDiamondSquare(matrixSize, threadNumber);
+	case ImplementationType::IT_Cuda:
+		return new CudaDiamondSquare(matrixSize);
+	default:
+		return new SerialDiamondSquare(matrixSize,
+			UTextureCreator::terrainTileSize);
+	}
+}
+
 /*	
 *	It creates the color channels using the computed matrix and returns
-*	the created texture.
+*	the created texture. If the mips are enabled they are filled in the
+*	same pass: the cell (i, j) of the matrix is the pixel (i/2^k, j/2^k)
+*	of the mip k if i and j are multiples of 2^k, so each mip takes the
+*	cells computed by a coarse level of diamond-square.
 *		matrix -> matrix of uint8 computed by the selected algorithm
 */
 UTexture2D* UTextureCreator::CreateChannels(uint8* matrix)
 {
-	int i, j;
 	int32 matrixSize = sizeX * sizeY;
 	UTextureCreator::imageSize = matrixSize * CHANNELS;
 	UTextureCreator::imageData = (uint8*)malloc(
 		UTextureCreator::imageSize * sizeof(uint8));
+	if (UTextureCreator::imageData == NULL)
+	{
+		return NULL;
+	}
+	return UTextureCreator::WriteChannels(matrix);
+}
+
+/*	PRIVATE
+*	It writes the color channels and the mips of the matrix in
+*	imageData, which has sizeX x sizeY pixels, and creates the texture
+*		matrix -> matrix of uint8 computed by the selected algorithm
+*/
+UTexture2D* UTextureCreator::WriteChannels(const uint8* matrix)
+{
+	int i, j, k, c;
+	int mipCount;
+	UTextureCreator::mipChain.Empty();
+	if (UTextureCreator::generateMips)
+	{
+		UTextureCreator::AllocateMipChain();
+	}
+	mipCount = UTextureCreator::mipChain.Num();
 	if (UTextureCreator::imageData != NULL)
 	{
-		for (i = 0; i < matrixSize; i++)
+		for (i = 0; i < sizeY; i++)
 		{
-			for (j = 0; j < CHANNELS; j++)
+			for (j = 0; j < sizeX; j++)
 			{
-				if (j == CHANNELS - 1)
+				uint8 value = matrix[i*sizeX + j];
+				uint8* pixel = UTextureCreator::imageData +
+					(i*sizeX + j)*CHANNELS;
+				for (c = 0; c < CHANNELS - 1; c++)
 				{
-					UTextureCreator::imageData[i*CHANNELS + j] = ALPHA;
+					pixel[c] = value;
 				}
-				else
+				pixel[CHANNELS - 1] = ALPHA;
+				for (k = 1; k <= mipCount && ((i | j) & ((1 << k) - 1)) == 0; k++)
 				{
-					UTextureCreator::imageData[i*CHANNELS + j] = matrix[i];
+					int mipWidth = sizeX >> k > 1 ? sizeX >> k : 1;
+					int mipHeight = sizeY >> k > 1 ? sizeY >> k : 1;
+					if ((i >> k) < mipHeight && (j >> k) < mipWidth)
+					{
+						FMemory::Memcpy(mipChain[k - 1].GetData() +
+							((i >> k)*mipWidth + (j >> k))*CHANNELS,
+							pixel, CHANNELS);
+					}
 				}
 			}
 		}
@@ -165,7 +1478,8 @@ UTexture2D* UTextureCreator::CreateChannels(uint8* matrix)
 }
 
 /*	
-*	It saves the matrix of bytes as texture to show in the widget
+*	It saves the matrix of bytes as texture to show in the widget.
+*	The mips in mipChain are added to the texture and then removed
 */
 UTexture2D* UTextureCreator::CreateTexture()
 {
@@ -178,11 +1492,91 @@ UTexture2D* UTextureCreator::CreateTexture()
 		FMemory::Memcpy(textureData, UTextureCreator::imageData,
 			UTextureCreator::imageSize);
 		texture->PlatformData->Mips[0].BulkData.Unlock();
+		for (int k = 0; k < UTextureCreator::mipChain.Num(); k++)
+		{
+			FTexture2DMipMap* mip = new FTexture2DMipMap();
+			texture->PlatformData->Mips.Add(mip);
+			mip->SizeX = UTextureCreator::sizeX >> (k + 1) > 1 ?
+				UTextureCreator::sizeX >> (k + 1) : 1;
+			mip->SizeY = UTextureCreator::sizeY >> (k + 1) > 1 ?
+				UTextureCreator::sizeY >> (k + 1) : 1;
+			mip->BulkData.Lock(LOCK_READ_WRITE);
+			textureData = mip->BulkData.Realloc(mipChain[k].Num());
+			FMemory::Memcpy(textureData, mipChain[k].GetData(),
+				mipChain[k].Num());
+			mip->BulkData.Unlock();
+		}
 		texture->UpdateResource();
 	}
+	// The first mip is kept for the result cache, which stores it
+	// with the image
+	UTextureCreator::textureFirstMip.Empty();
+	if (UTextureCreator::resultCache && UTextureCreator::mipChain.Num() > 0)
+	{
+		UTextureCreator::textureFirstMip =
+			MoveTemp(UTextureCreator::mipChain[0]);
+	}
+	UTextureCreator::mipChain.Empty();
 	return texture;
 }
 
+/*	PRIVATE
+*	It allocates the mips from the second one to the 1x1 one
+*	for an image of sizeX x sizeY pixels
+*/
+void UTextureCreator::AllocateMipChain()
+{
+	int width = UTextureCreator::sizeX;
+	int height = UTextureCreator::sizeY;
+	UTextureCreator::mipChain.Empty();
+	while (width > 1 || height > 1)
+	{
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		UTextureCreator::mipChain.AddDefaulted();
+		UTextureCreator::mipChain.Last().SetNumUninitialized(
+			width * height * CHANNELS);
+	}
+}
+
+/*	PRIVATE
+*	It computes the mips from firstLevel on with a box filter
+*	of the previous one. The level 0 is the image
+*		firstLevel: first mip to compute, at least 1
+*/
+void UTextureCreator::FillMipChain(int firstLevel)
+{
+	for (int k = firstLevel; k <= UTextureCreator::mipChain.Num(); k++)
+	{
+		int width = UTextureCreator::sizeX >> (k - 1) > 1 ?
+			UTextureCreator::sizeX >> (k - 1) : 1;
+		int height = UTextureCreator::sizeY >> (k - 1) > 1 ?
+			UTextureCreator::sizeY >> (k - 1) : 1;
+		const uint8* previous = k == 1 ? UTextureCreator::imageData :
+			UTextureCreator::mipChain[k - 2].GetData();
+		UTextureUtilities::DownsampleImage(previous, width, height,
+			UTextureCreator::mipChain[k - 1].GetData());
+	}
+}
+
+/*	PRIVATE
+*	It computes the row of the first mip that covers a row of the
+*	image and the previous one, once the two rows have been written.
+*	Nothing is done if the mips are not allocated
+*		data: image of sizeX x sizeY pixels
+*		row: row of the image that has been written
+*/
+void UTextureCreator::DownsampleWrittenRow(const uint8* data, int row)
+{
+	if (UTextureCreator::mipChain.Num() > 0 &&
+		(row % 2 == 1 || UTextureCreator::sizeY == 1))
+	{
+		UTextureUtilities::DownsampleRow(data, UTextureCreator::sizeX,
+			UTextureCreator::sizeY, row / 2,
+			UTextureCreator::mipChain[0].GetData());
+	}
+}
+
 /*	
 *	It creates the info structure used to save the image
 */
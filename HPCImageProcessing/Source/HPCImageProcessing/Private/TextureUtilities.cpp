@@ -9,6 +9,10 @@ FString const UTextureUtilities::filePath =
 FPaths::ConvertRelativePathToFull(FPaths::ProjectDir()) + "OutputImages/";
 //Extension of the image we want to save
 FString const UTextureUtilities::extensionFile = ".png";
+//Extension of the raw float heightmaps
+FString const UTextureUtilities::rawExtensionFile = ".r32";
+//Extension of the intermediate images, faster to decode than PNG
+FString const UTextureUtilities::qoiExtensionFile = ".qoi";
 
 EImageFormat const UTextureUtilities::imageFormat = EImageFormat::PNG;
 ERGBFormat const UTextureUtilities::RGBFormat = ERGBFormat::RGBA;
@@ -17,17 +21,15 @@ int const UTextureUtilities::bitDepth = 8;
 FString const UTextureUtilities::title = "Scegli immagine";
 FString const UTextureUtilities::defaultFolder =
 FPaths::ConvertRelativePathToFull(FPaths::ProjectDir()) + "InputImages/";
-FString const UTextureUtilities::filter = "Image files (*.png) | *.png";
+FString const UTextureUtilities::filter = "Image files (*.png;*.qoi) | *.png;*.qoi";
 
 /*	
 *	It saves the matrix of bytes as PNG image
 */
 void UTextureUtilities::SaveToPNG(AlgorithmType algorithm)
 {
-	int counter = 0;
 	FString algType = "";
 	FString fileName;
-	IPlatformFile &platform = FPlatformFileManager::Get().GetPlatformFile();
 	IImageWrapperModule &w_module =
 		FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
 	TSharedPtr<IImageWrapper> wrapper = w_module.CreateImageWrapper(UTextureUtilities::imageFormat);
@@ -48,17 +50,195 @@ void UTextureUtilities::SaveToPNG(AlgorithmType algorithm)
 	default:
 		break;
 	}
-	fileName = UTextureUtilities::filePath + algType
-		+ UTextureUtilities::extensionFile;
-	/*It checks if there is already a file with the specified path and changes the
-	name of the image to save it without overwrite the previous file*/
+	fileName = UTextureUtilities::GetFreeFileName(algType,
+		UTextureUtilities::extensionFile);
+	FFileHelper::SaveArrayToFile(wrapper->GetCompressed(), *fileName);
+}
+
+/*
+*	It saves an image of 4 bytes per pixel as PNG image in a file.
+*	The channels are written in the order used to load the images
+*		data: image pixels
+*		width: image width
+*		height: image height
+*		file: path of the file
+*/
+bool UTextureUtilities::SaveToPNGFile(const uint8* data, int width,
+	int height, FString file)
+{
+	IImageWrapperModule &w_module =
+		FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+	TSharedPtr<IImageWrapper> wrapper = w_module.CreateImageWrapper(UTextureUtilities::imageFormat);
+	if (!data || !wrapper.IsValid() ||
+		!wrapper->SetRaw(data, (int64)width * height * CHANNELS,
+			width, height, UTextureUtilities::RGBFormat, UTextureUtilities::bitDepth))
+	{
+		return false;
+	}
+	return FFileHelper::SaveArrayToFile(wrapper->GetCompressed(), *file);
+}
+
+/*
+*	It saves an image of 4 bytes per pixel as QOI image in a file.
+*	The channels are written in the order used to load the images
+*		data: image pixels
+*		width: image width
+*		height: image height
+*		file: path of the file
+*/
+bool UTextureUtilities::SaveToQOIFile(const uint8* data, int width,
+	int height, FString file)
+{
+	TArray<uint8> fileData;
+	if (!QOIImage::Encode(data, width, height, fileData))
+	{
+		return false;
+	}
+	return FFileHelper::SaveArrayToFile(fileData, *file);
+}
+
+/*
+*	It returns true if the file has the extension of the QOI images
+*		file: path of the file
+*/
+bool UTextureUtilities::IsQOIFile(const FString& file)
+{
+	return file.EndsWith(UTextureUtilities::qoiExtensionFile,
+		ESearchCase::IgnoreCase);
+}
+
+/*
+*	It saves a 16-bit heightmap as single channel PNG image
+*		data: heightmap samples
+*		width: heightmap width
+*		height: heightmap height
+*		name: name of the file, without path and extension
+*/
+bool UTextureUtilities::SaveToR16PNG(const uint16* data, int width,
+	int height, FString name)
+{
+	FString fileName;
+	IImageWrapperModule &w_module =
+		FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+	TSharedPtr<IImageWrapper> wrapper = w_module.CreateImageWrapper(UTextureUtilities::imageFormat);
+	if (!data || !wrapper.IsValid() ||
+		!wrapper->SetRaw(data, (int64)width * height * sizeof(uint16),
+			width, height, ERGBFormat::Gray, 16))
+	{
+		return false;
+	}
+	fileName = UTextureUtilities::GetFreeFileName(name,
+		UTextureUtilities::extensionFile);
+	return FFileHelper::SaveArrayToFile(wrapper->GetCompressed(), *fileName);
+}
+
+/*
+*	It saves a float heightmap as raw little-endian 32-bit floats,
+*	row after row without header
+*		data: heightmap samples
+*		width: heightmap width
+*		height: heightmap height
+*		name: name of the file, without path and extension
+*/
+bool UTextureUtilities::SaveToRawFloat(const float* data, int width,
+	int height, FString name)
+{
+	FString fileName;
+	const uint8* bytes = (const uint8*)data;
+	int64 size = (int64)width * height * sizeof(float);
+	int64 chunk;
+	bool isWritten = true;
+	if (!data)
+	{
+		return false;
+	}
+	fileName = UTextureUtilities::GetFreeFileName(name,
+		UTextureUtilities::rawExtensionFile);
+	IFileHandle* file = FPlatformFileManager::Get().GetPlatformFile()
+		.OpenWrite(*fileName);
+	if (!file)
+	{
+		return false;
+	}
+	// Heightmaps can be larger than 2 GB, so they are written in chunks
+	for (int64 offset = 0; offset < size && isWritten; offset += chunk)
+	{
+		chunk = FMath::Min<int64>(RAW_WRITE_CHUNK, size - offset);
+		isWritten = file->Write(bytes + offset, chunk);
+	}
+	isWritten = file->Flush() && isWritten;
+	delete file;
+	return isWritten;
+}
+
+/*
+*	It computes the next mip of an image: each pixel is the average
+*	of 2x2 pixels of the input. The output is max(width/2, 1) pixels
+*	wide and max(height/2, 1) pixels high
+*		input: input image, 4 bytes per pixel
+*		width: input width
+*		height: input height
+*		output: output image
+*/
+void UTextureUtilities::DownsampleImage(const uint8* input, int width,
+	int height, uint8* output)
+{
+	int outHeight = height > 1 ? height / 2 : 1;
+	for (int i = 0; i < outHeight; i++)
+	{
+		UTextureUtilities::DownsampleRow(input, width, height, i, output);
+	}
+}
+
+/*
+*	It computes a row of the next mip of an image, so the mip can be
+*	computed by the pass that writes the image: the row outRow needs
+*	the input rows 2*outRow and 2*outRow+1, which are then in cache
+*		input: input image, 4 bytes per pixel
+*		width: input width
+*		height: input height
+*		outRow: row of the output to compute
+*		output: output image, max(width/2, 1) x max(height/2, 1) pixels
+*/
+void UTextureUtilities::DownsampleRow(const uint8* input, int width,
+	int height, int outRow, uint8* output)
+{
+	int outWidth = width > 1 ? width / 2 : 1;
+	const uint8* top = input + (int64)2 * outRow * width * CHANNELS;
+	const uint8* bottom = 2 * outRow + 1 < height ?
+		top + width * CHANNELS : top;
+	uint8* target = output + (int64)outRow * outWidth * CHANNELS;
+	for (int j = 0; j < outWidth; j++)
+	{
+		int left = 2 * j * CHANNELS;
+		int right = (2 * j + 1 < width ? 2 * j + 1 : 2 * j) * CHANNELS;
+		for (int c = 0; c < CHANNELS; c++)
+		{
+			target[j*CHANNELS + c] = (top[left + c] + top[right + c] +
+				bottom[left + c] + bottom[right + c] + 2) / 4;
+		}
+	}
+}
+
+/*	PRIVATE
+*	It returns the path of a file in the output folder that does not exist.
+*	If there is already a file with the specified name it adds a counter
+*	to the name, so the previous file is not overwritten
+*		name: name of the file, without path and extension
+*		extension: extension of the file
+*/
+FString UTextureUtilities::GetFreeFileName(FString name, FString extension)
+{
+	int counter = 0;
+	IPlatformFile &platform = FPlatformFileManager::Get().GetPlatformFile();
+	FString fileName = UTextureUtilities::filePath + name + extension;
 	while (platform.FileExists(*fileName))
 	{
 		counter++;
-		fileName = UTextureUtilities::filePath + algType +
-			FString::FromInt(counter) + UTextureUtilities::extensionFile;
+		fileName = UTextureUtilities::filePath + name +
+			FString::FromInt(counter) + extension;
 	}
-	FFileHelper::SaveArrayToFile(wrapper->GetCompressed(), *fileName);
+	return fileName;
 }
 
 /*
@@ -93,33 +273,70 @@ TArray<FString> UTextureUtilities::OpenFileDialog()
 }
 
 /*
-*	It loads an image from file
+*	It loads an image from a PNG or QOI file. The first mip is
+*	computed by the pass that writes the pixels in the image
+*		file: path of the file
+*		firstMip: half-size image, NULL if not used
 */
-FImage* UTextureUtilities::LoadImageFromFile(FString file)
+FImage* UTextureUtilities::LoadImageFromFile(FString file,
+	TArray<uint8>* firstMip)
 {
 	TSharedPtr<IImageWrapper> wrapper;
 	TArray<uint8> fileData;
 	const TArray<uint8>* imageData;
 	FImage* image = NULL;
+	int64 rowSize;
+	if (!FPaths::FileExists(*file) ||
+		!FFileHelper::LoadFileToArray(fileData, *file))
+	{
+		return NULL;
+	}
+	if (UTextureUtilities::IsQOIFile(file))
+	{
+		image = new FImage();
+		if (!QOIImage::Decode(fileData.GetData(), fileData.Num(), image,
+			firstMip))
+		{
+			delete image;
+			image = NULL;
+		}
+		return image;
+	}
 	IImageWrapperModule &module = FModuleManager::LoadModuleChecked
 		<IImageWrapperModule>(FName("ImageWrapper"));
 	wrapper = module.CreateImageWrapper(UTextureUtilities::imageFormat);
-	if (FPaths::FileExists(*file))
+	if (wrapper.IsValid() &&
+		wrapper->SetCompressed(fileData.GetData(), fileData.Num()))
 	{
-		if (FFileHelper::LoadFileToArray(fileData, *file))
+		// The wrapper keeps its own copy of the compressed data
+		fileData.Empty();
+		if (wrapper->GetRaw(UTextureUtilities::RGBFormat,
+			UTextureUtilities::bitDepth, imageData))
 		{
-			if (wrapper.IsValid() &&
-				wrapper->SetCompressed(fileData.GetData(), fileData.Num()))
+			image = new FImage();
+			image->SizeX = wrapper->GetWidth();
+			image->SizeY = wrapper->GetHeight();
+			image->Format = ERawImageFormat::Type::BGRA8;
+			image->GammaSpace = EGammaSpace::sRGB;
+			// The buffer belongs to the wrapper, which is destroyed on
+			// return, so it is copied a pair of rows at a time
+			image->RawData.SetNumUninitialized(imageData->Num());
+			rowSize = (int64)image->SizeX * CHANNELS;
+			if (firstMip)
+			{
+				firstMip->SetNumUninitialized(
+					(image->SizeX > 1 ? image->SizeX / 2 : 1) *
+					(image->SizeY > 1 ? image->SizeY / 2 : 1) * CHANNELS);
+			}
+			for (int row = 0; row < image->SizeY; row++)
 			{
-				if (wrapper->GetRaw(UTextureUtilities::RGBFormat,
-					UTextureUtilities::bitDepth, imageData))
+				FMemory::Memcpy(image->RawData.GetData() + row * rowSize,
+					imageData->GetData() + row * rowSize, rowSize);
+				if (firstMip && (row % 2 == 1 || image->SizeY == 1))
 				{
-					image = new FImage();
-					image->SizeX = wrapper->GetWidth();
-					image->SizeY = wrapper->GetHeight();
-					image->RawData = *imageData;
-					image->Format = ERawImageFormat::Type::BGRA8;
-					image->GammaSpace = EGammaSpace::sRGB;
+					UTextureUtilities::DownsampleRow(image->RawData.GetData(),
+						image->SizeX, image->SizeY, row / 2,
+						firstMip->GetData());
 				}
 			}
 		}
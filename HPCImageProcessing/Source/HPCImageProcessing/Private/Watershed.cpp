@@ -0,0 +1,394 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Watershed.h"
+
+/*
+*	Watershed constructor.
+*	It allocates the buffers used for a channel
+*		width: width of the channel
+*		height: height of the channel
+*/
+Watershed::Watershed(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	this->size = width * height;
+	this->gradient = NULL;
+	this->tileCount = 0;
+	this->tileRows = 0;
+	this->labelCount = 0;
+	this->executionTime = 0;
+	this->heads = NULL;
+	this->tails = NULL;
+	this->borderCosts = NULL;
+	this->borderLabels = NULL;
+	this->labels = (int*)malloc(sizeof(int)*this->size);
+	this->costs = (int*)malloc(sizeof(int)*this->size);
+	this->next = (int*)malloc(sizeof(int)*this->size);
+	this->prev = (int*)malloc(sizeof(int)*this->size);
+	this->isQueued = (uint8*)malloc(sizeof(uint8)*this->size);
+}
+
+/*
+*	Watershed destructor.
+*	It frees the buffers
+*/
+Watershed::~Watershed()
+{
+	free(this->labels);
+	free(this->costs);
+	free(this->next);
+	free(this->prev);
+	free(this->isQueued);
+	free(this->heads);
+	free(this->tails);
+	free(this->borderCosts);
+	free(this->borderLabels);
+}
+
+/*
+*	It computes the watershed of a gradient channel from the markers.
+*	It returns false if the buffers could not be allocated
+*		gradient: gradient channel of width x height pixels
+*		markers: channel of width x height pixels, the pixels
+*			different from zero are markers
+*		threadNumber: the number of thread to use
+*/
+bool Watershed::Compute(const uint8* gradient, const uint8* markers,
+	int threadNumber)
+{
+	int tileCount = threadNumber > 1 ? threadNumber : 1;
+	int borderSize, tile, changes;
+	double start;
+	if (!this->labels || !this->costs || !this->next
+		|| !this->prev || !this->isQueued)
+	{
+		return false;
+	}
+	start = omp_get_wtime();
+	tileCount = tileCount < this->height ? tileCount : this->height;
+	tileCount = tileCount > 0 ? tileCount : 1;
+	this->tileRows = (this->height + tileCount - 1) / tileCount;
+	this->tileCount = (this->height + this->tileRows - 1) / this->tileRows;
+	// Two rows for each border between tiles
+	borderSize = 2 * this->width * (this->tileCount > 1 ?
+		this->tileCount - 1 : 1);
+	free(this->heads);
+	free(this->tails);
+	free(this->borderCosts);
+	free(this->borderLabels);
+	this->heads = (int*)malloc(sizeof(int)*this->tileCount*WATERSHED_LEVELS);
+	this->tails = (int*)malloc(sizeof(int)*this->tileCount*WATERSHED_LEVELS);
+	this->borderCosts = (int*)malloc(sizeof(int)*borderSize);
+	this->borderLabels = (int*)malloc(sizeof(int)*borderSize);
+	if (!this->heads || !this->tails
+		|| !this->borderCosts || !this->borderLabels)
+	{
+		return false;
+	}
+	this->gradient = gradient;
+	this->labelCount = this->LabelMarkers(markers);
+	#pragma omp parallel for num_threads(threadNumber > 0 ? threadNumber : 1)
+	for (tile = 0; tile < this->tileCount; tile++)
+	{
+		int* tileHeads = this->heads + tile * WATERSHED_LEVELS;
+		int* tileTails = this->tails + tile * WATERSHED_LEVELS;
+		this->SeedTile(tile, tileHeads, tileTails);
+		this->FloodTile(tile, tileHeads, tileTails);
+	}
+	// Merge phase: the tiles are flooded again from the borders
+	// where the paths through the neighbouring tiles are cheaper
+	changes = this->tileCount > 1 ? 1 : 0;
+	while (changes > 0)
+	{
+		this->SaveBorders();
+		changes = 0;
+		#pragma omp parallel for reduction(+:changes) num_threads(threadNumber > 0 ? threadNumber : 1)
+		for (tile = 0; tile < this->tileCount; tile++)
+		{
+			int* tileHeads = this->heads + tile * WATERSHED_LEVELS;
+			int* tileTails = this->tails + tile * WATERSHED_LEVELS;
+			int seeds = this->SeedBorder(tile, true, tileHeads, tileTails) +
+				this->SeedBorder(tile, false, tileHeads, tileTails);
+			if (seeds > 0)
+			{
+				this->FloodTile(tile, tileHeads, tileTails);
+			}
+			changes += seeds;
+		}
+	}
+	this->executionTime = omp_get_wtime() - start;
+	return true;
+}
+
+/*
+*	It returns true if a pixel has a different label from
+*	its right or lower neighbour
+*		pixel: index of the pixel
+*/
+bool Watershed::IsBoundary(int pixel) const
+{
+	int col = pixel % this->width;
+	return (col < this->width - 1 &&
+		this->labels[pixel + 1] != this->labels[pixel]) ||
+		(pixel + this->width < this->size &&
+		this->labels[pixel + this->width] != this->labels[pixel]);
+}
+
+/*
+*	It returns the number of millions of pixels computed per second
+*	by the last execution
+*/
+double Watershed::GetMegapixelsPerSecond() const
+{
+	return this->executionTime > 0 ?
+		this->size / (1000000.0 * this->executionTime) : 0;
+}
+
+/*	PRIVATE
+*	It gives a label from 1 to each connected component of
+*	the markers and 0 to the other pixels. It returns the number
+*	of labels. The next buffer is used as stack
+*		markers: channel of the markers
+*/
+int Watershed::LabelMarkers(const uint8* markers)
+{
+	int* stack = this->next;
+	int label = 0;
+	int i, k;
+	for (i = 0; i < this->size; i++)
+	{
+		this->labels[i] = 0;
+	}
+	for (i = 0; i < this->size; i++)
+	{
+		int top = 0;
+		if (!markers[i] || this->labels[i])
+		{
+			continue;
+		}
+		label++;
+		this->labels[i] = label;
+		stack[top++] = i;
+		while (top > 0)
+		{
+			int pixel = stack[--top];
+			int col = pixel % this->width;
+			int neighbours[4] = { pixel - this->width, pixel - 1,
+				pixel + 1, pixel + this->width };
+			bool isInside[4] = { pixel >= this->width, col > 0,
+				col < this->width - 1, pixel + this->width < this->size };
+			for (k = 0; k < 4; k++)
+			{
+				if (isInside[k] && markers[neighbours[k]] &&
+					!this->labels[neighbours[k]])
+				{
+					this->labels[neighbours[k]] = label;
+					stack[top++] = neighbours[k];
+				}
+			}
+		}
+	}
+	return label;
+}
+
+/*	PRIVATE
+*	It clears the queue of a tile and adds its markers with cost 0
+*		tile: index of the tile
+*		heads: first pixel of each bucket of the tile
+*		tails: last pixel of each bucket of the tile
+*/
+void Watershed::SeedTile(int tile, int* heads, int* tails)
+{
+	int firstPixel = tile * this->tileRows * this->width;
+	int endRow = (tile + 1) * this->tileRows;
+	int endPixel = (endRow < this->height ? endRow : this->height) *
+		this->width;
+	int i;
+	for (i = 0; i < WATERSHED_LEVELS; i++)
+	{
+		heads[i] = -1;
+		tails[i] = -1;
+	}
+	for (i = firstPixel; i < endPixel; i++)
+	{
+		this->isQueued[i] = 0;
+		this->costs[i] = this->labels[i] ? 0 : WATERSHED_UNREACHED;
+		if (this->labels[i])
+		{
+			this->Push(i, heads, tails);
+		}
+	}
+}
+
+/*	PRIVATE
+*	It adds to the queue of a tile the pixels of a border row
+*	that are reached with a lower cost from the neighbouring tile.
+*	It returns the number of pixels added
+*		tile: index of the tile
+*		isUpper: true for the first row of the tile,
+*			false for the last one
+*		heads: first pixel of each bucket of the tile
+*		tails: last pixel of each bucket of the tile
+*/
+int Watershed::SeedBorder(int tile, bool isUpper, int* heads, int* tails)
+{
+	const int *neighbourCosts, *neighbourLabels;
+	int firstPixel, endRow, col, seeds = 0;
+	if ((isUpper && tile == 0) || (!isUpper && tile == this->tileCount - 1))
+	{
+		return 0;
+	}
+	// The upper border saved the last row of the upper tile,
+	// then the first row of the lower one
+	neighbourCosts = this->borderCosts + (isUpper ?
+		2 * (tile - 1) * this->width : (2 * tile + 1) * this->width);
+	neighbourLabels = this->borderLabels + (isUpper ?
+		2 * (tile - 1) * this->width : (2 * tile + 1) * this->width);
+	endRow = (tile + 1) * this->tileRows;
+	firstPixel = (isUpper ? tile * this->tileRows : endRow - 1) * this->width;
+	for (col = 0; col < this->width; col++)
+	{
+		int pixel = firstPixel + col;
+		int cost = neighbourCosts[col] > this->gradient[pixel] ?
+			neighbourCosts[col] : this->gradient[pixel];
+		if (cost < this->costs[pixel])
+		{
+			if (this->isQueued[pixel])
+			{
+				this->Remove(pixel, heads, tails);
+			}
+			this->costs[pixel] = cost;
+			this->labels[pixel] = neighbourLabels[col];
+			this->Push(pixel, heads, tails);
+			seeds++;
+		}
+	}
+	return seeds;
+}
+
+/*	PRIVATE
+*	It floods a tile from the pixels in its queue: each pixel is
+*	taken from the lowest bucket and gives its label to the
+*	neighbours that it reaches with a lower cost
+*		tile: index of the tile
+*		heads: first pixel of each bucket of the tile
+*		tails: last pixel of each bucket of the tile
+*/
+void Watershed::FloodTile(int tile, int* heads, int* tails)
+{
+	int firstPixel = tile * this->tileRows * this->width;
+	int endRow = (tile + 1) * this->tileRows;
+	int endPixel = (endRow < this->height ? endRow : this->height) *
+		this->width;
+	int level, k;
+	for (level = 0; level < WATERSHED_LEVELS; level++)
+	{
+		// Costs are never lower than the level of the pixel
+		// that reaches them, so the bucket can grow while it is emptied
+		while (heads[level] != -1)
+		{
+			int pixel = heads[level];
+			int col = pixel % this->width;
+			int neighbours[4] = { pixel - this->width, pixel - 1,
+				pixel + 1, pixel + this->width };
+			bool isInside[4] = { pixel - this->width >= firstPixel,
+				col > 0, col < this->width - 1,
+				pixel + this->width < endPixel };
+			this->Remove(pixel, heads, tails);
+			for (k = 0; k < 4; k++)
+			{
+				int neighbour = neighbours[k];
+				int cost;
+				if (!isInside[k])
+				{
+					continue;
+				}
+				cost = this->gradient[neighbour] > level ?
+					this->gradient[neighbour] : level;
+				if (cost < this->costs[neighbour])
+				{
+					if (this->isQueued[neighbour])
+					{
+						this->Remove(neighbour, heads, tails);
+					}
+					this->costs[neighbour] = cost;
+					this->labels[neighbour] = this->labels[pixel];
+					this->Push(neighbour, heads, tails);
+				}
+			}
+		}
+	}
+}
+
+/*	PRIVATE
+*	It copies the costs and labels of the two rows next to each
+*	border between tiles, so tiles can read them while the
+*	neighbouring tiles are flooded
+*/
+void Watershed::SaveBorders()
+{
+	for (int border = 0; border < this->tileCount - 1; border++)
+	{
+		int lowerRow = (border + 1) * this->tileRows;
+		int upperPixel = (lowerRow - 1) * this->width;
+		int* savedCosts = this->borderCosts + 2 * border * this->width;
+		int* savedLabels = this->borderLabels + 2 * border * this->width;
+		FMemory::Memcpy(savedCosts, this->costs + upperPixel,
+			sizeof(int) * 2 * this->width);
+		FMemory::Memcpy(savedLabels, this->labels + upperPixel,
+			sizeof(int) * 2 * this->width);
+	}
+}
+
+/*	PRIVATE
+*	It adds a pixel at the end of the bucket of its cost
+*		pixel: index of the pixel
+*		heads: first pixel of each bucket of the tile
+*		tails: last pixel of each bucket of the tile
+*/
+void Watershed::Push(int pixel, int* heads, int* tails)
+{
+	int level = this->costs[pixel];
+	this->prev[pixel] = tails[level];
+	this->next[pixel] = -1;
+	if (tails[level] != -1)
+	{
+		this->next[tails[level]] = pixel;
+	}
+	else
+	{
+		heads[level] = pixel;
+	}
+	tails[level] = pixel;
+	this->isQueued[pixel] = 1;
+}
+
+/*	PRIVATE
+*	It removes a pixel from the bucket of its cost
+*		pixel: index of the pixel
+*		heads: first pixel of each bucket of the tile
+*		tails: last pixel of each bucket of the tile
+*/
+void Watershed::Remove(int pixel, int* heads, int* tails)
+{
+	int level = this->costs[pixel];
+	if (this->prev[pixel] != -1)
+	{
+		this->next[this->prev[pixel]] = this->next[pixel];
+	}
+	else
+	{
+		heads[level] = this->next[pixel];
+	}
+	if (this->next[pixel] != -1)
+	{
+		this->prev[this->next[pixel]] = this->prev[pixel];
+	}
+	else
+	{
+		tails[level] = this->prev[pixel];
+	}
+	this->isQueued[pixel] = 0;
+}
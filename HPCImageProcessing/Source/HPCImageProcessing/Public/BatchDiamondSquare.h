@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DiamondSquareAlgorithm.h"
+#include <omp.h>
+
+/* structure that describes a terrain of a batch */
+struct DiamondSquareJob
+{
+	int size;
+	uint32 seed;
+};
+
+/**
+ *	This class computes many independent terrains with the
+ *	diamond-square algorithm. Small terrains are computed one group
+ *	per thread: the terrains of a group have the same size and are
+ *	stored interleaved (structure of arrays), so every step of the
+ *	algorithm computes the same cell of LANES terrains with the same
+ *	instructions. Terrains larger than maxBatchedSize are computed
+ *	one at a time with OpenMPDiamondSquare.
+ *	All the results are stored in a single buffer allocated by the
+ *	constructor and each terrain is the one SerialDiamondSquare
+ *	computes with the same seed.
+ */
+class HPCIMAGEPROCESSING_API BatchDiamondSquare
+{
+public:
+	// Number of terrains computed together by a thread
+	static const int LANES = 8;
+
+	BatchDiamondSquare(const TArray<DiamondSquareJob>& jobs,
+		int threadNumber, int maxBatchedSize = 1025);
+	~BatchDiamondSquare();
+	bool ExecuteBatch();
+	uint8* GetTerrain(int job) const;
+	int GetTerrainCount() const { return this->jobs.Num(); }
+	double GetExecutionTime() const { return this->executionTime; }
+	double GetTerrainsPerSecond() const;
+
+private:
+	/* terrains of the same size computed together */
+	struct JobGroup
+	{
+		int size;
+		int count;
+		int jobs[LANES];
+	};
+
+	void BuildGroups();
+	void ExecuteGroup(const JobGroup& group, uint8* lanes) const;
+	void DiamondLevel(uint8* lanes, const uint32* seeds, int size,
+		int matrixSize, int maxValue) const;
+	void SquareLevel(uint8* lanes, const uint32* seeds, int size,
+		int matrixSize, int maxValue) const;
+
+	TArray<DiamondSquareJob> jobs;
+	TArray<JobGroup> groups;
+	// Jobs computed with intra-image parallelism
+	TArray<int> largeJobs;
+	// Buffer of all the terrains and offset of each one
+	uint8* arena;
+	TArray<int64> offsets;
+	// Interleaved matrices, one per thread
+	uint8* lanes;
+	int64 laneCells;
+	int threadNum;
+	int maxBatchedSize;
+	double executionTime;
+};
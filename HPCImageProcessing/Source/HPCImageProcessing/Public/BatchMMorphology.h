@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MathematicalMorphology.h"
+#include <omp.h>
+
+/**
+ *	This class executes opening or closing on many small images with
+ *	the same structuring element. The element is loaded once and the
+ *	images are handed out to the threads, each one computed by a
+ *	single thread in its own planes, so there is no allocation and no
+ *	parallel region for each image. The channels are computed one at a
+ *	time in two planes with ghost cells, and the second pass writes
+ *	the output image directly.
+ *	All the results are stored in a single buffer allocated by the
+ *	constructor and each one is the one SerialMMorphology computes.
+ */
+class HPCIMAGEPROCESSING_API BatchMMorphology
+{
+public:
+	BatchMMorphology(const TArray<FImage*>& images, int size,
+		int threadNumber);
+	~BatchMMorphology();
+	bool ExecuteBatch(bool isOpening);
+	uint8* GetOutput(int image) const;
+	int GetImageCount() const { return this->images.Num(); }
+	double GetExecutionTime() const { return this->executionTime; }
+	double GetImagesPerSecond() const;
+
+private:
+	/* buffers used by a thread */
+	struct WorkerScratch
+	{
+		uint8* planes;
+		int* erosionOffsets;
+		int* dilationOffsets;
+		// Pitch of the planes the offsets were computed for
+		int offsetWidth;
+	};
+
+	void ExecuteImage(int image, bool isOpening, WorkerScratch& scratch) const;
+	void SetOffsets(WorkerScratch& scratch, int width) const;
+	void FilterPlane(const uint8* in, uint8* out, int step, int outWidth,
+		int width, int height, int paddedWidth, const int* offsets,
+		bool isErosion) const;
+
+	TArray<FImage*> images;
+	StructuringElement structElem;
+	// Rows and columns of the element pixels from the center
+	int* elementRows;
+	int* elementCols;
+	int elementCount;
+	// Buffer of all the outputs and offset of each one
+	uint8* arena;
+	TArray<int64> offsets;
+	// Two planes with ghost cells of the largest image per thread
+	int64 planeSize;
+	TArray<WorkerScratch> workers;
+	int threadNum;
+	double executionTime;
+};
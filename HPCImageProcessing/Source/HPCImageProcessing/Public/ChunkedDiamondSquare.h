@@ -0,0 +1,96 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/List.h"
+#include "DiamondSquareAlgorithm.h"
+#include <omp.h>
+
+/* structure that identifies a chunk of the terrain */
+struct ChunkKey
+{
+	int32 X;
+	int32 Y;
+	int32 Level;
+
+	bool operator==(const ChunkKey& other) const
+	{
+		return X == other.X && Y == other.Y && Level == other.Level;
+	}
+};
+
+inline uint32 GetTypeHash(const ChunkKey& key)
+{
+	return DiamondSquareHash((uint32)key.Level,
+		((uint64)(uint32)key.Y << 32) | (uint32)key.X);
+}
+
+/* structure that contains the samples of a chunk */
+struct TerrainChunk
+{
+	ChunkKey key;
+	uint8* samples;
+	int size;
+
+	TerrainChunk(ChunkKey chunkKey, int chunkSize);
+	~TerrainChunk();
+};
+
+/**
+ *	This class generates an unbounded terrain made of chunks of
+ *	size 2^n+1 computed on demand. A chunk at level L covers the
+ *	area of 2^L chunks of level 0 per side with the same number of
+ *	samples. Chunks of the top level are computed with the
+ *	diamond-square algorithm; a chunk of a lower level takes every
+ *	other sample from its parent and computes the others with one
+ *	more diamond-square level. Values on chunk edges are computed
+ *	with a one-dimensional midpoint displacement and every random
+ *	value is a hash of the world seed and of the world position,
+ *	so neighbouring chunks match without having to exist.
+ */
+class HPCIMAGEPROCESSING_API ChunkedDiamondSquare
+{
+public:
+	ChunkedDiamondSquare(uint32 worldSeed, int chunkSize,
+		int topLevel, int cacheCapacity);
+	~ChunkedDiamondSquare();
+	TSharedPtr<TerrainChunk> GetChunk(int chunkX, int chunkY, int level);
+	bool GenerateChunks(const TArray<ChunkKey>& keys, int threadNumber);
+	int GetChunkSize() const { return this->chunkSize; }
+	int GetCachedChunks() const { return this->cache.Num(); }
+
+private:
+	/* entry of the chunk cache */
+	struct CacheEntry
+	{
+		TSharedPtr<TerrainChunk> chunk;
+		TDoubleLinkedList<ChunkKey>::TDoubleLinkedListNode* node;
+	};
+
+	bool BuildChunks(const TArray<ChunkKey>& keys, int threadNumber,
+		TMap<ChunkKey, TSharedPtr<TerrainChunk>>& chunks);
+	TSharedPtr<TerrainChunk> FindChunk(const ChunkKey& key);
+	void AddChunk(const TSharedPtr<TerrainChunk>& chunk);
+	ChunkKey GetParent(const ChunkKey& key) const;
+	bool GenerateTopChunk(TerrainChunk* chunk) const;
+	bool GenerateChildChunk(TerrainChunk* chunk,
+		const TerrainChunk* parent) const;
+	void GenerateEdges(TerrainChunk* chunk, int matrixSize,
+		int maxValue) const;
+	void DiamondStep(TerrainChunk* chunk, int row, int column,
+		int adding, int maxValue) const;
+	void SquareStep(TerrainChunk* chunk, int row, int column,
+		int adding, int maxValue) const;
+	int RandomValue(const TerrainChunk* chunk, int row, int column,
+		int maxValue) const;
+	int GetDepth(int level) const;
+
+	uint32 worldSeed;
+	int chunkSize;
+	int topLevel;
+	int cacheCapacity;
+	TMap<ChunkKey, CacheEntry> cache;
+	// Keys of the cached chunks, from the most recently used
+	TDoubleLinkedList<ChunkKey> usage;
+};
@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <omp.h>
+#define TREE_LEVELS 256
+
+/**
+ *	This class builds the max-tree (or the min-tree) of a channel:
+ *	the tree of the connected components of every threshold set.
+ *	Each pixel points to its parent; a node is represented by its
+ *	level root, the only pixel of the node whose parent has a lower
+ *	level. The tree is built with union-find on horizontal tiles in
+ *	parallel, then the trees of neighbouring tiles are merged along
+ *	their borders with a pairwise reduction.
+ *	Once the tree is built, attribute filters such as area openings
+ *	are computed in a linear pass for any threshold.
+ */
+class HPCIMAGEPROCESSING_API ComponentTree
+{
+public:
+	ComponentTree(const uint8* channel, int width, int height,
+		bool isMaxTree);
+	~ComponentTree();
+	bool Build(int threadNumber);
+	void AreaFilter(int64 minArea, uint8* output) const;
+	void AttributeFilter(TFunction<bool(int node)> criterion,
+		uint8* output) const;
+	bool IsNode(int pixel) const;
+	int GetParent(int node) const { return this->parent[node]; }
+	int64 GetArea(int node) const { return this->area[node]; }
+	uint8 GetLevel(int node) const;
+	bool IsMaxTree() const { return this->isMaxTree; }
+
+private:
+	void SortPixels(int threadNumber);
+	void BuildTile(int tile);
+	void MergeTiles(int upperTile, int lowerTile);
+	void Connect(int first, int second);
+	int FindRoot(int pixel);
+	int LevelRoot(int pixel);
+	int ParentNode(int node);
+	void ComputeArea();
+
+	int width;
+	int height;
+	int size;
+	bool isMaxTree;
+	// Values of the channel, complemented for the min-tree
+	uint8* values;
+	int* parent;
+	// Union-find forest used while building the tiles
+	int* zpar;
+	int64* area;
+	// Pixels sorted by value, for each tile and level
+	int* order;
+	int* segmentStart;
+	int* segmentCount;
+	int tileCount;
+	int tileRows;
+	bool isBuilt;
+};
@@ -5,6 +5,27 @@
 #include "CoreMinimal.h"
 #include <ctime>
 #define MAX 256
+// Largest squares of the levels computed a row at a time
+#define FINE_LEVEL_SIZE 8
+// Cells of a row whose random values are computed together
+#define ROW_CHUNK 64
+
+/*
+*	Counter-based random generator: it returns a hash of the
+*	seed and of the index of a cell, so the value of a cell does
+*	not depend on the order in which the cells are visited
+*		seed: random seed
+*		index: index of the cell
+*/
+inline uint32 DiamondSquareHash(uint32 seed, uint64 index)
+{
+	uint64 x = ((uint64)seed << 32) ^ index;
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	x = x ^ (x >> 31);
+	return (uint32)x;
+}
 
 /**
  *	Abstract class parent of the other classes that implement
@@ -16,13 +37,55 @@ public:
 	DiamondSquareAlgorithm(int size);
 	virtual ~DiamondSquareAlgorithm();
 	virtual uint8* ExecuteDiamondSquare() = 0;
+	void SetSeed(uint32 newSeed);
+	void SetPreviewCallback(TFunction<void(const uint8* preview,
+		int previewSize, int step)> callback, int levelInterval,
+		int maxPreviewSize);
 protected:
 	virtual void DiamondSquare(int matrixSize, int maxValue) = 0;
 	virtual void DiamondStep(int row, int column,
 		int adding, int maxValue) = 0;
 	virtual void SquareStep(int row, int column,
 		int adding, int maxValue) = 0;
+	uint32 RandomHash(int row, int column) const;
+	int RandomValue(int row, int column, int maxValue) const;
+	void RandomRow(int row, int column, int stride, int count,
+		int maxValue, int* values) const;
+	void DiamondRow(int row, int half, int maxValue);
+	void SquareRow(int row, int half, int maxValue);
+	void EmitPreview(int step);
 
 	uint8* image;
 	int size;
+	uint32 seed;
+	// Fields used to send the completed levels while computing
+	TFunction<void(const uint8*, int, int)> previewCallback;
+	int previewInterval;
+	int maxPreviewSize;
 };
+
+/*
+*	It returns the random hash of a cell
+*		row: row index
+*		column: column index
+*/
+inline uint32 DiamondSquareAlgorithm::RandomHash(int row, int column) const
+{
+	return DiamondSquareHash(this->seed,
+		(uint64)row * (uint64)this->size + (uint64)column);
+}
+
+/*
+*	It returns the random displacement of a cell
+*	in the range [-maxValue/2, maxValue/2)
+*		row: row index
+*		column: column index
+*		maxValue: random seed
+*/
+inline int DiamondSquareAlgorithm::RandomValue(int row, int column,
+	int maxValue) const
+{
+	int max = maxValue / 2 > 1 ? maxValue / 2 : 1;
+	int min = -max;
+	return min + (int)(this->RandomHash(row, column) % (uint32)(max - min));
+}
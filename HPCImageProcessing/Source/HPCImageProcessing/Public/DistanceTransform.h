@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <omp.h>
+// Value of the pixels without a feature on their line
+#define DISTANCE_INFINITY 1e20f
+
+/**
+ *	This class computes the exact Euclidean distance transform of a
+ *	binary mask with the separable algorithm of Felzenszwalb and
+ *	Huttenlocher: a lower envelope of parabolas on every row, then on
+ *	every column. Rows and columns are computed in parallel.
+ *	Binary erosion and dilation by a disk are thresholds of the
+ *	distance map, so their cost does not depend on the radius.
+ */
+class HPCIMAGEPROCESSING_API DistanceTransform
+{
+public:
+	DistanceTransform(int width, int height, int threadNumber);
+	~DistanceTransform();
+	bool Compute(const uint8* mask, bool toForeground);
+	bool Erode(uint8* mask, float radius);
+	bool Dilate(uint8* mask, float radius);
+	void GetDistances(uint8* output) const;
+	const float* GetSquaredDistances() const { return this->distances; }
+	static void LowerEnvelope(float* values, int count, float curvature,
+		float* scratch, int* vertices);
+
+private:
+	int width;
+	int height;
+	int threadNumber;
+	// Squared distances of the last computed transform
+	float* distances;
+};
@@ -0,0 +1,244 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DiamondSquareAlgorithm.h"
+
+/*
+*	Traits of the samples a heightmap can be made of.
+*	Range returns the highest height, FromFloat clamps a computed
+*	value to [0, Range] instead of wrapping it around
+*/
+template <typename SampleType>
+struct THeightmapSample;
+
+template <>
+struct THeightmapSample<uint16>
+{
+	static float Range() { return 65535.0f; }
+	static uint16 FromFloat(float value)
+	{
+		value = value < 0.0f ? 0.0f : (value > Range() ? Range() : value);
+		return (uint16)(value + 0.5f);
+	}
+};
+
+template <>
+struct THeightmapSample<float>
+{
+	static float Range() { return 1.0f; }
+	static float FromFloat(float value)
+	{
+		return value < 0.0f ? 0.0f : (value > Range() ? Range() : value);
+	}
+};
+
+/**
+ *	Serial diamond-square algorithm that produces a heightmap
+ *	of uint16 or float samples. Values are clamped, so negative
+ *	displacements do not wrap around like in the 8-bit engines,
+ *	and each level is computed row by row without virtual calls
+ *	so that the inner loops can be vectorized by the compiler
+ */
+template <typename SampleType>
+class THeightmapDiamondSquare
+{
+public:
+	THeightmapDiamondSquare(int size);
+	~THeightmapDiamondSquare();
+	SampleType* ExecuteDiamondSquare();
+	void SetSeed(uint32 newSeed) { this->seed = newSeed; }
+	int GetSize() const { return this->size; }
+	static int64 GetMemoryFootprint(int size);
+	static int64 GetBandwidthCost(int size);
+private:
+	void DiamondLevel(int matrixSize, float amplitude);
+	void SquareLevel(int matrixSize, float amplitude);
+	float Random(int row, int column, float amplitude) const;
+
+	SampleType* image;
+	int size;
+	uint32 seed;
+};
+
+/*
+*	THeightmapDiamondSquare constructor.
+*	It allocates the space for the matrix
+*		size: the length of the matrix row/column
+*/
+template <typename SampleType>
+THeightmapDiamondSquare<SampleType>::THeightmapDiamondSquare(int size)
+{
+	this->size = size;
+	this->seed = (uint32)time(0);
+	this->image = (SampleType*)malloc(GetMemoryFootprint(size));
+}
+
+/*
+*	THeightmapDiamondSquare destructor.
+*	It frees the matrix allocated space
+*/
+template <typename SampleType>
+THeightmapDiamondSquare<SampleType>::~THeightmapDiamondSquare()
+{
+	free(this->image);
+}
+
+/*
+*	It returns the bytes allocated for a matrix
+*		size: the length of the matrix row/column
+*/
+template <typename SampleType>
+int64 THeightmapDiamondSquare<SampleType>::GetMemoryFootprint(int size)
+{
+	return (int64)sizeof(SampleType) * size * size;
+}
+
+/*
+*	It returns an estimate of the bytes moved to compute a matrix:
+*	each cell is written once and read by four neighbours
+*		size: the length of the matrix row/column
+*/
+template <typename SampleType>
+int64 THeightmapDiamondSquare<SampleType>::GetBandwidthCost(int size)
+{
+	return 5 * GetMemoryFootprint(size);
+}
+
+/*
+*	It executes the diamond-square algorithm
+*/
+template <typename SampleType>
+SampleType* THeightmapDiamondSquare<SampleType>::ExecuteDiamondSquare()
+{
+	typedef THeightmapSample<SampleType> Sample;
+	int last = this->size - 1;
+	float amplitude = Sample::Range();
+	if (this->image == NULL)
+	{
+		return NULL;
+	}
+	// It initializes matrix angles
+	this->image[0] = Sample::FromFloat(
+		this->Random(0, 0, amplitude) + amplitude / 2);
+	this->image[last] = Sample::FromFloat(
+		this->Random(0, last, amplitude) + amplitude / 2);
+	this->image[last * this->size] = Sample::FromFloat(
+		this->Random(last, 0, amplitude) + amplitude / 2);
+	this->image[last * this->size + last] = Sample::FromFloat(
+		this->Random(last, last, amplitude) + amplitude / 2);
+	for (int matrixSize = last; matrixSize > 1; matrixSize /= 2)
+	{
+		this->DiamondLevel(matrixSize, amplitude);
+		this->SquareLevel(matrixSize, amplitude);
+		amplitude /= 2;
+	}
+	return this->image;
+}
+
+/*	PRIVATE
+*	It returns a random displacement in [-amplitude/2, amplitude/2)
+*		row: row index
+*		column: column index
+*		amplitude: width of the range of the displacement
+*/
+template <typename SampleType>
+float THeightmapDiamondSquare<SampleType>::Random(int row, int column,
+	float amplitude) const
+{
+	uint32 hash = DiamondSquareHash(this->seed,
+		(uint64)row * (uint64)this->size + (uint64)column);
+	return ((float)(hash >> 8) * (1.0f / 16777216.0f) - 0.5f) * amplitude;
+}
+
+/*	PRIVATE
+*	Diamond step of a level: it sets the center of each square
+*	with the average of the angles plus a random value
+*		matrixSize: size of the squares of the level
+*		amplitude: width of the range of the displacement
+*/
+template <typename SampleType>
+void THeightmapDiamondSquare<SampleType>::DiamondLevel(int matrixSize,
+	float amplitude)
+{
+	typedef THeightmapSample<SampleType> Sample;
+	int last = this->size - 1;
+	int half = matrixSize / 2;
+	for (int row = half; row < last; row += matrixSize)
+	{
+		const SampleType* up = this->image + (row - half) * this->size;
+		const SampleType* down = this->image + (row + half) * this->size;
+		SampleType* out = this->image + row * this->size;
+		for (int col = half; col < last; col += matrixSize)
+		{
+			float value = (float)up[col - half] + (float)up[col + half] +
+				(float)down[col - half] + (float)down[col + half];
+			value += this->Random(row, col, amplitude);
+			out[col] = Sample::FromFloat(value * 0.25f);
+		}
+	}
+}
+
+/*	PRIVATE
+*	Square step of a level: it sets the center of each diamond
+*	with the average of the angles plus a random value. Border
+*	cells, which have three angles, are computed outside the
+*	inner loops so the inner loops have no branches
+*		matrixSize: size of the squares of the level
+*		amplitude: width of the range of the displacement
+*/
+template <typename SampleType>
+void THeightmapDiamondSquare<SampleType>::SquareLevel(int matrixSize,
+	float amplitude)
+{
+	typedef THeightmapSample<SampleType> Sample;
+	int last = this->size - 1;
+	int half = matrixSize / 2;
+	for (int row = 0; row < this->size; row += half)
+	{
+		SampleType* out = this->image + row * this->size;
+		// Rows outside the matrix are never pointed to
+		const SampleType* up = row != 0 ? out - half * this->size : NULL;
+		const SampleType* down = row != last ? out + half * this->size : NULL;
+		float value;
+		if (row % matrixSize == 0)
+		{
+			// Cells between two angles of the same row
+			for (int col = half; col < last; col += matrixSize)
+			{
+				float div = 2.0f;
+				value = (float)out[col - half] + (float)out[col + half];
+				if (up)
+				{
+					value += (float)up[col];
+					div++;
+				}
+				if (down)
+				{
+					value += (float)down[col];
+					div++;
+				}
+				value += this->Random(row, col, amplitude);
+				out[col] = Sample::FromFloat(value / div);
+			}
+		}
+		else
+		{
+			// Cells between two diamond centers of the same column
+			value = (float)up[0] + (float)down[0] + (float)out[half]
+				+ this->Random(row, 0, amplitude);
+			out[0] = Sample::FromFloat(value / 3.0f);
+			for (int col = matrixSize; col < last; col += matrixSize)
+			{
+				value = (float)up[col] + (float)down[col] +
+					(float)out[col - half] + (float)out[col + half];
+				value += this->Random(row, col, amplitude);
+				out[col] = Sample::FromFloat(value * 0.25f);
+			}
+			value = (float)up[last] + (float)down[last] +
+				(float)out[last - half] + this->Random(row, last, amplitude);
+			out[last] = Sample::FromFloat(value / 3.0f);
+		}
+	}
+}
@@ -0,0 +1,36 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Alignment of the planes and of their rows in bytes
+#define PLANE_ALIGNMENT 64
+// Rows whose pitch is a multiple of this size map to the same cache sets
+#define PLANE_ALIASING_STRIDE 1024
+// Size of the huge pages and planes from which they are used
+#define PLANE_HUGE_PAGE 2097152
+
+/**
+ *	This class allocates the planes of the image operations.
+ *	A plane starts at a 64 byte boundary and its rows are a pitch
+ *	apart, larger or equal to the width: the pitch is a multiple of
+ *	64 bytes and never a multiple of 1024 bytes, so rows are aligned
+ *	for vector loads and the rows of a window do not evict each other
+ *	on power of two widths. Offsets of the structuring elements have
+ *	to be computed with the pitch, not the width.
+ *	Planes of at least 2 MB can be backed by huge pages, where the
+ *	platform supports them. Planes are freed with Free.
+ */
+class HPCIMAGEPROCESSING_API ImagePlane
+{
+public:
+	static int GetPitch(int width, int elementSize = 1);
+	static void* Allocate(int64 size);
+	static void Free(void* plane);
+	static void SetHugePages(bool enable);
+	static bool GetHugePages() { return ImagePlane::useHugePages; }
+
+private:
+	static bool useHugePages;
+};
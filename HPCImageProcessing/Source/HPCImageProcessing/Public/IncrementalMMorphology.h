@@ -0,0 +1,46 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SerialMMorphology.h"
+
+/**
+ *	This class implements an incremental version of opening and
+ *	closing for images that are edited a little at a time. The first
+ *	execution computes the whole image and keeps the input, the
+ *	intermediate and the output; then only the rectangles that changed
+ *	are read again and recomputed, dilated by the extent of the
+ *	structuring element for the first pass and by twice the extent for
+ *	the second one, so the cost depends on the size of the edit.
+ *	The flat and the non-flat elements are supported; the paraboloid
+ *	element is not, because its support is the whole image.
+ */
+class HPCIMAGEPROCESSING_API IncrementalMMorphology
+	: public SerialMMorphology
+{
+public:
+	IncrementalMMorphology(FImage* image, int size);
+	~IncrementalMMorphology();
+	uint8* ExecuteOpeningOrClosing(bool isOpening);
+	bool UpdateRegions(const TArray<FIntRect>& changedRegions,
+		TArray<FIntRect>& updatedRegions);
+	const uint8* GetOutput() const { return this->output; }
+private:
+	FIntRect ExpandRegion(const FIntRect& region, int times) const;
+	void ReadRegion(const FIntRect& region);
+	void ErodeRegion(const uint8* in, uint8* out,
+		const FIntRect& region) const;
+	void DilateRegion(const uint8* in, uint8* out,
+		const FIntRect& region) const;
+	void ComposeRegion(const FIntRect& region);
+	void FreePlanes();
+
+	bool isOpening;
+	// Channels with ghost cells: input, first pass and second pass
+	uint8* inputPlanes[3];
+	uint8* middlePlanes[3];
+	uint8* outputPlanes[3];
+	// Output image kept between the updates
+	uint8* output;
+};
@@ -4,9 +4,21 @@
 
 #include "CoreMinimal.h"
 #include "TextureUtilities.h"
+#include "PathOpening.h"
+#include "DistanceTransform.h"
+#include "RankFilter.h"
+#include "ImagePlane.h"
+#include "MorphologyAutotuner.h"
 #define FOREGROUND 255
 #define BLACK 0
 #define WHITE 255
+// Channel values from this one are foreground in binary operations
+#define BINARY_THRESHOLD 128
+// Ordering key of the ghost cells in vector erosion and dilation
+#define KEY_MAX 0xFFFFFFFF
+#define KEY_MIN 0
+// Side of the tiles of the transposes of the separable passes
+#define TRANSPOSE_TILE 32
 
 /* structure that contains informations 
 for structuring elements */
@@ -25,6 +37,16 @@ struct Offset
 	int count = 0;
 };
 
+/* structure that contains informations
+for offsets of non-flat structuring elements */
+struct WeightedOffset
+{
+	int* rows;
+	int* cols;
+	uint8* weights;
+	int count = 0;
+};
+
 /**
  *	Abstract class parent of the other classes that implement
  *	mathematical morphology operations
@@ -35,6 +57,20 @@ public:
 	MathematicalMorphology(FImage* image, int size);
 	virtual ~MathematicalMorphology();
 	virtual uint8* ExecuteOpeningOrClosing(bool isOpening) = 0;
+	virtual uint8* ExecutePathOpeningOrClosing(bool isOpening, int length);
+	uint8* ExecuteDiskOpeningOrClosing(bool isOpening, float radius);
+	uint8* ExecuteDistanceMap();
+	uint8* ExecuteVectorOpeningOrClosing(bool isOpening);
+	uint8* ExecuteRankFilter(float percentile);
+	uint8* ExecuteMedianFilter() { return this->ExecuteRankFilter(50); }
+	void SetGenerateMips(bool generate);
+	uint8* GetFirstMip() const { return this->firstMip; }
+	void SetNonFlat(bool nonFlat);
+	void SetParaboloidElement(float radius);
+	void SetKernel(MorphologyKernel kernel);
+	void TuneKernel(bool isOpening);
+	MorphologyKernel GetExecutedKernel() const { return this->executedKernel; }
+	static StructuringElement LoadStructuringElement(int size);
 protected:
 	virtual void SplitChannels(uint8* redChannel, uint8* greenChannel, 
 		uint8* blueChannel, uint8 ghost) = 0;
@@ -42,13 +78,64 @@ protected:
 	virtual void ExecuteDilation(uint8* input, uint8* output) = 0;
 	virtual void FillGhostCells(uint8* red, uint8* green,
 		uint8* blue, uint8 value) = 0;
+	void DownsampleRows(const uint8* output, int mipRow);
+	void SplitPlanes(uint8* planes, bool invert) const;
+	void BinarizePlanes(uint8* planes) const;
+	uint8* ComposePlanes(const uint8* planes, bool invert);
+	void NonFlatErosionRow(const uint8* in, uint8* out, int row) const;
+	void NonFlatDilationRow(const uint8* in, uint8* out, int row) const;
+	void ParaboloidColumn(const uint8* in, int column, bool isErosion,
+		float* scratch, int* vertices);
+	void ParaboloidRow(uint8* out, int row, bool isErosion,
+		float* scratch, int* vertices);
+	int GetEnvelopeLength() const;
+	void PackKeys(uint32* keys, uint32 ghost) const;
+	void FillKeyGhostCells(uint32* keys, uint32 ghost) const;
+	void VectorPass(const uint32* in, uint32* out, bool isErosion) const;
+	uint8* ComposeKeys(const uint32* keys);
+	void SetOffsets(Offset *offset, bool reflect, int imageWidth) const;
+	MorphologyKernel SelectKernel();
+	uint8* ExecuteTunedOpeningOrClosing(bool isOpening);
+	uint8* ExecutePipelineOpeningOrClosing(bool isOpening);
+	void SetSeparable(bool separable);
+	void ExecuteSeparable(const uint8* in, uint8* out, bool isErosion);
+	void MinMaxRow(const uint8* source, uint8* target, int count,
+		int length, bool isErosion) const;
+	void TransposeTiles(const uint8* source, int sourcePitch, uint8* target,
+		int targetPitch, int rows, int cols) const;
 	FImage* input;
 	StructuringElement structElem;
 	Offset ErosionOffsets;
 	Offset DilationOffsets;
+	// Offsets and weights used if the element is non-flat
+	WeightedOffset ErosionWeights;
+	WeightedOffset DilationWeights;
+	bool isNonFlat;
+	// Curvature of the paraboloid element, 0 if not used
+	float paraboloidCurvature;
+	// Result of the column pass of the paraboloid element
+	float* paraboloidBuffer;
+	// Size of the element, kernel requested and kernel of the last execution
+	int elementSize;
+	MorphologyKernel kernel;
+	MorphologyKernel executedKernel;
+	// True if the element is a rectangle computed by separable passes
+	bool isSeparable;
+	// Transposed columns of the separable passes and their pitch
+	uint8* transposeBuffer;
+	int transposePitch;
+	// Distance between the rows of the channels with ghost cells
+	int pitch;
+	// Number of threads used by the operations on whole planes
+	int threadNumber;
+	// Half-size image computed while composing the output, NULL if not used
+	uint8* firstMip;
 private:
-	void LoadStructuringElement(int size);
-	void SetOffsets(Offset *offset, bool reflect);
+	void SetWeightedOffsets(WeightedOffset *offset, bool reflect);
+	void FreeWeightedOffsets();
 	static const FString fileName;
 	static const FString extension;
+	// Elements already decoded, shared by all the threads
+	static TMap<int, StructuringElement> loadedElements;
+	static FCriticalSection elementLock;
 };
@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/FileHelper.h"
+#include <atomic>
+
+/* kernels that compute the same opening or closing */
+enum MorphologyKernel
+{
+	// The kernel is chosen by the autotuner
+	MK_Auto,
+	// Minimum and maximum on the offsets of the element
+	MK_Offsets,
+	// Row passes and tiled transposes, rectangular elements only
+	MK_Separable,
+	// Fused passes on bands of rows of MorphologyPipeline
+	MK_Pipeline
+};
+
+/**
+ *	This class keeps the fastest kernel of opening and closing for
+ *	each element size, class of image size and number of threads.
+ *	The class of a size is its power of two, so images of similar
+ *	size share the measurement. The winners are written to a profile
+ *	in the saved directory of the project and read by the first
+ *	request, so each machine measures a case only once.
+ *	The measurement is done by MathematicalMorphology when its kernel
+ *	is MK_Auto: it executes every candidate the first time a case is
+ *	seen.
+ */
+class HPCIMAGEPROCESSING_API MorphologyAutotuner
+{
+public:
+	static MorphologyKernel FindKernel(int elementSize, int width, int height,
+		int threadNumber);
+	static void AddKernel(int elementSize, int width, int height,
+		int threadNumber, MorphologyKernel kernel);
+	static void SetForcedKernel(MorphologyKernel kernel);
+	static MorphologyKernel GetForcedKernel() { return MorphologyAutotuner::forcedKernel; }
+	static FCriticalSection* GetTuningLock(int elementSize, int width,
+		int height, int threadNumber);
+	static void Empty();
+
+private:
+	static uint64 GetKey(int elementSize, int width, int height,
+		int threadNumber);
+	static int GetSizeClass(int size);
+	static FString GetProfileFile();
+	static void Load();
+	static void Save();
+
+	// Fastest kernel of each case
+	static TMap<uint64, MorphologyKernel> profile;
+	static bool isLoaded;
+	// Kernel used instead of the profile, MK_Auto if none
+	static std::atomic<MorphologyKernel> forcedKernel;
+	// The profile is shared by the threads of the processing daemon
+	static FCriticalSection profileLock;
+	// Lock of each case held while it is measured, never removed
+	static TMap<uint64, TSharedPtr<FCriticalSection>> tuningLocks;
+};
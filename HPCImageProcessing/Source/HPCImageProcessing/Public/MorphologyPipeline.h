@@ -0,0 +1,113 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MathematicalMorphology.h"
+#include <omp.h>
+// Rows of the image computed together by a fused pair of passes
+#define PIPELINE_BAND_ROWS 32
+
+/* operations that can be added to a pipeline */
+enum PipelineOperation
+{
+	PO_Erosion,
+	PO_Dilation,
+	PO_Opening,
+	PO_Closing,
+	PO_Gradient
+};
+
+/**
+ *	This class executes a graph of mathematical morphology operations
+ *	on an image. Operations are recorded and computed only when the
+ *	result of a node is requested, so nodes that are not needed are
+ *	skipped. Every operation is made of erosions, dilations and
+ *	subtractions on red, green and blue planes, with ghost cells of the
+ *	size of the largest element, that stay planar between the nodes:
+ *	the image is split once and interleaved only at the end.
+ *	An erosion or dilation whose result is used only by the next pass
+ *	is fused with it: the two passes are computed band by band and the
+ *	intermediate band stays in cache. Buffers are assigned from the
+ *	last use of each result, so a chain of any length uses the same
+ *	number of buffers.
+ */
+class HPCIMAGEPROCESSING_API MorphologyPipeline
+{
+public:
+	MorphologyPipeline(FImage* image, int threadNumber);
+	~MorphologyPipeline();
+	int GetSource() const { return 0; }
+	int AddOperation(PipelineOperation operation, int elementSize, int input);
+	uint8* Execute(int output, uint8* firstMip = NULL);
+	int GetBufferCount() const { return this->buffers.Num(); }
+	int GetFusedCount() const { return this->fusedCount; }
+
+private:
+	/* steps executed by the nodes */
+	enum PipelineStep
+	{
+		PS_Source,
+		PS_Erosion,
+		PS_Dilation,
+		PS_Subtract
+	};
+
+	/* structure that describes a node of the graph */
+	struct PipelineNode
+	{
+		PipelineStep step;
+		int inputs[2];
+		int element;
+		// Fields set by the planning of an execution
+		bool isNeeded;
+		int lastUse;
+		int buffer;
+		// Node computed together with this one, -1 if none
+		int fusedInput;
+		bool isFused;
+	};
+
+	/* structure that contains a loaded structuring element */
+	struct PipelineElement
+	{
+		int size;
+		StructuringElement element;
+		int* offsets;
+		int* reflectedOffsets;
+		int count;
+	};
+
+	int AddNode(PipelineStep step, int first, int second, int element);
+	int FindElement(int size);
+	bool PlanExecution(int output);
+	bool SetPadding();
+	int TakeBuffer();
+	void SplitSource(uint8* planes) const;
+	void FillGhostCells(uint8* planes, uint8 value) const;
+	void ExecutePass(const PipelineNode& node, const uint8* in,
+		uint8* out) const;
+	void ExecuteFusedPasses(const PipelineNode& first,
+		const PipelineNode& second, const uint8* in, uint8* out,
+		uint8* bands) const;
+	void ExecuteSubtraction(const uint8* first, const uint8* second,
+		uint8* out) const;
+	void FilterRow(const uint8* in, uint8* out, const PipelineNode& node) const;
+	uint8* ComposeImage(const uint8* planes, uint8* firstMip) const;
+	void FreeBuffers();
+
+	FImage* input;
+	int threadNumber;
+	TArray<PipelineNode> nodes;
+	TArray<PipelineElement> elements;
+	// Geometry of the planes with ghost cells, rows are a pitch apart
+	int padX;
+	int padY;
+	int pitch;
+	int paddedHeight;
+	int64 planeSize;
+	// Buffers of three planes and buffers not used by a live result
+	TArray<uint8*> buffers;
+	TArray<bool> isBufferFree;
+	int fusedCount;
+};
@@ -5,6 +5,7 @@
 #include "CoreMinimal.h"
 #include "DiamondSquareAlgorithm.h"
 #include <omp.h>
+#include <atomic>
 
 /**
  * This class implements a parallel version of
@@ -26,5 +27,12 @@ protected:
 		int adding, int maxValue);
 
 private:
+	void DiamondRows(int matrixSize, int maxValue,
+		int firstRow, int endRow);
+	void SquareRows(int matrixSize, int maxValue,
+		int firstRow, int endRow);
+	void ParallelDiamondSquare(int matrixSize, int maxValue);
+	static void WaitProgress(std::atomic<int>* progress, int value);
+
 	int threadNum;
 };
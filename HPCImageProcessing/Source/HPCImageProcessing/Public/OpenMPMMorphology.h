@@ -17,6 +17,7 @@ public:
 	OpenMPMMorphology(FImage* image, int size, int threadNum);
 	~OpenMPMMorphology() {}
 	uint8* ExecuteOpeningOrClosing(bool isOpening);
+	uint8* ExecutePathOpeningOrClosing(bool isOpening, int length);
 protected:
 	void SplitChannels(uint8* redChannel,uint8* greenChannel,
 		uint8* blueChannel, uint8 ghost);
@@ -26,4 +27,6 @@ protected:
 	void ExecuteDilation(uint8* in, uint8* out);
 	void FillGhostCells(uint8* red, uint8* green,
 		uint8* blue, uint8 value);
+private:
+	void ExecuteParaboloid(uint8* in, uint8* out, bool isErosion);
 };
@@ -0,0 +1,55 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DiamondSquareAlgorithm.h"
+
+/**
+ *	This class executes the diamond-square algorithm directly into a
+ *	memory-mapped file, for terrains that do not fit in memory.
+ *	Levels with a step larger than the tile size are computed in a
+ *	small buffer that contains only the cells on the tile lattice.
+ *	The other levels are computed band by band, with the wavefront of
+ *	SerialDiamondSquare: a band of tileSize rows is a contiguous range
+ *	of the file, so pages are touched sequentially and the bands that
+ *	are completed are released. The tile size is the largest one whose
+ *	resident bands fit in the memory budget.
+ *	With the same seed the file contains the matrix of SerialDiamondSquare.
+ */
+class HPCIMAGEPROCESSING_API OutOfCoreDiamondSquare
+{
+public:
+	OutOfCoreDiamondSquare(int size, FString fileName, int64 memoryBudget);
+	~OutOfCoreDiamondSquare();
+	bool ExecuteDiamondSquare();
+	void SetSeed(uint32 newSeed) { this->seed = newSeed; }
+	int GetTileSize() const { return this->tileSize; }
+
+private:
+	bool MapFile();
+	void UnmapFile();
+	void PrefetchBand(int band);
+	void ReleaseBand(int band);
+	void LatticeDiamondSquare();
+	void CopyLatticeRow(int row);
+	void DiamondRows(int matrixSize, int maxValue,
+		int firstRow, int endRow);
+	void SquareRows(int matrixSize, int maxValue,
+		int firstRow, int endRow);
+	int RandomValue(int64 row, int64 column, int maxValue) const;
+
+	int size;
+	int tileSize;
+	uint32 seed;
+	FString fileName;
+	// Matrix of the cells whose indices are multiple of tileSize
+	uint8* lattice;
+	int latticeSize;
+	// Mapped output file
+	uint8* image;
+	int64 imageSize;
+	int64 pageSize;
+	void* fileHandle;
+	void* mappingHandle;
+};
@@ -0,0 +1,78 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#define PATH_CONES 4
+#define PATH_LEVELS 256
+
+/* cones of directions of the paths */
+enum PathCone
+{
+	PC_NorthSouth,
+	PC_EastWest,
+	PC_NorthEastSouthWest,
+	PC_NorthWestSouthEast
+};
+
+/**
+ *	This class computes the grayscale path opening of a channel in a
+ *	cone of directions: the value of a pixel is the highest threshold
+ *	at which it belongs to a path of at least length pixels whose
+ *	steps are in the cone. Thresholds are visited from the lowest one
+ *	and the pixels of each level are removed; the lengths of the
+ *	longest paths that end and start in each pixel are updated only
+ *	where they change, visiting the pixels in the order of the cone
+ *	with a bucket queue. Lengths are truncated to the path length, so
+ *	a pixel is updated at most length times.
+ *	The passes over the whole channel are split among threadNumber
+ *	threads: the pixels with the same rank depend only on the lower
+ *	ranks, so each line of pixels of a rank is computed in parallel.
+ *	An object can be used for many channels of the same size, but
+ *	not by more callers at the same time.
+ */
+class HPCIMAGEPROCESSING_API PathOpening
+{
+public:
+	PathOpening(int width, int height, int length, int threadNumber = 1);
+	~PathOpening();
+	bool ExecutePathOpening(const uint8* channel, uint8* result,
+		PathCone cone);
+
+private:
+	void SetCone(PathCone cone);
+	int GetRank(int pixel) const;
+	bool GetLinePixel(int rank, int index, int* pixel) const;
+	void ComputeLengths(bool forward);
+	bool GetNeighbour(int pixel, int step, bool forward,
+		int* neighbour) const;
+	void EnqueueNeighbours(int pixel, bool forward);
+	void UpdateResult(int pixel, uint8* result, int level);
+	void Enqueue(int pixel);
+	void Propagate(bool forward, uint8* result, int level);
+	int ComputeLength(int pixel, bool forward) const;
+
+	int width;
+	int height;
+	int length;
+	int threadNumber;
+	// Steps of the paths of the current cone
+	int rowSteps[3];
+	int colSteps[3];
+	PathCone cone;
+	// Lengths of the longest paths that start and end in each pixel
+	int* forwardLengths;
+	int* backwardLengths;
+	uint8* isActive;
+	uint8* isDone;
+	uint8* isQueued;
+	// Pixels sorted by value and first pixel of each level
+	int* pixelOrder;
+	int levelStart[PATH_LEVELS + 1];
+	// Bucket queue: a list of pixels for each rank of the cone
+	int* heads;
+	int* next;
+	int rankCount;
+	int firstRank;
+	int lastRank;
+};
@@ -0,0 +1,177 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Async.h"
+#include "HAL/Event.h"
+#include "SerialMMorphology.h"
+#include "OpenMPMMorphology.h"
+#include "CudaMMorphology.h"
+#include "SerialDiamondSquare.h"
+#include "OpenMPDiamondSquare.h"
+#include "CudaDiamondSquare.h"
+#include "ResultCache.h"
+#include <atomic>
+#include <omp.h>
+// Longest request accepted by the daemon
+#define DAEMON_LINE_LENGTH 4096
+// Seconds a client has to send its whole request
+#define DAEMON_READ_TIMEOUT 5
+// Clients whose request is read at the same time
+#define DAEMON_MAX_CLIENTS 64
+// Milliseconds an idle worker waits before looking at the queue again
+#define DAEMON_WAIT_TIME 100
+// Seconds the daemon waits for a client to read its reply
+#define DAEMON_WRITE_TIMEOUT 5
+// Prefix of the images in shared memory
+#define DAEMON_SHARED_PREFIX "shm:"
+#if PLATFORM_WINDOWS
+// Sockets are handles on Windows, as SOCKET
+typedef UPTRINT DaemonSocket;
+#else
+typedef int DaemonSocket;
+#endif
+// Value of a socket that is not open, as INVALID_SOCKET on Windows
+#define DAEMON_NO_SOCKET ((DaemonSocket)-1)
+
+/* operations executed by the daemon */
+enum DaemonOperation
+{
+	DO_Opening,
+	DO_Closing,
+	DO_Median,
+	DO_DiamondSquare
+};
+
+/* implementations that execute the jobs, as ImplementationType */
+enum DaemonImplementation
+{
+	DI_Serial,
+	DI_OpenMP,
+	DI_Cuda
+};
+
+/* structure that contains a job received by the daemon */
+struct DaemonJob
+{
+	// Socket of the client, answered when the job ends
+	DaemonSocket client;
+	DaemonOperation operation;
+	DaemonImplementation implementation;
+	int threadNumber;
+	// Size of the structuring element or of the matrix
+	int size;
+	uint32 seed;
+	// Files or shared memory objects of the images
+	FString input;
+	FString output;
+	// Time the job entered the queue
+	double queuedTime;
+};
+
+/* structure that contains a client whose request is being read */
+struct DaemonClient
+{
+	DaemonSocket socket;
+	// Bytes of the request received so far
+	ANSICHAR line[DAEMON_LINE_LENGTH];
+	int length;
+	// Time after which the client is closed
+	double deadline;
+};
+
+/* structure that contains the counters of the daemon */
+struct DaemonStatistics
+{
+	int queueDepth;
+	int runningJobs;
+	int completedJobs;
+	int failedJobs;
+	int rejectedJobs;
+	int cachedJobs;
+	// Seconds from the request to the start and to the end of the jobs
+	double averageQueueTime;
+	double averageLatency;
+	double maxLatency;
+};
+
+/**
+ *	This class is a long-running server that executes morphology and
+ *	diamond-square jobs sent by other processes on a Unix domain
+ *	socket. A client connects, sends one request line and reads one
+ *	reply line:
+ *		opening|closing|median implementation threads elementSize input output
+ *		diamondsquare implementation threads size seed output
+ *		stats
+ *	where implementation is serial, openmp or cuda, and the images are
+ *	PNG or QOI files or shm:name, a shared memory object that contains
+ *	width and height as 32 bit integers followed by the BGRA pixels.
+ *	On Linux and Mac it is a POSIX object; on Windows it is a named file
+ *	mapping, that exists only while a process has it open, so the client
+ *	creates the output with its size before sending the request and
+ *	closes it after reading the result.
+ *	The replies are "ok queueMs executionMs", "busy queueDepth",
+ *	"error reason" and the counters for stats.
+ *	A thread reads the requests of all the clients without blocking,
+ *	so a slow client does not delay the others, parses them and queues
+ *	them to a fixed set of workers; when the queue is full the request
+ *	is refused with busy,
+ *	so clients slow down instead of piling up. Workers, their OpenMP
+ *	threads, the loaded structuring elements and the results of the
+ *	previous jobs stay in memory between the jobs.
+ *	Replies are written in full even when the socket buffer of the
+ *	client is full, waiting up to DAEMON_WRITE_TIMEOUT seconds.
+ *	The socket is AF_UNIX on Linux, Mac and Windows 10 or later,
+ *	Start fails elsewhere.
+ */
+class HPCIMAGEPROCESSING_API ProcessingDaemon
+{
+public:
+	ProcessingDaemon(FString socketPath, int workerCount, int queueCapacity,
+		int64 cacheBudget);
+	~ProcessingDaemon();
+	bool Start();
+	void Stop();
+	bool IsRunning() const { return this->isRunning; }
+	DaemonStatistics GetStatistics();
+
+private:
+	void AcceptClients();
+	void HandleRequest(DaemonSocket client, FString line);
+	void RunWorker();
+	bool ParseJob(const FString& line, DaemonJob& job) const;
+	bool ExecuteJob(const DaemonJob& job, FString& error);
+	uint8* ExecuteMorphology(const DaemonJob& job, FImage* image) const;
+	uint8* ExecuteDiamondSquare(const DaemonJob& job) const;
+	uint8* FindResult(uint64 key, int& width, int& height);
+	void AddResult(uint64 key, const uint8* pixels, int width, int height);
+	FString GetStatisticsLine();
+	static FImage* ReadImage(const FString& source);
+	static bool WriteImage(const FString& target, const uint8* pixels,
+		int width, int height);
+	static bool ReadLine(DaemonClient& client, bool& isComplete);
+	static void Reply(DaemonSocket client, const FString& message);
+	static void SetNonBlocking(DaemonSocket client);
+	static void CloseClient(DaemonSocket client);
+
+	FString socketPath;
+	int workerCount;
+	int queueCapacity;
+	// Listening socket, DAEMON_NO_SOCKET if not started
+	DaemonSocket listener;
+	std::atomic<bool> isRunning;
+	// Thread that accepts the clients and the workers
+	TArray<TFuture<void>> threads;
+	// Jobs waiting for a worker, from the oldest one
+	TArray<DaemonJob> queue;
+	FCriticalSection queueLock;
+	FEvent* jobEvent;
+	// Results of the previous jobs, NULL if not used
+	ResultCache* results;
+	FCriticalSection cacheLock;
+	// Counters and sums of the times, protected by the lock of the queue
+	DaemonStatistics statistics;
+	double totalQueueTime;
+	double totalLatency;
+};
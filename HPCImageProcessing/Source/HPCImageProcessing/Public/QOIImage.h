@@ -0,0 +1,42 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Runtime/ImageCore/Public/ImageCore.h"
+#define QOI_HEADER_SIZE 14
+#define QOI_END_SIZE 8
+#define QOI_INDEX_SIZE 64
+#define QOI_MAX_RUN 62
+// Largest image accepted by the decoder, as the reference one
+#define QOI_MAX_PIXELS 400000000
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xC0
+#define QOI_OP_RGB 0xFE
+#define QOI_OP_RGBA 0xFF
+#define QOI_MASK 0xC0
+
+/**
+ *	This class encodes and decodes images in the QOI format, a
+ *	lossless format for the intermediate images: each pixel is a run
+ *	of the previous one, a pixel of a table indexed by a hash of the
+ *	colour, a small difference from the previous one or the whole
+ *	colour. There is no entropy coding, so decoding is a single pass
+ *	several times faster than PNG, directly into the image buffer.
+ *	Pixels are 4 bytes in the order of the images loaded from PNG.
+ */
+class HPCIMAGEPROCESSING_API QOIImage
+{
+public:
+	static bool Decode(const uint8* data, int64 size, FImage* image,
+		TArray<uint8>* firstMip = NULL);
+	static bool Encode(const uint8* pixels, int width, int height,
+		TArray<uint8>& data);
+
+private:
+	static int GetIndex(const uint8* pixel);
+	static uint32 ReadBigEndian(const uint8* data);
+	static void WriteBigEndian(uint8* data, uint32 value);
+};
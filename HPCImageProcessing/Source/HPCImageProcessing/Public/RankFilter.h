@@ -0,0 +1,79 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <omp.h>
+// Bins of the histograms and bins of their coarse level
+#define RANK_BINS 256
+#define RANK_COARSE_BINS 16
+#define RANK_COARSE_SHIFT 4
+
+/**
+ *	This class computes the rank filters of a channel: each pixel
+ *	takes the value at a percentile of the window of the structuring
+ *	element, so percentile 0 is the erosion and percentile 50 is the
+ *	median. Pixels outside of the image are not in the window, as the
+ *	ghost cells of erosion and dilation.
+ *	Windows are histograms with a coarse level of 16 bins, so the
+ *	value is found in 32 steps. Rectangular elements use the
+ *	algorithm of Perreault and Hebert: a histogram for each column,
+ *	moved down by one pixel for each row, and a window histogram that
+ *	adds and removes whole columns; the fine bins of the window are
+ *	updated only when the value is searched in them, so the cost
+ *	does not depend on the size of the element. Other elements move
+ *	the window histogram along the row adding and removing only the
+ *	pixels of the left and right edges of the element.
+ *	The image is split into bands of rows, one for each thread.
+ */
+class HPCIMAGEPROCESSING_API RankFilter
+{
+public:
+	RankFilter(int width, int height, const uint8* element,
+		int elementWidth, int elementHeight, int threadNumber);
+	~RankFilter();
+	bool Execute(const uint8* channel, uint8* result, float percentile);
+	bool IsRectangle() const { return this->isRectangle; }
+
+private:
+	/* histogram of a window, fine bins valid at a column each */
+	struct WindowHistogram
+	{
+		int coarse[RANK_COARSE_BINS];
+		int fine[RANK_BINS];
+		int fineColumn[RANK_COARSE_BINS];
+	};
+
+	void FilterRectangleBand(const uint8* channel, uint8* result,
+		int firstRow, int lastRow, uint16* columns,
+		uint16* coarseColumns) const;
+	void UpdateFineBins(WindowHistogram& window, const uint16* columns,
+		int bin, int col) const;
+	void FilterMaskBand(const uint8* channel, uint8* result,
+		int firstRow, int lastRow) const;
+	int GetRank(int count) const;
+	static int FindBin(const int* bins, int first, int& rank);
+
+	int width;
+	int height;
+	int threadNumber;
+	// Rows and columns of the element from the center
+	int halfWidth;
+	int halfHeight;
+	int elementWidth;
+	int elementHeight;
+	bool isRectangle;
+	// Pixels of the element that leave and enter the window when it
+	// moves right by one pixel, as rows and columns from the center
+	int* leavingRows;
+	int* leavingCols;
+	int* enteringRows;
+	int* enteringCols;
+	int edgeCount;
+	// Rows and columns of all the pixels of the element
+	int* elementRows;
+	int* elementCols;
+	int elementCount;
+	// Fraction of the window below the value, from 0 to 1
+	float fraction;
+};
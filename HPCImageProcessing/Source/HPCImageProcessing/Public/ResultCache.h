@@ -0,0 +1,86 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/List.h"
+#include "Misc/FileHelper.h"
+#include "HAL/FileManager.h"
+
+/* structure that contains a cached result */
+struct CachedResult
+{
+	uint64 key;
+	uint8* data;
+	int64 size;
+	int width;
+	int height;
+	// First mip of the image, empty if the mips were not generated
+	TArray<uint8> firstMip;
+
+	CachedResult(uint64 resultKey, uint8* resultData, int64 resultSize,
+		int resultWidth, int resultHeight);
+	~CachedResult();
+	int64 GetMemory() const { return this->size + this->firstMip.Num(); }
+};
+
+/**
+ *	This class keeps the results of the operations in memory, so an
+ *	operation executed again with the same input and parameters is not
+ *	computed. Results are addressed by a hash of the input pixels and
+ *	of the parameters; when their size exceeds the budget the least
+ *	recently used ones are removed, or written to the spill directory
+ *	and read again when they are requested.
+ *	Results are shared pointers, so a result in use stays valid
+ *	after it is removed from the cache.
+ */
+class HPCIMAGEPROCESSING_API ResultCache
+{
+public:
+	ResultCache(int64 memoryBudget, FString spillDirectory);
+	~ResultCache();
+	TSharedPtr<CachedResult> Find(uint64 key);
+	bool Contains(uint64 key) const;
+	void Add(const TSharedPtr<CachedResult>& result);
+	void Empty();
+	int64 GetMemoryBudget() const { return this->memoryBudget; }
+	int64 GetUsedMemory() const { return this->usedMemory; }
+	int GetHits() const { return this->hits; }
+	int GetMisses() const { return this->misses; }
+	int GetSpillHits() const { return this->spillHits; }
+	static uint64 HashBytes(const uint8* data, int64 size, uint64 seed);
+	static uint64 CombineHash(uint64 hash, uint64 value);
+
+private:
+	/* entry of the cache */
+	struct CacheEntry
+	{
+		TSharedPtr<CachedResult> result;
+		TDoubleLinkedList<uint64>::TDoubleLinkedListNode* node;
+	};
+
+	/* result written to the spill directory */
+	struct SpilledEntry
+	{
+		int64 size;
+		int64 mipSize;
+		int width;
+		int height;
+	};
+
+	void Evict();
+	TSharedPtr<CachedResult> ReadSpilled(uint64 key);
+	FString GetSpillFile(uint64 key) const;
+
+	int64 memoryBudget;
+	int64 usedMemory;
+	// Directory of the removed results, empty to discard them
+	FString spillDirectory;
+	TMap<uint64, CacheEntry> cache;
+	TMap<uint64, SpilledEntry> spilled;
+	// Keys of the cached results, from the most recently used
+	TDoubleLinkedList<uint64> usage;
+	int hits;
+	int misses;
+	int spillHits;
+};
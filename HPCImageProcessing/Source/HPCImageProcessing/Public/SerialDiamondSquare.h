@@ -4,6 +4,8 @@
 
 #include "CoreMinimal.h"
 #include "DiamondSquareAlgorithm.h"
+// Rows of a tile of the blocked traversal, a few bands fit in cache
+#define DEFAULT_TILE_SIZE 32
 
 /**
  * This class implements a serial version of Diamond-square algorithm
@@ -12,8 +14,7 @@ class HPCIMAGEPROCESSING_API SerialDiamondSquare
 	: public DiamondSquareAlgorithm
 {
 public:
-	SerialDiamondSquare(int size)
-		: DiamondSquareAlgorithm(size) {}
+	SerialDiamondSquare(int size, int tileSize = DEFAULT_TILE_SIZE);
 	~SerialDiamondSquare() {}
 	uint8* ExecuteDiamondSquare();
 
@@ -23,4 +24,13 @@ protected:
 		int adding, int maxValue);
 	void SquareStep(int row, int column,
 		int adding, int maxValue);
+
+private:
+	void DiamondRows(int matrixSize, int maxValue,
+		int firstRow, int endRow);
+	void SquareRows(int matrixSize, int maxValue,
+		int firstRow, int endRow);
+	void BlockedDiamondSquare(int matrixSize, int maxValue);
+
+	int tileSize;
 };
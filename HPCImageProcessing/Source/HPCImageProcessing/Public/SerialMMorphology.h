@@ -26,4 +26,6 @@ protected:
 	void ExecuteDilation(uint8* in, uint8* out);
 	void FillGhostCells(uint8* red, uint8* green, 
 		uint8* blue, uint8 value);
+private:
+	void ExecuteParaboloid(uint8* in, uint8* out, bool isErosion);
 };
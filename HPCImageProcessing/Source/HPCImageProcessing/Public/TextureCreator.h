@@ -8,10 +8,20 @@
 #include "SerialDiamondSquare.h"
 #include "OpenMPDiamondSquare.h"
 #include "CudaDiamondSquare.h"
+#include "HeightmapDiamondSquare.h"
 #include "SerialMMorphology.h"
 #include "OpenMPMMorphology.h"
 #include "CudaMMorphology.h"
+#include "IncrementalMMorphology.h"
+#include "MorphologyPipeline.h"
+#include "ComponentTree.h"
+#include "Watershed.h"
+#include "ResultCache.h"
+#include "ProcessingDaemon.h"
 #include "TextureUtilities.h"
+#include "Async/Async.h"
+#include "Containers/Queue.h"
+#include <atomic>
 #include <Math.h>
 #include "TextureCreator.generated.h"
 
@@ -24,6 +34,33 @@ enum ImplementationType
 	IT_Cuda UMETA(DisplayName = "Cuda"),
 };
 
+//It is used to force the kernel of opening and closing
+UENUM(BlueprintType)
+enum KernelType
+{
+	KT_Auto UMETA(DisplayName = "Fastest"),
+	KT_Offsets UMETA(DisplayName = "Offsets"),
+	KT_Separable UMETA(DisplayName = "Separable"),
+	KT_Pipeline UMETA(DisplayName = "Pipeline"),
+};
+
+//It is used to specify the sample type of a heightmap
+UENUM(BlueprintType)
+enum HeightmapFormat
+{
+	HF_R16 UMETA(DisplayName = "16 bit"),
+	HF_Float UMETA(DisplayName = "Float"),
+};
+
+/* structure that contains a matrix sent by a progressive execution */
+struct ProgressiveMatrix
+{
+	uint8* matrix;
+	int size;
+	bool isFinal;
+	float executionTime;
+};
+
 /**
  * 
  */
@@ -35,15 +72,106 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "DiamondSquare")
 		static UTexture2D* CreateProceduralTexture(ImplementationType implementationType,
 			int size, int threadNumber, float &executionTime);
+	UFUNCTION(BlueprintCallable, Category = "DiamondSquare")
+		static UTexture2D* CreateHeightmap(HeightmapFormat format,
+			int size, float &executionTime, float &memoryFootprint,
+			bool &isSaved);
+	UFUNCTION(BlueprintCallable, Category = "DiamondSquare")
+		static bool StartProgressiveTexture(ImplementationType implementationType,
+			int size, int threadNumber, int levelInterval);
+	UFUNCTION(BlueprintCallable, Category = "DiamondSquare")
+		static UTexture2D* GetProgressiveTexture(bool &isFinished,
+			float &executionTime);
+	UFUNCTION(BlueprintCallable, Category = "TextureUtilities")
+		static void SetGenerateMips(bool generate);
+	UFUNCTION(BlueprintCallable, Category = "TextureUtilities")
+		static void SetHugePages(bool enable);
+	UFUNCTION(BlueprintCallable, Category = "TextureUtilities")
+		static void SetResultCache(int memoryBudget, bool spillToDisk);
+	UFUNCTION(BlueprintCallable, Category = "TextureUtilities")
+		static void GetResultCacheStatistics(int &hits, int &misses,
+			int &spillHits, float &usedMemory);
+	UFUNCTION(BlueprintCallable, Category = "TextureUtilities")
+		static bool StartDaemon(FString socketPath, int workerCount,
+			int queueCapacity, int memoryBudget);
+	UFUNCTION(BlueprintCallable, Category = "TextureUtilities")
+		static void StopDaemon();
+	UFUNCTION(BlueprintCallable, Category = "TextureUtilities")
+		static void GetDaemonStatistics(int &queueDepth, int &runningJobs,
+			int &completedJobs, int &rejectedJobs, float &averageLatency,
+			float &maxLatency);
+	UFUNCTION(BlueprintCallable, Category = "DiamondSquare")
+		static void SetTerrainSeed(int seed);
+	UFUNCTION(BlueprintCallable, Category = "DiamondSquare")
+		static void SetTerrainTileSize(int tileSize);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static void SetNonFlatElement(bool nonFlat);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static void SetParaboloidRadius(float radius);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static void SetSeparableElement(bool separable);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static void ForceMorphologyKernel(KernelType kernel);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static void ResetMorphologyProfile();
 	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
 		static UTexture2D* LoadImage();
 	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
 		static UTexture2D* ExecuteMMOperation(ImplementationType implementationType,
 			int threadNumber, float &executionTime, bool isOpening, int structElemSize);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static UTexture2D* ExecutePathOperation(ImplementationType implementationType,
+			int threadNumber, float &executionTime, bool isOpening, int pathLength);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static UTexture2D* ExecuteAreaOperation(ImplementationType implementationType,
+			int threadNumber, float &executionTime, bool isOpening, int minArea);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static UTexture2D* ExecuteDiskOperation(ImplementationType implementationType,
+			int threadNumber, float &executionTime, bool isOpening, float radius,
+			bool isDistanceMap);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static UTexture2D* ExecuteVectorMMOperation(ImplementationType implementationType,
+			int threadNumber, float &executionTime, bool isOpening, int structElemSize);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static UTexture2D* ExecuteRankFilterOperation(ImplementationType implementationType,
+			int threadNumber, float &executionTime, float percentile, int structElemSize);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static UTexture2D* ExecuteWatershedOperation(
+			ImplementationType implementationType, int threadNumber,
+			float &executionTime, float &megapixelsPerSecond, int markerLevel);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static UTexture2D* ExecuteMMPipeline(int threadNumber,
+			float &executionTime, const TArray<FString>& operations);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static UTexture2D* StartIncrementalMMOperation(float &executionTime,
+			bool isOpening, int structElemSize);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static bool WriteImagePixels(FIntPoint origin, int width,
+			const TArray<FColor>& pixels);
+	UFUNCTION(BlueprintCallable, Category = "MathematicalMorphology")
+		static bool UpdateIncrementalMMOperation(float &executionTime);
 private:
+	static DiamondSquareAlgorithm* CreateDiamondSquare(
+		ImplementationType implementationType, int size, int threadNumber);
+	static MathematicalMorphology* CreateMMorphology(
+		ImplementationType implementationType, int threadNumber,
+		int structElemSize);
+	static UTexture2D* CreateMMTexture(MathematicalMorphology* implementation,
+		uint8* output);
+	static bool BuildComponentTrees(int threadNumber, bool isMaxTree);
+	static void FreeComponentTrees();
+	static void FreeIncrementalMMorphology();
+	static uint64 GetImageHash();
+	static UTexture2D* FindCachedTexture(uint64 key);
+	static void CacheTexture(uint64 key, UTexture2D* texture);
 	static UTexture2D* CreateChannels(uint8* matrix);
+	static UTexture2D* WriteChannels(const uint8* matrix);
+	static UTexture2D* CreatePreviewTexture(const uint8* matrix, int size);
 	static UTexture2D* CreateTexture();
 	static void CreateImageInfo();
+	static void AllocateMipChain();
+	static void FillMipChain(int firstLevel);
+	static void DownsampleWrittenRow(const uint8* data, int row);
 
 	static const EPixelFormat pixelFormat;
 	static uint8* imageData;
@@ -51,4 +179,34 @@ private:
 	static int sizeX;
 	static int sizeY;
 	static FImage* image;
+	//Mips of the texture from the second one, used if generateMips is true
+	static bool generateMips;
+	static TArray<TArray<uint8>> mipChain;
+	static TArray<uint8> textureFirstMip;
+	//Structuring element options of mathematical morphology
+	static bool nonFlatElement;
+	static float paraboloidRadius;
+	static bool separableElement;
+	static KernelType morphologyKernel;
+	//Component trees of the loaded image, kept between area operations
+	static ComponentTree* componentTrees[3];
+	//Fields used by the incremental mathematical morphology
+	static IncrementalMMorphology* incrementalMorphology;
+	static UTexture2D* incrementalTexture;
+	static TArray<FIntRect> changedRegions;
+	//Fields used by the result cache
+	static ResultCache* resultCache;
+	static TMap<uint64, TWeakObjectPtr<UTexture2D>> cachedTextures;
+	static TSharedPtr<CachedResult> shownResult;
+	static uint64 imageHash;
+	static bool isImageHashValid;
+	static int terrainSeed;
+	static int terrainTileSize;
+	//Server of the jobs of other processes, NULL if not started
+	static ProcessingDaemon* daemon;
+	//Fields used by the progressive execution
+	static const int maxPreviewSize;
+	static TQueue<ProgressiveMatrix, EQueueMode::Mpsc> progressiveQueue;
+	static std::atomic<bool> isProgressiveRunning;
+	static uint8* previewData;
 };
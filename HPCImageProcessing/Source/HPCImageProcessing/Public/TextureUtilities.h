@@ -11,10 +11,13 @@
 #include "Runtime/ImageWrapper/Public/IImageWrapperModule.h"
 #include "Runtime/ImageCore/Public/ImageCore.h"
 #include "Runtime/Engine/Classes/Engine/Texture2D.h"
+#include "QOIImage.h"
 #include "TextureUtilities.generated.h"
 
 #define ALPHA 255
 #define CHANNELS 4
+// Bytes written by each call when a raw heightmap is saved
+#define RAW_WRITE_CHUNK (64 * 1024 * 1024)
 
 /* This structure is used to save the image */
 struct ImageInfo
@@ -46,12 +49,29 @@ public:
 		static void SaveToPNG(AlgorithmType algorithm);
 	static void SetImageInfo(ImageInfo image);
 	static TArray<FString> OpenFileDialog();
-	static FImage* LoadImageFromFile(FString file);
+	static FImage* LoadImageFromFile(FString file,
+		TArray<uint8>* firstMip = NULL);
+	static bool SaveToPNGFile(const uint8* data, int width,
+		int height, FString file);
+	static bool SaveToQOIFile(const uint8* data, int width,
+		int height, FString file);
+	static bool IsQOIFile(const FString& file);
+	static bool SaveToR16PNG(const uint16* data, int width,
+		int height, FString name);
+	static bool SaveToRawFloat(const float* data, int width,
+		int height, FString name);
+	static void DownsampleImage(const uint8* input, int width,
+		int height, uint8* output);
+	static void DownsampleRow(const uint8* input, int width,
+		int height, int outRow, uint8* output);
 private:
+	static FString GetFreeFileName(FString name, FString extension);
 	// Fields used to save the new image
 	static ImageInfo info;
 	static const FString filePath;
 	static const FString extensionFile;
+	static const FString rawExtensionFile;
+	static const FString qoiExtensionFile;
 	//Fields used to load or save an image
 	static const EImageFormat imageFormat;
 	static const ERGBFormat RGBFormat;
@@ -0,0 +1,68 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <omp.h>
+#define WATERSHED_LEVELS 256
+// Cost of the pixels that no marker reaches
+#define WATERSHED_UNREACHED 256
+
+/**
+ *	This class computes the marker-controlled watershed of a gradient
+ *	channel. Each connected component of the markers (4-connectivity)
+ *	gets a label and floods the gradient: a pixel takes the label of
+ *	the marker it reaches with the lowest path cost, where the cost of
+ *	a path is its highest gradient value. Pixels are flooded in order
+ *	of cost with a hierarchical queue: a FIFO bucket for each of the
+ *	256 gradient values.
+ *	With more threads the channel is split in horizontal tiles that
+ *	are flooded independently; then the costs of the border rows are
+ *	exchanged and the tiles that improve are flooded again, until no
+ *	cost changes. The costs are the same as the serial ones, labels
+ *	can differ only on pixels reached at the same cost by two markers.
+ */
+class HPCIMAGEPROCESSING_API Watershed
+{
+public:
+	Watershed(int width, int height);
+	~Watershed();
+	bool Compute(const uint8* gradient, const uint8* markers,
+		int threadNumber);
+	int GetLabel(int pixel) const { return this->labels[pixel]; }
+	int GetLabelCount() const { return this->labelCount; }
+	bool IsBoundary(int pixel) const;
+	double GetExecutionTime() const { return this->executionTime; }
+	double GetMegapixelsPerSecond() const;
+
+private:
+	int LabelMarkers(const uint8* markers);
+	void SeedTile(int tile, int* heads, int* tails);
+	int SeedBorder(int tile, bool isUpper, int* heads, int* tails);
+	void FloodTile(int tile, int* heads, int* tails);
+	void SaveBorders();
+	void Push(int pixel, int* heads, int* tails);
+	void Remove(int pixel, int* heads, int* tails);
+
+	int width;
+	int height;
+	int size;
+	const uint8* gradient;
+	int* labels;
+	// Highest gradient value of the best path from a marker
+	int* costs;
+	// Doubly-linked FIFO lists of the bucket queues
+	int* next;
+	int* prev;
+	uint8* isQueued;
+	// Bucket queues, WATERSHED_LEVELS lists for each tile
+	int* heads;
+	int* tails;
+	// Costs and labels of the rows next to the tile borders
+	int* borderCosts;
+	int* borderLabels;
+	int tileCount;
+	int tileRows;
+	int labelCount;
+	double executionTime;
+};
@@ -21,5 +21,6 @@ public:
 	static uint8_t* ExecuteOpeningOrClosing(int structWidth,
 		int structHeight, uint8_t* image, int width, 
 		int height, int* erOffset, int erCount,
-		int* dilOffset, int dilCount, bool isOpening);
+		int* dilOffset, int dilCount, bool isOpening,
+		uint8_t* firstMip = NULL);
 };
\ No newline at end of file
@@ -182,6 +182,35 @@ __global__ void Dilation(uint8_t* input, uint8_t* output,
 	}
 }
 
+/*
+*	Kernel that computes the first mip of the output image:
+*	each pixel is the average of 2x2 pixels of the image
+*		image: output image
+*		mip: first mip, max(width/2, 1) x max(height/2, 1) pixels
+*		width: image width
+*		height: image height
+*/
+__global__ void DownsampleImage(uint8_t* image, uint8_t* mip,
+	int width, int height)
+{
+	int mipWidth = width > 1 ? width / 2 : 1;
+	int mipHeight = height > 1 ? height / 2 : 1;
+	int x = blockIdx.x*blockDim.x + threadIdx.x;
+	int y = blockIdx.y*blockDim.y + threadIdx.y;
+	if (x < mipWidth && y < mipHeight)
+	{
+		int left = 2 * x * CHANNELS;
+		int right = (2 * x + 1 < width ? 2 * x + 1 : 2 * x) * CHANNELS;
+		uint8_t* top = image + 2 * y * width * CHANNELS;
+		uint8_t* bottom = 2 * y + 1 < height ? top + width * CHANNELS : top;
+		for (int c = 0; c < CHANNELS; c++)
+		{
+			mip[(y*mipWidth + x)*CHANNELS + c] = (top[left + c] +
+				top[right + c] + bottom[left + c] + bottom[right + c] + 2) / 4;
+		}
+	}
+}
+
 /*
 *	Function that will be called by the Unreal Engine classes to 
 *	execute opening or closing operations with CUDA
@@ -196,11 +225,13 @@ __global__ void Dilation(uint8_t* input, uint8_t* output,
 *		dilCount: number of elements in dilOffset
 *		isOpening: true if we have to execute opening operations,
 *			false otherwise
+*		firstMip: first mip of the output, computed on the device
+*			from the composed image, NULL if not used
 */
 uint8_t* CudaMathMorphology::ExecuteOpeningOrClosing(int structWidth,
 	int structHeight, uint8_t* image, int width,
 	int height, int* erOffset, int erCount,
-	int* dilOffset, int dilCount, bool isOpening)
+	int* dilOffset, int dilCount, bool isOpening, uint8_t* firstMip)
 {
 	int32_t imageSize = width * height * CHANNELS;
 	int32_t size = imageSize * sizeof(uint8_t);
@@ -306,6 +337,21 @@ uint8_t* CudaMathMorphology::ExecuteOpeningOrClosing(int structWidth,
 		d_red, d_green, d_blue, structWidth,
 		structHeight, width, height);
 	cudaMemcpy(output, d_output, size, cudaMemcpyDeviceToHost);
+	if (firstMip)
+	{
+		//first mip of the composed image
+		int mipWidth = width > 1 ? width / 2 : 1;
+		int mipHeight = height > 1 ? height / 2 : 1;
+		int32_t mipSize = mipWidth * mipHeight * CHANNELS * sizeof(uint8_t);
+		uint8_t* d_mip;
+		dim3 grid_mip((mipWidth + BLOCK_2D - 1) / BLOCK_2D,
+			(mipHeight + BLOCK_2D - 1) / BLOCK_2D);
+		cudaMalloc((void**)&d_mip, mipSize);
+		DownsampleImage<<<grid_mip, block_2D>>>(d_output, d_mip,
+			width, height);
+		cudaMemcpy(firstMip, d_mip, mipSize, cudaMemcpyDeviceToHost);
+		cudaFree(d_mip);
+	}
 	cudaFree(d_Image);
 	cudaFree(d_red);
 	cudaFree(d_green);